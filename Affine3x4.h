@@ -0,0 +1,62 @@
+#pragma once
+
+// The math types together with their inline definitions
+#include <assimp/types.h>
+
+// Affine transformation kept as the top three rows of a row-major 4x4 matrix,
+// the last row is always 0 0 0 1 and not stored. Used for the bone and joint
+// transformations that are evaluated every frame: a product takes 36 multiplies
+// instead of 64 and a bone moves 48 bytes per matrix instead of 64. The layout
+// is the one of the skinning palette. aiMatrix4x4 is only built where OpenGL
+// or the importer need it.
+class Affine3x4
+{
+public:
+	Affine3x4() : m{1.f, 0.f, 0.f, 0.f, 0.f, 1.f, 0.f, 0.f, 0.f, 0.f, 1.f, 0.f} {}
+
+	// Drops the last row, which has to be 0 0 0 1 for the result to be exact
+	explicit Affine3x4(const aiMatrix4x4t<float>& mat)
+		: m{mat.a1, mat.a2, mat.a3, mat.a4, mat.b1, mat.b2, mat.b3, mat.b4, mat.c1, mat.c2, mat.c3, mat.c4} {}
+
+	// Scales first, then rotates, then translates
+	Affine3x4(const aiVector3D& scaling, const aiQuaternion& rotation, const aiVector3D& position)
+	{
+		aiMatrix3x3t<float> r = rotation.GetMatrix();
+		m[0] = r.a1 * scaling.x; m[1] = r.a2 * scaling.y; m[2] = r.a3 * scaling.z; m[3] = position.x;
+		m[4] = r.b1 * scaling.x; m[5] = r.b2 * scaling.y; m[6] = r.b3 * scaling.z; m[7] = position.y;
+		m[8] = r.c1 * scaling.x; m[9] = r.c2 * scaling.y; m[10] = r.c3 * scaling.z; m[11] = position.z;
+	}
+
+	aiMatrix4x4t<float> toMatrix4() const
+	{
+		return aiMatrix4x4t<float>(m[0], m[1], m[2], m[3], m[4], m[5], m[6], m[7],
+			m[8], m[9], m[10], m[11], 0.f, 0.f, 0.f, 1.f);
+	}
+
+	Affine3x4 operator*(const Affine3x4& b) const
+	{
+		Affine3x4 r;
+		for (int i = 0; i < 12; i += 4)
+		{
+			r.m[i] = m[i] * b.m[0] + m[i + 1] * b.m[4] + m[i + 2] * b.m[8];
+			r.m[i + 1] = m[i] * b.m[1] + m[i + 1] * b.m[5] + m[i + 2] * b.m[9];
+			r.m[i + 2] = m[i] * b.m[2] + m[i + 1] * b.m[6] + m[i + 2] * b.m[10];
+			r.m[i + 3] = m[i] * b.m[3] + m[i + 1] * b.m[7] + m[i + 2] * b.m[11] + m[i + 3];
+		}
+		return r;
+	}
+
+	bool operator==(const Affine3x4& b) const
+	{
+		for (int i = 0; i < 12; ++i)
+			if (m[i] != b.m[i])
+				return false;
+		return true;
+	}
+
+	bool operator!=(const Affine3x4& b) const { return !(*this == b); }
+
+	const float* data() const { return m; }
+
+	float m[12];
+};
@@ -0,0 +1,61 @@
+#include "ControlSnapshot.h"
+
+#include <algorithm>
+
+using namespace std;
+
+ControlSnapshot* ControlSnapshot::Instance()
+{
+	static ControlSnapshot snapshot;
+	return &snapshot;
+}
+
+void ControlSnapshot::reset(int num_controls)
+{
+	lock_guard<mutex> lock(pending_mutex);
+	pending.assign(num_controls, 0.f);
+	pending_dirty.assign(num_controls, 1);
+	pending_changed = true;
+	values.assign(num_controls, 0.f);
+	dirty.assign(num_controls, 0);
+}
+
+void ControlSnapshot::set(int control, float value)
+{
+	lock_guard<mutex> lock(pending_mutex);
+	if (pending[control] == value)
+		return;
+
+	pending[control] = value;
+	pending_dirty[control] = 1;
+	pending_changed = true;
+}
+
+bool ControlSnapshot::beginFrame()
+{
+	lock_guard<mutex> lock(pending_mutex);
+	if (!pending_changed)
+	{
+		fill(dirty.begin(), dirty.end(), 0);
+		return false;
+	}
+
+	// Swap so that neither side allocates, then bring pending up to date again
+	values.swap(pending);
+	dirty.swap(pending_dirty);
+	pending = values;
+	fill(pending_dirty.begin(), pending_dirty.end(), 0);
+	pending_changed = false;
+
+	if (++current_generation == 0)
+		current_generation = 1;
+	return true;
+}
+
+bool ControlSnapshot::changed(int first, int last) const
+{
+	for (int i = first; i <= last; ++i)
+		if (dirty[i])
+			return true;
+	return false;
+}
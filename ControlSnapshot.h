@@ -0,0 +1,51 @@
+#pragma once
+
+#include <vector>
+#include <mutex>
+
+// Values of the UI controls as seen by one frame.
+// The UI writes every change with set, which only touches the pending copy,
+// and the frame takes them over at once with beginFrame. Drawing reads plain
+// memory and can tell which controls changed since the previous frame.
+class ControlSnapshot
+{
+public:
+	static ControlSnapshot* Instance();
+
+	// Drop all values, every control starts at 0
+	void reset(int num_controls);
+
+	// Called by the UI whenever a control changes, safe from any thread
+	void set(int control, float value);
+
+	// Publish the changes made since the last call, returns true if there were any
+	bool beginFrame();
+
+	int numControls() const { return values.size(); }
+
+	float value(int control) const { return values[control]; }
+
+	// Whether the control changed between the previous frame and this one
+	bool changed(int control) const { return dirty[control] != 0; }
+
+	// Whether any of the controls in [first, last] changed
+	bool changed(int first, int last) const;
+
+	// Incremented by every frame with changes, never 0. Compare it with a
+	// stored value to know whether anything changed since some older frame.
+	unsigned generation() const { return current_generation; }
+
+private:
+	ControlSnapshot() = default;
+	ControlSnapshot(const ControlSnapshot&) = delete;
+	ControlSnapshot& operator=(const ControlSnapshot&) = delete;
+
+	std::mutex pending_mutex;			// guards the pending values
+	std::vector<float> pending;
+	std::vector<char> pending_dirty;
+	bool pending_changed{false};
+
+	std::vector<float> values;				// used by the current frame
+	std::vector<char> dirty;
+	unsigned current_generation{1};
+};
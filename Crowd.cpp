@@ -0,0 +1,142 @@
+#include "Crowd.h"
+#include "Skinning.h"
+#include "WorkerPool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+using namespace std;
+
+// Instances turn at most this far away from the heading of the mesh, in degrees
+static const float kMaxHeading = 30.f;
+
+// Instances are moved at most this fraction of the spacing off their grid cell
+static const float kJitter = 0.25f;
+
+void Crowd::build(int mesh_index, int count, float spacing, unsigned seed)
+{
+	clear();
+	if (count <= 0)
+		return;
+
+	this->mesh_index = mesh_index;
+	this->spacing = spacing;
+
+	mt19937 rng(seed);
+	uniform_real_distribution<float> jitter(-kJitter * spacing, kJitter * spacing);
+	uniform_real_distribution<float> heading(-kMaxHeading, kMaxHeading);
+	uniform_real_distribution<float> phase(0.f, 2.f * AI_MATH_PI_F);
+	uniform_real_distribution<float> pace(0.8f, 1.2f);
+
+	// The grid is centered on the mesh itself, whose cell is left free
+	int side = int(ceil(sqrt(float(count + 1))));
+	int half = side / 2;
+	instances.resize(count);
+	int cell = 0;
+	for (auto& instance : instances)
+	{
+		int x, y;
+		do
+		{
+			x = cell % side - half;
+			y = cell / side - half;
+			++cell;
+		} while (x == 0 && y == 0);
+
+		// The model is z-up, the herd stands in the xy plane
+		aiMatrix4x4t<float> rotation, translation;
+		aiMatrix4x4t<float>::RotationZ(AI_MATH_PI_F * heading(rng) / 180.f, rotation);
+		aiMatrix4x4t<float>::Translation(aiVector3D(x * spacing + jitter(rng), y * spacing + jitter(rng), 0.f), translation);
+		instance.mesh_index = mesh_index;
+		instance.root = Affine3x4(translation * rotation);
+		instance.phase = phase(rng);
+		instance.pace = pace(rng);
+	}
+}
+
+void Crowd::clear()
+{
+	instances.clear();
+	mesh_index = -1;
+	spacing = 0.f;
+}
+
+// Pose and skin one instance, instance is the only thing written
+static void poseInstance(const ModelHelper& helper, float t, SkinningMethod method, const Frustum& frustum,
+	CharacterInstance& instance)
+{
+	const Mesh& mesh = helper.meshes[instance.mesh_index];
+	if (instance.posed_mesh == instance.mesh_index && instance.posed_t == t && instance.posed_method == method)
+	{
+		instance.visible = frustum.transformed(instance.root).boxVisible(instance.aabb_min, instance.aabb_max);
+		return;
+	}
+
+	if (instance.buffer_mesh != instance.mesh_index)
+	{
+		instance.bone_locals.resize(mesh.bones.size());
+		instance.joint_globals.resize(helper.joints.size());
+		// A mesh without bones is skinned with a single identity entry, as SkinData indexes it
+		instance.bone_finals.assign(max<size_t>(1, mesh.bones.size()), Affine3x4());
+		instance.vertices = mesh.vertices;		// keeps the texture coordinates
+		instance.buffer_mesh = instance.mesh_index;
+		instance.posed_mesh = -1;
+	}
+
+	// Every instance starts from the bind pose
+	const BoneHandle* control_bones = mesh.control_bones.data();
+	Affine3x4 pose[NUM_CONTROL_BONES];
+	walkCycle(t * instance.pace + instance.phase, pose);
+	fill(instance.bone_locals.begin(), instance.bone_locals.end(), Affine3x4());
+	for (int b = 0; b < NUM_CONTROL_BONES; ++b)
+		if (control_bones[b].valid())
+			instance.bone_locals[control_bones[b].index] = pose[b];
+
+	helper.evaluatePose(mesh, instance.bone_locals.data(), instance.joint_globals.data(), instance.bone_finals.data());
+
+	// Culled instances are posed again next frame, but not skinned until they are visible
+	int num_vertices = mesh.skin.num_vertices;
+	calPoseBounds(mesh.skin, instance.bone_finals.data(), method, instance.aabb_min, instance.aabb_max);
+	instance.visible = num_vertices > 0 && frustum.transformed(instance.root).boxVisible(instance.aabb_min, instance.aabb_max);
+	if (!instance.visible)
+		return;
+	instance.posed_mesh = instance.mesh_index;
+	instance.posed_t = t;
+	instance.posed_method = method;
+
+	const float* palette = instance.bone_finals.data()->data();
+	if (method == SkinningMethod::DUAL_QUATERNION)
+	{
+		buildDualQuatPalette(instance.bone_finals, instance.dual_quat_palette);
+		palette = instance.dual_quat_palette.data();
+	}
+	skinVertices(skinning_kernel, method, mesh.skin, palette, 0, num_vertices, instance.vertices.data());
+	calBounds(instance.vertices.data(), 0, num_vertices, instance.aabb_min, instance.aabb_max);
+}
+
+void Crowd::update(ModelHelper& helper, float t, SkinningMethod method, const Frustum& frustum)
+{
+	if (instances.empty())
+		return;
+
+	// Resolved here for every mesh an instance may use, the workers only read them
+	for (auto& mesh : helper.meshes)
+		mesh.controlBones();
+
+	// The job captures a single reference so that it fits into the Job without an allocation
+	struct
+	{
+		const ModelHelper& helper;
+		float t;
+		SkinningMethod method;
+		const Frustum& frustum;
+		vector<CharacterInstance>& instances;
+	} frame{helper, t, method, frustum, instances};
+
+	WorkerPool::Instance()->parallelFor(instances.size(), kCrowdChunkSize, [&frame](int chunk, int begin, int end)
+	{
+		for (int i = begin; i < end; ++i)
+			poseInstance(frame.helper, frame.t, frame.method, frame.frustum, frame.instances[i]);
+	});
+}
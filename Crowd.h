@@ -0,0 +1,66 @@
+#pragma once
+
+#include <vector>
+#include "ModelHelper.h"
+#include "Frustum.h"
+
+// Number of instances handed to a worker at once
+constexpr int kCrowdChunkSize = 4;
+
+// One copy of a mesh in a crowd. The bind data (skin, bones, indices, texture)
+// stays in the shared Mesh, an instance only owns its pose and skinned vertices.
+class CharacterInstance
+{
+public:
+	int mesh_index{-1};		// mesh drawn for this instance, e.g. a level of detail of the crowd's mesh
+	int level{0};			// level of detail picked last time
+	Affine3x4 root;			// from instance space to mesh space
+	float phase{0.f};		// offset into the walk cycle
+	float pace{1.f};		// walk cycle speed relative to the animation tick
+
+	std::vector<Affine3x4> bone_locals;		// per bone of the mesh
+	std::vector<Affine3x4> joint_globals;	// per joint
+	std::vector<Affine3x4> bone_finals;		// per bone, also the linear blend skinning palette
+	std::vector<float> dual_quat_palette;
+	std::vector<Vertex> vertices;			// skinned, in instance space
+	aiVector3D aabb_min, aabb_max;
+	bool visible{true};		// false if culled by the last update, vertices are then out of date
+
+	// What vertices were skinned for, update skips instances where nothing changed
+	int buffer_mesh{-1};		// mesh the vectors above are set up for
+	int posed_mesh{-1};
+	float posed_t{0.f};
+	SkinningMethod posed_method{SkinningMethod::LINEAR};
+};
+
+// A herd of independently posed copies of one mesh, or of its levels of detail.
+// update poses and skins all of them at once, instances are spread over the
+// worker pool in chunks and each one is evaluated and skinned by a single thread.
+class Crowd
+{
+public:
+	// Place count instances of helper.meshes[mesh_index] on a jittered grid in the
+	// ground plane of the mesh, spacing apart, each with a random heading and phase
+	void build(int mesh_index, int count, float spacing, unsigned seed = 1);
+	void clear();
+
+	// Pose every instance in the walk cycle at time t and skin its mesh with method.
+	// Instances whose mesh, time and method are the same as last time are skipped,
+	// and so is the skinning of instances whose pose bounds are outside frustum,
+	// which is given in the space the roots map to.
+	void update(ModelHelper& helper, float t, SkinningMethod method, const Frustum& frustum = Frustum());
+
+	bool matches(int mesh_index, int count, float spacing) const
+	{
+		return mesh_index == this->mesh_index && count == instances.size() && spacing == this->spacing;
+	}
+
+	int meshIndex() const { return mesh_index; }
+	int size() const { return instances.size(); }
+
+	std::vector<CharacterInstance> instances;
+
+private:
+	int mesh_index{-1};
+	float spacing{0.f};
+};
@@ -0,0 +1,95 @@
+#include "FrameScheduler.h"
+
+#include <FL/Fl.H>
+#include <FL/Fl_Widget.H>
+#include <algorithm>
+
+using namespace std;
+
+// A redraw that was not drawn in this time is given up on, e.g. if the window is hidden
+static const double kPendingTimeout = 0.5;
+
+// Frames further apart than this were idle in between, which says nothing about the pacing
+static const double kIdleInterval = 0.25;
+
+// Weight of the newest frame in the measured averages
+static const double kAverageWeight = 0.1;
+
+FrameScheduler* FrameScheduler::Instance()
+{
+	static FrameScheduler scheduler;
+	return &scheduler;
+}
+
+double FrameScheduler::now() const
+{
+	return chrono::duration<double>(chrono::steady_clock::now() - origin).count();
+}
+
+void FrameScheduler::requestFrame()
+{
+	if (timer_armed)
+		return;
+	if (frame_pending && now() - pending_since < kPendingTimeout)
+		return;
+
+	// Start the next frame one period after the last one, or right away if that has passed.
+	// Late frames are not caught up on, so they cannot pile up.
+	double delay = 0.0;
+	if (target_fps > 0.0 && last_begin >= 0.0)
+		delay = max(0.0, last_begin + 1.0 / target_fps - now());
+
+	timer_armed = true;
+	Fl::add_timeout(delay, FrameScheduler::tick, this);
+}
+
+void FrameScheduler::tick(void* data)
+{
+	auto* scheduler = static_cast<FrameScheduler*>(data);
+	scheduler->timer_armed = false;
+	if (scheduler->view == nullptr)
+		return;
+
+	scheduler->frame_pending = true;
+	scheduler->pending_since = scheduler->now();
+	scheduler->view->redraw();
+}
+
+void FrameScheduler::setAnimating(bool animating)
+{
+	is_animating = animating;
+	if (animating)
+		requestFrame();
+}
+
+void FrameScheduler::setTargetFrameRate(double fps)
+{
+	target_fps = max(fps, 0.0);
+}
+
+void FrameScheduler::beginFrame()
+{
+	double begin = now();
+	if (last_begin >= 0.0 && begin - last_begin < kIdleInterval)
+	{
+		double interval = begin - last_begin;
+		average_interval = average_interval > 0.0 ? average_interval + (interval - average_interval) * kAverageWeight : interval;
+	}
+	last_begin = begin;
+	frame_pending = false;
+}
+
+void FrameScheduler::endFrame()
+{
+	double draw = now() - last_begin;
+	average_draw = average_draw > 0.0 ? average_draw + (draw - average_draw) * kAverageWeight : draw;
+
+	// Only now the next frame is scheduled, so at most one is ever in flight
+	if (is_animating)
+		requestFrame();
+}
+
+double FrameScheduler::frameRate() const
+{
+	return average_interval > 0.0 ? 1.0 / average_interval : 0.0;
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <chrono>
+
+class Fl_Widget;
+
+// Frame rate the scheduler paces frames to unless told otherwise
+constexpr double kDefaultFrameRate = 60.0;
+
+// Decides when the view is redrawn.
+// Requests are coalesced into at most one pending frame, and frames are never
+// started closer together than the target frame rate allows. While animating,
+// every drawn frame schedules the next one; otherwise nothing runs until
+// something asks for a frame, so an idle modeler uses no CPU.
+class FrameScheduler
+{
+public:
+	static FrameScheduler* Instance();
+
+	void setView(Fl_Widget* view) { this->view = view; }
+
+	// Ask for the view to be redrawn, cheap to call many times per frame
+	void requestFrame();
+
+	// Keep drawing frames until turned off again
+	void setAnimating(bool animating);
+	bool animating() const { return is_animating; }
+
+	// Frames per second, 0 to draw as fast as the event loop allows
+	void setTargetFrameRate(double fps);
+	double targetFrameRate() const { return target_fps; }
+
+	// Called by the view at the start and the end of its draw
+	void beginFrame();
+	void endFrame();
+
+	// Measured over the last frames, 0 until two frames were drawn
+	double frameRate() const;
+	double frameTime() const { return average_draw; }		// in seconds
+
+private:
+	FrameScheduler() = default;
+	FrameScheduler(const FrameScheduler&) = delete;
+	FrameScheduler& operator=(const FrameScheduler&) = delete;
+
+	static void tick(void*);
+
+	double now() const;
+
+	Fl_Widget* view{nullptr};
+	std::chrono::steady_clock::time_point origin{std::chrono::steady_clock::now()};
+
+	double target_fps{kDefaultFrameRate};
+	bool is_animating{false};
+
+	bool timer_armed{false};		// tick will issue a redraw
+	bool frame_pending{false};		// redraw issued but not drawn yet
+	double pending_since{0.0};
+
+	double last_begin{-1.0};		// in seconds since origin
+	double average_interval{0.0};	// between frame starts, in seconds
+	double average_draw{0.0};
+};
@@ -0,0 +1,88 @@
+#include "Frustum.h"
+
+#include <cmath>
+
+using namespace std;
+
+// Divide a plane by the length of its normal, a degenerate plane is left as it is
+static void normalizePlane(float* plane)
+{
+	float length = sqrt(plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2]);
+	if (length == 0.f)
+		return;
+	for (int k = 0; k < 4; ++k)
+		plane[k] /= length;
+}
+
+Frustum::Frustum()
+{
+	// 0 >= 0 holds everywhere
+	for (auto& plane : planes)
+		for (int k = 0; k < 4; ++k)
+			plane[k] = 0.f;
+}
+
+Frustum::Frustum(const float* projection, const float* modelview)
+{
+	// clip = projection * modelview, column-major
+	float clip[16];
+	for (int c = 0; c < 4; ++c)
+		for (int r = 0; r < 4; ++r)
+		{
+			clip[c * 4 + r] = 0.f;
+			for (int k = 0; k < 4; ++k)
+				clip[c * 4 + r] += projection[k * 4 + r] * modelview[c * 4 + k];
+		}
+
+	// A point is inside if -w <= x, y, z <= w in clip space, every side of those
+	// inequalities is a plane: the last row plus or minus one of the other rows
+	for (int i = 0; i < 3; ++i)
+	{
+		for (int k = 0; k < 4; ++k)
+		{
+			planes[i * 2][k] = clip[k * 4 + 3] + clip[k * 4 + i];
+			planes[i * 2 + 1][k] = clip[k * 4 + 3] - clip[k * 4 + i];
+		}
+		normalizePlane(planes[i * 2]);
+		normalizePlane(planes[i * 2 + 1]);
+	}
+}
+
+bool Frustum::sphereVisible(const aiVector3D& center, float radius) const
+{
+	for (const auto& plane : planes)
+		if (plane[0] * center.x + plane[1] * center.y + plane[2] * center.z + plane[3] < -radius)
+			return false;
+	return true;
+}
+
+bool Frustum::boxVisible(const aiVector3D& aabb_min, const aiVector3D& aabb_max) const
+{
+	// The box is outside a plane if even its corner furthest along the normal is
+	for (const auto& plane : planes)
+	{
+		float x = plane[0] >= 0.f ? aabb_max.x : aabb_min.x;
+		float y = plane[1] >= 0.f ? aabb_max.y : aabb_min.y;
+		float z = plane[2] >= 0.f ? aabb_max.z : aabb_min.z;
+		if (plane[0] * x + plane[1] * y + plane[2] * z + plane[3] < 0.f)
+			return false;
+	}
+	return true;
+}
+
+Frustum Frustum::transformed(const Affine3x4& transformation) const
+{
+	// n . (R x + t) + d = (R^T n) . x + (n . t + d)
+	const float* m = transformation.data();
+	Frustum result;
+	for (int p = 0; p < 6; ++p)
+	{
+		const float* plane = planes[p];
+		float* out = result.planes[p];
+		for (int k = 0; k < 3; ++k)
+			out[k] = plane[0] * m[k] + plane[1] * m[4 + k] + plane[2] * m[8 + k];
+		out[3] = plane[0] * m[3] + plane[1] * m[7] + plane[2] * m[11] + plane[3];
+		normalizePlane(out);
+	}
+	return result;
+}
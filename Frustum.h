@@ -0,0 +1,26 @@
+#pragma once
+
+#include "Affine3x4.h"
+
+// The six clip planes of a camera, in the space of the modelview matrix it was
+// built from. Only bounding volumes are tested, so an object is kept whenever
+// it may be visible. A default constructed frustum contains everything.
+class Frustum
+{
+public:
+	Frustum();
+
+	// Both matrices are column-major, as glGetFloatv returns them
+	Frustum(const float* projection, const float* modelview);
+
+	bool sphereVisible(const aiVector3D& center, float radius) const;
+	bool boxVisible(const aiVector3D& aabb_min, const aiVector3D& aabb_max) const;
+
+	// The same frustum in the space transformation maps from, e.g. the space of
+	// an instance whose root is transformation. Objects of that space can then be
+	// tested with their own bounds.
+	Frustum transformed(const Affine3x4& transformation) const;
+
+	// a * x + b * y + c * z + d >= 0 inside, normalized so that d is a distance
+	float planes[6][4];
+};
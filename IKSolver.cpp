@@ -139,7 +139,8 @@ void IKSolver::applyRotation(Mesh& mesh)
 		{
 			if (bone.name != ori_bone.name)
 				continue;
-			ori_bone.local_transformation = aiMatrix4x4t<float>(scaling, bone.rotation, position);
+			ori_bone.local_transformation = Affine3x4(scaling, bone.rotation, position);
+			ori_bone.dirty = true;
 			break;
 		}
 }
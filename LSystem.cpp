@@ -1,6 +1,17 @@
 #include "LSystem.h"
 #include <FL/gl.h>
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <numeric>
+#include <sstream>
 #include "modelerdraw.h"
+#include "WorkerPool.h"
 
 using namespace std;
 
@@ -14,78 +25,913 @@ LSystem::LSystem()
 }
 
 
+// Argument of a symbol that has none
+static const float kNoArgument = numeric_limits<float>::quiet_NaN();
+
+float LSystemExpression::evaluate(float parameter) const
+{
+	float stack[kMaxExpressionDepth];
+	int top = 0, constant = 0;
+	for (Op op : ops)
+	{
+		switch (op)
+		{
+		case CONSTANT: stack[top++] = constants[constant++]; break;
+		case PARAMETER: stack[top++] = parameter; break;
+		case ADD: --top; stack[top - 1] += stack[top]; break;
+		case SUBTRACT: --top; stack[top - 1] -= stack[top]; break;
+		case MULTIPLY: --top; stack[top - 1] *= stack[top]; break;
+		case DIVIDE: --top; stack[top - 1] /= stack[top]; break;
+		case NEGATE: stack[top - 1] = -stack[top - 1]; break;
+		}
+	}
+	return stack[0];
+}
+
+// Recursive descent over sums, products, negations, numbers, the parameter and
+// parentheses, writing the ops of out as it goes
+class ExpressionParser
+{
+public:
+	ExpressionParser(const char* begin, const char* end, const string& parameter, LSystemExpression& out)
+		: p(begin), end(end), parameter(parameter), out(out) { }
+
+	// False if the text is not a whole expression or needs too deep a stack
+	bool parse()
+	{
+		sum();
+		skipSpaces();
+		return ok && p == end && max_depth <= kMaxExpressionDepth;
+	}
+
+private:
+	void skipSpaces()
+	{
+		while (p < end && isspace((unsigned char)*p))
+			++p;
+	}
+
+	bool accept(char c)
+	{
+		skipSpaces();
+		if (p < end && *p == c)
+		{
+			++p;
+			return true;
+		}
+		return false;
+	}
+
+	void push(LSystemExpression::Op op)
+	{
+		out.ops.push_back(op);
+		if (op == LSystemExpression::CONSTANT || op == LSystemExpression::PARAMETER)
+			max_depth = max(max_depth, ++depth);
+		else if (op != LSystemExpression::NEGATE)
+			--depth;
+	}
+
+	void sum()
+	{
+		product();
+		for (;;)
+		{
+			if (accept('+'))
+			{
+				product();
+				push(LSystemExpression::ADD);
+			}
+			else if (accept('-'))
+			{
+				product();
+				push(LSystemExpression::SUBTRACT);
+			}
+			else
+				return;
+		}
+	}
+
+	void product()
+	{
+		factor();
+		for (;;)
+		{
+			if (accept('*'))
+			{
+				factor();
+				push(LSystemExpression::MULTIPLY);
+			}
+			else if (accept('/'))
+			{
+				factor();
+				push(LSystemExpression::DIVIDE);
+			}
+			else
+				return;
+		}
+	}
+
+	void factor()
+	{
+		if (accept('-'))
+		{
+			factor();
+			push(LSystemExpression::NEGATE);
+			return;
+		}
+		if (accept('('))
+		{
+			sum();
+			ok = ok && accept(')');
+			return;
+		}
+		skipSpaces();
+		if (p < end && (isalpha((unsigned char)*p) || *p == '_'))
+		{
+			const char* name = p;
+			while (p < end && (isalnum((unsigned char)*p) || *p == '_'))
+				++p;
+			ok = ok && !parameter.empty() && parameter.compare(0, string::npos, name, p - name) == 0;
+			push(LSystemExpression::PARAMETER);
+			return;
+		}
+		// strtof could read past end, the text is copied up to it
+		const char* number = p;
+		while (p < end && (isdigit((unsigned char)*p) || *p == '.' || *p == 'e' || *p == 'E'
+			|| ((*p == '+' || *p == '-') && (p[-1] == 'e' || p[-1] == 'E'))))
+			++p;
+		string text(number, p);
+		char* parsed;
+		float value = strtof(text.c_str(), &parsed);
+		ok = ok && !text.empty() && *parsed == '\0';
+		out.constants.push_back(value);
+		push(LSystemExpression::CONSTANT);
+	}
+
+	const char* p;
+	const char* end;
+	const string& parameter;
+	LSystemExpression& out;
+	int depth{0}, max_depth{0};
+	bool ok{true};
+};
+
+// "A" or "A(l)": the symbol and the name of its parameter
+static bool parsePredecessor(const string& key, unsigned char& symbol, string& parameter)
+{
+	parameter.clear();
+	if (key.empty())
+		return false;
+	symbol = key[0];
+	if (key.length() == 1)
+		return true;
+	if (key[1] != '(' || key.back() != ')')
+		return false;
+	size_t begin = key.find_first_not_of(' ', 2), end = key.find_last_not_of(' ', key.length() - 2);
+	if (begin == string::npos || begin > end)
+		return false;
+	parameter = key.substr(begin, end + 1 - begin);
+	for (char c : parameter)
+		if (!isalnum((unsigned char)c) && c != '_')
+			return false;
+	return !isdigit((unsigned char)parameter[0]);
+}
+
+// Symbols of text and the arguments they get, which may use parameter
+static bool parseSuccessor(const string& text, const string& parameter, LSystemProduction& production)
+{
+	production.symbols.clear();
+	production.arguments.clear();
+	for (size_t i = 0; i < text.length(); ++i)
+	{
+		production.symbols += text[i];
+		production.arguments.emplace_back();
+		if (i + 1 == text.length() || text[i + 1] != '(')
+			continue;
+
+		// The argument ends at the matching ')'
+		size_t close = i + 2;
+		for (int depth = 1; close < text.length(); ++close)
+		{
+			if (text[close] == '(')
+				++depth;
+			else if (text[close] == ')' && --depth == 0)
+				break;
+		}
+		if (close == text.length())
+			return false;
+		ExpressionParser parser(text.data() + i + 2, text.data() + close, parameter, production.arguments.back());
+		if (!parser.parse())
+			return false;
+		i = close;
+	}
+	return true;
+}
+
 void LSystem::generate()
 {
-	str = init_str;
-	for (int i = 0; i < max_iter; ++i)
-		iterate();
+	if (rule != rewritten_rule || stochastic_rule != rewritten_stochastic_rule || seed != rewritten_seed
+		|| init_str != rewritten_init_str || max_iter != rewritten_iter || max_length != rewritten_max_length)
+		rewrite();
+	interpret();
 	need_regenerate = false;
 }
 
-void LSystem::iterate()
+void LSystem::rewrite()
 {
-	string result;
-	for (int i = 0; i < str.length(); ++i)
+	buildRuleTable();
+	str = init_str;
+	arguments.clear();
+	if (general_grammar)
 	{
-		bool flag = false;
-		for (auto& item : rule)
+		LSystemProduction start;
+		if (parseSuccessor(init_str, "", start))
 		{
-			if (str.substr(i, 1) != item.first)
-				continue;
-			
-			result += item.second;
-			flag = true;
+			str = start.symbols;
+			if (parametric)
+				for (const auto& argument : start.arguments)
+					arguments.push_back(argument.empty() ? kNoArgument : argument.evaluate(kNoArgument));
+		}
+		else
+		{
+			cerr << "L-system initial string \"" << init_str << "\" has an invalid argument" << endl;
+		}
+		if (parametric)
+			arguments.resize(str.length(), kNoArgument);
+	}
+	fill(symbol_counts, symbol_counts + kNumSymbols, 0);
+	for (unsigned char symbol : str)
+		++symbol_counts[symbol];
+
+	for (iterations = 0; iterations < max_iter; ++iterations)
+	{
+		if (!iterate())
+		{
+			cerr << "L-system stopped after " << iterations << " iterations, the next one would exceed "
+				<< max_length << " symbols" << endl;
 			break;
 		}
-		if (!flag)	result += str[i];
 	}
-	
-	str = result;
+
+	rewritten_rule = rule;
+	rewritten_stochastic_rule = stochastic_rule;
+	rewritten_seed = seed;
+	rewritten_init_str = init_str;
+	rewritten_iter = max_iter;
+	rewritten_max_length = max_length;
 }
 
-void LSystem::draw()
+void LSystem::buildRuleTable()
 {
-	if (need_regenerate)
-		generate();
-	for (int i = 0; i < str.length(); ++i)
+	// Grammars the counts cannot rewrite
+	auto has_argument = [](const string& text) { return text.find('(') != string::npos; };
+	parametric = has_argument(init_str);
+	for (const auto& item : rule)
+		parametric = parametric || has_argument(item.first) || has_argument(item.second);
+	for (const auto& item : stochastic_rule)
+	{
+		parametric = parametric || has_argument(item.first);
+		for (const auto& successor : item.second)
+			parametric = parametric || has_argument(successor.successor);
+	}
+	general_grammar = parametric || !stochastic_rule.empty();
+	for (int symbol = 0; symbol < kNumSymbols; ++symbol)
+		general_productions[symbol].clear();
+	if (general_grammar)
+	{
+		buildGeneralRuleTable();
+		return;
+	}
+
+	for (int symbol = 0; symbol < kNumSymbols; ++symbol)
+		productions[symbol].assign(1, char(symbol));
+	for (const auto& item : rule)
 	{
-		char token = str[i];
-		switch (token)
+		if (item.first.length() != 1)
 		{
-		case 'F':
-			drawCylinder(forward_dist, branch_radius1, branch_radius2);
-			glTranslatef(0, 0, forward_dist);
-			break;
-		case 'G':
-			glTranslatef(0, 0, forward_dist);
-			break;
-		case '+':
-			glRotatef(yaw_angle, 0, 1, 0);
-			break;
-		case '-':
-			glRotatef(-yaw_angle, 0, 1, 0);
-			break;
-		case '^':
-			glRotatef(-pitch_angle, 1, 0, 0);
-			break;
-		case '&':
-			glRotatef(pitch_angle, 1, 0, 0);
-			break;
-		case '/': case '>':
-			glRotatef(-roll_angle, 0, 0, 1);
-			break;
-		case '\\': case '<':
-			glRotatef(roll_angle, 0, 0, 1);
-			break;
-		case '|':
-			glRotatef(180, 0, 1, 0);
+			cerr << "L-system rule for \"" << item.first << "\" ignored, only single symbols are rewritten" << endl;
+			continue;
+		}
+		productions[(unsigned char)item.first[0]] = item.second;
+	}
+
+	for (int symbol = 0; symbol < kNumSymbols; ++symbol)
+	{
+		size_t counts[kNumSymbols] = {};
+		for (unsigned char s : productions[symbol])
+			++counts[s];
+		production_counts[symbol].clear();
+		for (int s = 0; s < kNumSymbols; ++s)
+			if (counts[s] > 0)
+				production_counts[symbol].emplace_back(s, counts[s]);
+	}
+}
+
+void LSystem::buildGeneralRuleTable()
+{
+	unsigned char symbol;
+	string parameter;
+	for (const auto& item : rule)
+	{
+		LSystemProduction production;
+		if (!parsePredecessor(item.first, symbol, parameter) || !parseSuccessor(item.second, parameter, production))
+		{
+			cerr << "L-system rule \"" << item.first << "\" -> \"" << item.second << "\" ignored, it does not parse" << endl;
+			continue;
+		}
+		if (!general_productions[symbol].empty())
+		{
+			cerr << "L-system rule \"" << item.first << "\" -> \"" << item.second << "\" ignored, another key already rewrites '"
+				<< symbol << "'" << endl;
+			continue;
+		}
+		production.threshold = 1.f;
+		general_productions[symbol].assign(1, production);
+	}
+
+	for (const auto& item : stochastic_rule)
+	{
+		if (!parsePredecessor(item.first, symbol, parameter))
+		{
+			cerr << "L-system stochastic rule for \"" << item.first << "\" ignored, it does not parse" << endl;
+			continue;
+		}
+		// Thresholds are the normalized cumulative probabilities
+		vector<LSystemProduction> successors;
+		float cumulative = 0.f;
+		for (const auto& successor : item.second)
+		{
+			LSystemProduction production;
+			if (successor.probability <= 0.f)
+				continue;
+			if (!parseSuccessor(successor.successor, parameter, production))
+			{
+				cerr << "L-system successor \"" << successor.successor << "\" of \"" << item.first << "\" ignored, it does not parse" << endl;
+				continue;
+			}
+			cumulative += successor.probability;
+			production.threshold = cumulative;
+			successors.push_back(production);
+		}
+		if (successors.empty())
+			continue;
+		for (auto& production : successors)
+			production.threshold /= cumulative;
+		// Rounding must not leave a gap below 1
+		successors.back().threshold = 1.f;
+		general_productions[symbol].swap(successors);
+	}
+}
+
+// Write the productions of count symbols from in to out
+static void expand(const string* productions, const char* in, size_t count, char* out)
+{
+	for (size_t i = 0; i < count; ++i)
+	{
+		const string& production = productions[(unsigned char)in[i]];
+		if (production.length() == 1)
+		{
+			*out++ = production[0];
+			continue;
+		}
+		memcpy(out, production.data(), production.length());
+		out += production.length();
+	}
+}
+
+bool LSystem::iterate()
+{
+	if (general_grammar)
+		return iterateGeneral();
+
+	// How often every symbol occurs after the rewrite follows from the counts alone
+	size_t next_counts[kNumSymbols] = {};
+	size_t length = 0;
+	for (int symbol = 0; symbol < kNumSymbols; ++symbol)
+	{
+		if (symbol_counts[symbol] == 0)
+			continue;
+		for (const auto& count : production_counts[symbol])
+			next_counts[count.first] += symbol_counts[symbol] * count.second;
+		length += symbol_counts[symbol] * productions[symbol].length();
+		if (length > max_length)
+			return false;
+	}
+
+	// Single pass, every symbol writes its production to a buffer of the exact size
+	next_str.resize(length);
+	if (!parallel || str.length() < 2 * kLSystemChunkSize)
+	{
+		expand(productions, str.data(), str.length(), &next_str[0]);
+	}
+	else
+	{
+		size_t production_lengths[kNumSymbols];
+		for (int symbol = 0; symbol < kNumSymbols; ++symbol)
+			production_lengths[symbol] = productions[symbol].length();
+
+		WorkerPool* pool = WorkerPool::Instance();
+		chunk_offsets.assign(WorkerPool::numChunks(str.length(), kLSystemChunkSize) + 1, 0);
+		pool->parallelFor(str.length(), kLSystemChunkSize, [this, &production_lengths](int chunk, int begin, int end)
+		{
+			size_t chunk_length = 0;
+			for (int i = begin; i < end; ++i)
+				chunk_length += production_lengths[(unsigned char)str[i]];
+			chunk_offsets[chunk + 1] = chunk_length;
+		});
+		partial_sum(chunk_offsets.begin(), chunk_offsets.end(), chunk_offsets.begin());
+		pool->parallelFor(str.length(), kLSystemChunkSize, [this](int chunk, int begin, int end)
+		{
+			expand(productions, str.data() + begin, end - begin, &next_str[chunk_offsets[chunk]]);
+		});
+	}
+
+	str.swap(next_str);
+	copy(next_counts, next_counts + kNumSymbols, symbol_counts);
+	return true;
+}
+
+// Uniform in [0, 1) from seed, the iteration and the position of a symbol in str,
+// the same whichever thread rewrites the symbol
+static float symbolRandom(unsigned seed, int iteration, size_t position)
+{
+	// splitmix64 finalizer
+	uint64_t x = (uint64_t(seed) << 32 | unsigned(iteration)) ^ (uint64_t(position) * 0x9E3779B97F4A7C15ull);
+	x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+	x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+	x ^= x >> 31;
+	return float(x >> 40) / float(1 << 24);
+}
+
+const LSystemProduction* LSystem::pick(unsigned char symbol, size_t position) const
+{
+	const auto& successors = general_productions[symbol];
+	if (successors.empty())
+		return nullptr;
+	if (successors.size() == 1)
+		return &successors[0];
+	float random = symbolRandom(seed, iterations, position);
+	for (const auto& production : successors)
+		if (random < production.threshold)
+			return &production;
+	return &successors.back();
+}
+
+// Call job(chunk, begin, end) for every chunk of kLSystemChunkSize symbols of
+// a string length symbols long, on the worker pool if parallel and it is long enough
+template <typename Job>
+static void forChunks(bool parallel, int length, const Job& job)
+{
+	if (parallel && length >= 2 * kLSystemChunkSize)
+	{
+		WorkerPool::Instance()->parallelFor(length, kLSystemChunkSize, job);
+		return;
+	}
+	for (int chunk = 0, begin = 0; begin < length; ++chunk, begin += kLSystemChunkSize)
+		job(chunk, begin, min(begin + kLSystemChunkSize, length));
+}
+
+bool LSystem::iterateGeneral()
+{
+	chunk_offsets.assign(WorkerPool::numChunks(str.length(), kLSystemChunkSize) + 1, 0);
+	forChunks(parallel, str.length(), [this](int chunk, int begin, int end)
+	{
+		size_t chunk_length = 0;
+		for (int i = begin; i < end; ++i)
+		{
+			const LSystemProduction* production = pick(str[i], i);
+			chunk_length += production ? production->symbols.length() : 1;
+		}
+		chunk_offsets[chunk + 1] = chunk_length;
+	});
+	partial_sum(chunk_offsets.begin(), chunk_offsets.end(), chunk_offsets.begin());
+	size_t length = chunk_offsets.back();
+	if (length > max_length)
+		return false;
+
+	next_str.resize(length);
+	if (parametric)
+		next_arguments.resize(length);
+	forChunks(parallel, str.length(), [this](int chunk, int begin, int end)
+	{
+		size_t out = chunk_offsets[chunk];
+		for (int i = begin; i < end; ++i)
+		{
+			const LSystemProduction* production = pick(str[i], i);
+			if (!production)
+			{
+				next_str[out] = str[i];
+				if (parametric)
+					next_arguments[out] = arguments[i];
+				++out;
+				continue;
+			}
+			size_t count = production->symbols.length();
+			memcpy(&next_str[out], production->symbols.data(), count);
+			if (parametric)
+			{
+				float parameter = arguments[i];
+				for (size_t k = 0; k < count; ++k)
+				{
+					const LSystemExpression& argument = production->arguments[k];
+					next_arguments[out + k] = argument.empty() ? kNoArgument : argument.evaluate(parameter);
+				}
+			}
+			out += count;
+		}
+	});
+
+	str.swap(next_str);
+	arguments.swap(next_arguments);
+	return true;
+}
+
+// Rotation by angle degrees about axis, as glRotatef applies it
+static Affine3x4 rotation(float angle, const aiVector3D& axis)
+{
+	aiMatrix4x4t<float> mat;
+	return Affine3x4(aiMatrix4x4t<float>::Rotation(angle / 180.f * AI_MATH_PI_F, axis, mat));
+}
+
+// The turtle of interpret, appending what it leaves to segments, branches and
+// radius. The turtle is the modelview draw would have, relative to the one it
+// starts with. A branch only grows its own sphere, enclosing the sphere of a
+// child is left to the parent when the child closes.
+class TurtleWalk
+{
+public:
+	TurtleWalk(const LSystem& system, vector<LSystemSegment>& segments, vector<LSystemBranch>& branches, float& radius);
+
+	// Interpret str[begin, end)
+	void walk(size_t begin, size_t end);
+
+	// Add a part walked on its own, in place of its symbols
+	void append(const LSystemPart& part);
+
+	// Close the branches str leaves open
+	void finish()
+	{
+		while (!open.empty())
+			close();
+	}
+
+	Affine3x4 turtle;
+
+private:
+	aiVector3D position() const { return aiVector3D(turtle.m[3], turtle.m[7], turtle.m[11]); }
+	void grow(const aiVector3D& point);
+	void close();
+	void enclose(const LSystemBranch& branch);
+
+	const LSystem& system;
+	vector<LSystemSegment>& segments;
+	vector<LSystemBranch>& branches;
+	float& radius;
+	Affine3x4 yaw_left, yaw_right, pitch_up, pitch_down, roll_left, roll_right, turn;
+	vector<Affine3x4> turtles;
+	vector<int> open;
+};
+
+TurtleWalk::TurtleWalk(const LSystem& system, vector<LSystemSegment>& segments, vector<LSystemBranch>& branches, float& radius)
+	: system(system), segments(segments), branches(branches), radius(radius)
+{
+	yaw_left = rotation(system.yaw_angle, aiVector3D(0, 1, 0));
+	yaw_right = rotation(-system.yaw_angle, aiVector3D(0, 1, 0));
+	pitch_up = rotation(-system.pitch_angle, aiVector3D(1, 0, 0));
+	pitch_down = rotation(system.pitch_angle, aiVector3D(1, 0, 0));
+	roll_left = rotation(-system.roll_angle, aiVector3D(0, 0, 1));
+	roll_right = rotation(system.roll_angle, aiVector3D(0, 0, 1));
+	turn = rotation(180, aiVector3D(0, 1, 0));
+}
+
+void TurtleWalk::walk(size_t begin, size_t end)
+{
+	const string& str = system.str;
+	const float* arguments = system.arguments.empty() ? nullptr : system.arguments.data();
+	for (size_t i = begin; i < end; ++i)
+	{
+		// An argument replaces the length or the angle of the turtle
+		float argument = arguments ? arguments[i] : kNoArgument;
+		bool has_argument = !isnan(argument);
+		switch (str[i])
+		{
+		case 'F': case 'G':
+		{
+			// A cylinder is within the spheres that enclose both of its ends
+			float length = has_argument ? argument : system.forward_dist;
+			aiVector3D from = position();
+			if (str[i] == 'F')
+				segments.push_back({turtle, length, system.branch_radius1, system.branch_radius2});
+			turtle.m[3] += turtle.m[2] * length;
+			turtle.m[7] += turtle.m[6] * length;
+			turtle.m[11] += turtle.m[10] * length;
+			if (str[i] == 'F')
+			{
+				grow(from);
+				grow(position());
+			}
 			break;
+		}
+		case '+': turtle = turtle * (has_argument ? rotation(argument, aiVector3D(0, 1, 0)) : yaw_left); break;
+		case '-': turtle = turtle * (has_argument ? rotation(-argument, aiVector3D(0, 1, 0)) : yaw_right); break;
+		case '^': turtle = turtle * (has_argument ? rotation(-argument, aiVector3D(1, 0, 0)) : pitch_up); break;
+		case '&': turtle = turtle * (has_argument ? rotation(argument, aiVector3D(1, 0, 0)) : pitch_down); break;
+		case '/': case '>': turtle = turtle * (has_argument ? rotation(-argument, aiVector3D(0, 0, 1)) : roll_left); break;
+		case '\\': case '<': turtle = turtle * (has_argument ? rotation(argument, aiVector3D(0, 0, 1)) : roll_right); break;
+		case '|': turtle = turtle * turn; break;
 		case '[':
-			glPushMatrix();
+		{
+			LSystemBranch branch;
+			branch.first_segment = segments.size();
+			branch.center = position();
+			branch.radius = 0.f;
+			open.push_back(branches.size());
+			branches.push_back(branch);
+			turtles.push_back(turtle);
 			break;
+		}
 		case ']':
-			glPopMatrix();
+			// Like glPopMatrix on an empty stack, an unmatched ']' changes nothing
+			if (open.empty())
+				break;
+			close();
+			turtle = turtles.back();
+			turtles.pop_back();
 			break;
 		}
 	}
 }
+
+void TurtleWalk::append(const LSystemPart& part)
+{
+	int segment_offset = segments.size(), branch_offset = branches.size();
+	segments.insert(segments.end(), part.segments.begin(), part.segments.end());
+	for (LSystemBranch branch : part.branches)
+	{
+		branch.first_segment += segment_offset;
+		branch.end_segment += segment_offset;
+		branch.next += branch_offset;
+		branches.push_back(branch);
+	}
+	enclose(branches[branch_offset]);
+}
+
+void TurtleWalk::grow(const aiVector3D& point)
+{
+	if (open.empty())
+		radius = max(radius, point.Length());
+	else
+		branches[open.back()].radius = max(branches[open.back()].radius, (point - branches[open.back()].center).Length());
+}
+
+void TurtleWalk::close()
+{
+	LSystemBranch& branch = branches[open.back()];
+	branch.end_segment = segments.size();
+	branch.next = branches.size();
+	open.pop_back();
+	enclose(branch);
+}
+
+void TurtleWalk::enclose(const LSystemBranch& branch)
+{
+	if (open.empty())
+	{
+		radius = max(radius, branch.center.Length() + branch.radius);
+		return;
+	}
+	LSystemBranch& parent = branches[open.back()];
+	parent.radius = max(parent.radius, (branch.center - parent.center).Length() + branch.radius);
+}
+
+void LSystem::interpret()
+{
+	segments.clear();
+	branches.clear();
+	radius = 0.f;
+
+	WorkerPool* pool = WorkerPool::Instance();
+	TurtleWalk walk(*this, segments, branches, radius);
+	if (!parallel || str.length() < 2 * kLSystemChunkSize || pool->numThreads() == 1)
+	{
+		walk.walk(0, str.length());
+		walk.finish();
+		return;
+	}
+
+	// At least two parts per thread where the branches allow it, so that uneven ones still spread over all of them
+	findParts(kLSystemChunkSize / 64, str.length() / (2 * pool->numThreads()));
+
+	// Turtles the parts start with. A part ends with its ']', which would restore
+	// the turtle of its '[', so the trunk goes on from there unchanged.
+	{
+		vector<LSystemSegment> trunk_segments;
+		vector<LSystemBranch> trunk_branches;
+		float trunk_radius = 0.f;
+		TurtleWalk trunk(*this, trunk_segments, trunk_branches, trunk_radius);
+		size_t from = 0;
+		for (LSystemPart& part : parts)
+		{
+			trunk.walk(from, part.begin);
+			part.turtle = trunk.turtle;
+			from = part.end;
+		}
+	}
+
+	pool->parallelFor(parts.size(), 1, [this](int chunk, int begin, int end)
+	{
+		for (int p = begin; p < end; ++p)
+		{
+			LSystemPart& part = parts[p];
+			part.segments.clear();
+			part.branches.clear();
+			float part_radius = 0.f;
+			TurtleWalk part_walk(*this, part.segments, part.branches, part_radius);
+			part_walk.turtle = part.turtle;
+			part_walk.walk(part.begin, part.end);
+		}
+	});
+
+	size_t from = 0;
+	for (const LSystemPart& part : parts)
+	{
+		walk.walk(from, part.begin);
+		walk.append(part);
+		from = part.end;
+	}
+	walk.walk(from, str.length());
+	walk.finish();
+}
+
+void LSystem::findParts(size_t shortest, size_t longest)
+{
+	// A branch that closes replaces the parts within it, which closed before it
+	size_t num_parts = 0;
+	vector<size_t> open;
+	for (size_t i = 0; i < str.length(); ++i)
+	{
+		if (str[i] == '[')
+		{
+			open.push_back(i);
+		}
+		else if (str[i] == ']' && !open.empty())
+		{
+			size_t begin = open.back(), end = i + 1;
+			open.pop_back();
+			if (end - begin > longest)
+				continue;
+			while (num_parts > 0 && parts[num_parts - 1].begin > begin)
+				--num_parts;
+			if (end - begin < shortest)
+				continue;
+			if (num_parts == parts.size())
+				parts.emplace_back();
+			parts[num_parts].begin = begin;
+			parts[num_parts].end = end;
+			++num_parts;
+		}
+	}
+	parts.resize(num_parts);
+}
+
+void LSystem::draw(const Frustum& frustum)
+{
+	if (need_regenerate)
+		generate();
+
+	// The spheres enclose the axes of the cylinders, which are this thick at most
+	float thickness = max(branch_radius1, branch_radius2);
+	if (!frustum.sphereVisible(aiVector3D(), radius + thickness))
+		return;
+
+	// Segments from one branch start to the next are drawn or skipped together
+	visible_runs.clear();
+	int num_segments = segments.size(), num_branches = branches.size();
+	for (int s = 0, b = 0; ; )
+	{
+		// Branches that start here, a culled one is skipped with everything that grows from it
+		while (b < num_branches && branches[b].first_segment == s)
+		{
+			const LSystemBranch& branch = branches[b];
+			if (frustum.sphereVisible(branch.center, branch.radius + thickness))
+			{
+				++b;
+				continue;
+			}
+			s = branch.end_segment;
+			b = branch.next;
+		}
+		if (s >= num_segments)
+			break;
+
+		int end = b < num_branches ? branches[b].first_segment : num_segments;
+		if (!visible_runs.empty() && visible_runs.back().second == s)
+			visible_runs.back().second = end;
+		else
+			visible_runs.emplace_back(s, end);
+		s = end;
+	}
+
+	// A .ray file needs its cones
+	if (ModelerDrawState::Instance()->m_rayFile)
+	{
+		for (const auto& run : visible_runs)
+			for (int s = run.first; s < run.second; ++s)
+			{
+				// Column-major for OpenGL
+				const float* m = segments[s].transformation.data();
+				float mat[16] = {m[0], m[4], m[8], 0.f, m[1], m[5], m[9], 0.f, m[2], m[6], m[10], 0.f, m[3], m[7], m[11], 1.f};
+				glPushMatrix();
+				glMultMatrixf(mat);
+				drawCylinder(segments[s].length, segments[s].radius1, segments[s].radius2);
+				glPopMatrix();
+			}
+		return;
+	}
+
+	// A segment is the cylinder of its radii relative to the larger one, scaled up to
+	// that radius and its length. Segments of the same shape are drawn together.
+	const UnitCylinder* cylinder = nullptr;
+	float shape_r1 = 0.f, shape_r2 = 0.f;
+	instance_transformations.clear();
+	for (const auto& run : visible_runs)
+		for (int s = run.first; s < run.second; ++s)
+		{
+			const LSystemSegment& segment = segments[s];
+			float scale = max(segment.radius1, segment.radius2);
+			if (scale <= 0.f)
+				continue;
+			float r1 = segment.radius1 / scale, r2 = segment.radius2 / scale;
+			if (!cylinder || r1 != shape_r1 || r2 != shape_r2)
+			{
+				if (cylinder)
+					drawInstances(*cylinder, instance_transformations.data(), instance_transformations.size() / 16);
+				instance_transformations.clear();
+				cylinder = &unitCylinder(r1, r2);
+				shape_r1 = r1;
+				shape_r2 = r2;
+			}
+
+			// Column-major for OpenGL
+			const float* m = segment.transformation.data();
+			float mat[16] = {m[0] * scale, m[4] * scale, m[8] * scale, 0.f, m[1] * scale, m[5] * scale, m[9] * scale, 0.f,
+				m[2] * segment.length, m[6] * segment.length, m[10] * segment.length, 0.f, m[3], m[7], m[11], 1.f};
+			instance_transformations.insert(instance_transformations.end(), mat, mat + 16);
+		}
+	if (cylinder)
+		drawInstances(*cylinder, instance_transformations.data(), instance_transformations.size() / 16);
+}
+
+// Everything the rewrite of a system depends on, with seed for its own
+static string cacheKey(const LSystem& system, unsigned seed)
+{
+	ostringstream key;
+	key.precision(9);
+	key << system.init_str << '\0' << system.max_iter << ' ' << system.max_length << ' ' << seed << '\0';
+	for (const auto& item : system.rule)
+		key << item.first << '\0' << item.second << '\0';
+	key << '\0';
+	for (const auto& item : system.stochastic_rule)
+	{
+		key << item.first << '\0';
+		for (const auto& successor : item.second)
+			key << successor.probability << ' ' << successor.successor << '\0';
+		key << '\0';
+	}
+	return key.str();
+}
+
+LSystem& LSystemCache::get(const LSystem& prototype, unsigned seed)
+{
+	string key = cacheKey(prototype, seed);
+	auto found = systems.find(key);
+	if (found == systems.end())
+	{
+		if (systems.size() >= kMaxCachedSystems)
+			systems.clear();
+		unique_ptr<LSystem> system(new LSystem());
+		system->rule = prototype.rule;
+		system->stochastic_rule = prototype.stochastic_rule;
+		system->init_str = prototype.init_str;
+		system->max_iter = prototype.max_iter;
+		system->max_length = prototype.max_length;
+		system->parallel = prototype.parallel;
+		system->seed = seed;
+		found = systems.emplace(key, move(system)).first;
+	}
+
+	LSystem& system = *found->second;
+	if (system.yaw_angle != prototype.yaw_angle || system.pitch_angle != prototype.pitch_angle
+		|| system.roll_angle != prototype.roll_angle || system.forward_dist != prototype.forward_dist
+		|| system.branch_radius1 != prototype.branch_radius1 || system.branch_radius2 != prototype.branch_radius2)
+	{
+		system.yaw_angle = prototype.yaw_angle;
+		system.pitch_angle = prototype.pitch_angle;
+		system.roll_angle = prototype.roll_angle;
+		system.forward_dist = prototype.forward_dist;
+		system.branch_radius1 = prototype.branch_radius1;
+		system.branch_radius2 = prototype.branch_radius2;
+		system.need_regenerate = true;
+	}
+	return system;
+}
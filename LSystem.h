@@ -2,15 +2,112 @@
 
 #include <string>
 #include <map>
+#include <memory>
+#include <vector>
+#include "Frustum.h"
+
+// Bounding sphere of the branch a '[' of the string opens, in the space the
+// system is drawn in, centered where the branch starts
+class LSystemBranch
+{
+public:
+	int first_segment, end_segment;		// segments of the branch and everything that grows from it
+	int next;			// index in branches of the first branch after this one and its children
+	aiVector3D center;
+	float radius;
+};
+
+// What the turtle leaves at an 'F': the cylinder along z from transformation,
+// length long, with radius1 at its start and radius2 at its end
+class LSystemSegment
+{
+public:
+	Affine3x4 transformation;
+	float length;
+	float radius1, radius2;
+};
+
+// Depth of the stack an expression is evaluated on
+constexpr int kMaxExpressionDepth = 16;
+
+// Arithmetic on the parameter of a parametric rule, e.g. the l*0.7 of the rule
+// A(l) -> F(l)[A(l*0.7)]. Kept in postfix order. An empty expression stands for
+// a symbol without argument.
+class LSystemExpression
+{
+public:
+	enum Op : unsigned char { CONSTANT, PARAMETER, ADD, SUBTRACT, MULTIPLY, DIVIDE, NEGATE };
+
+	bool empty() const { return ops.empty(); }
+
+	// NaN if it uses parameter and parameter is NaN, a symbol without argument passes none on
+	float evaluate(float parameter) const;
+
+	std::vector<Op> ops;
+	std::vector<float> constants;		// of the CONSTANT ops, in order
+};
+
+// A successor in the rule table of stochastic and parametric grammars
+class LSystemProduction
+{
+public:
+	float threshold;		// picked for a random number below it and not below the threshold of the one before
+	std::string symbols;
+	std::vector<LSystemExpression> arguments;		// of every symbol of symbols
+};
+
+// One successor of a stochastic rule and how likely it is picked
+class LSystemSuccessor
+{
+public:
+	bool operator==(const LSystemSuccessor& other) const
+	{
+		return probability == other.probability && successor == other.successor;
+	}
+
+	float probability;
+	std::string successor;
+};
+
+// Number of distinct symbols, a symbol is one char of the string
+constexpr int kNumSymbols = 256;
+
+// Symbols rewritten by a worker at once, shorter strings are rewritten and interpreted on one thread
+constexpr int kLSystemChunkSize = 1 << 16;
+
+// A branch of str that the parallel interpret walks on its own: the turtle it
+// starts with and what it leaves, indexed from the start of the part
+class LSystemPart
+{
+public:
+	size_t begin, end;		// from its '[' to after its ']'
+	Affine3x4 turtle;
+	std::vector<LSystemSegment> segments;
+	std::vector<LSystemBranch> branches;		// the first is the branch of the part itself
+};
 
 class LSystem
 {	
 public:
 	LSystem();
 	
+	// Rewrite the string unless the grammar and the depth are the ones it was
+	// rewritten with, then interpret it
 	void generate();
-	void iterate();
-	void draw();
+
+	// Rewrite init_str max_iter times, or as often as max_length allows
+	void rewrite();
+
+	// Branches whose bounding sphere is outside frustum are skipped
+	// together with everything that grows from them. Every other segment
+	// is a scaled copy of a unitCylinder that drawInstances draws.
+	void draw(const Frustum& frustum = Frustum());
+
+	// Walk the string with the turtle: the transformation of every segment and
+	// the bounds of every branch. The only pass the turtle parameters need.
+	// In parallel, the parts are walked by the workers from the turtles the trunk
+	// leaves them, then put in place in the order of str.
+	void interpret();
 	
 	int max_iter{7};
 	float yaw_angle{22.5f};
@@ -21,9 +118,103 @@ public:
 	float branch_radius1{0.01f};
 	float branch_radius2{0.01f};
 
-	bool need_regenerate{true};
+	bool need_regenerate{true};		// the turtle parameters or the radii changed
+	bool parallel{true};		// rewrite and interpret on the worker pool, the result is the same
+	// Keys are single symbols, or a symbol with the name of its parameter, e.g.
+	// "A(l)", whose successor may use it in arguments: "F(l)[A(l*0.7)]". A '('
+	// after a symbol starts its argument. The turtle draws an 'F' or 'G' with an
+	// argument that long, and a turn with one by that many degrees. Of two keys of
+	// one symbol, e.g. "A" and "A(l)", the first in map order is kept.
 	std::map<std::string, std::string> rule;
+
+	// Keyed like rule. One successor of a symbol is picked at random from seed, the
+	// iteration and the position of the symbol, so a seed grows the same tree however
+	// the string is split between threads. Probabilities are normalized. A symbol
+	// with a stochastic rule ignores its rule.
+	std::map<std::string, std::vector<LSystemSuccessor>> stochastic_rule;
+	unsigned seed{0};
+
 	std::string str;
-	std::string init_str;
+	std::string init_str;		// may have arguments too, e.g. "A(1)"
+	std::vector<float> arguments;		// of every symbol of str if the grammar is parametric, NaN for none
+
+	// Symbols str may grow to. A symbol takes a byte, twice that while str is
+	// rewritten. A parametric grammar also keeps a float argument of every symbol
+	// in arguments and next_arguments, 8 more bytes per symbol. Generation stops
+	// at the last iteration within the limit.
+	size_t max_length{1 << 24};
+	int iterations{0};		// done by the last generate
+
+	std::vector<LSystemSegment> segments;		// in the order of their 'F' in str
+
+	std::vector<LSystemBranch> branches;		// in the order of their '[' in str
+	float radius{0.f};		// of the bounding sphere of the whole system, centered at the origin
+
+private:
+	// Fill productions and production_counts from rule, or general_productions
+	// from rule and stochastic_rule if the grammar is stochastic or parametric
+	void buildRuleTable();
+	void buildGeneralRuleTable();
+
+	// Rewrite every symbol of str at once, the result is sized from symbol_counts
+	// before it is written. Returns false and leaves str as it is if the result
+	// would be longer than max_length. In parallel, chunks of str count the length
+	// of their result, whose prefix sum is where each chunk then writes it.
+	bool iterate();
+
+	// iterate for general grammars, where the length of the result depends on
+	// the successors picked: the length of every chunk is counted in a first pass
+	bool iterateGeneral();
+
+	// The successor of the symbol at position in str, nullptr if it is rewritten to itself
+	const LSystemProduction* pick(unsigned char symbol, size_t position) const;
+
+	// Fill parts with the largest branches of str that are at most longest symbols
+	// long, in the order of str. Branches shorter than shortest are left to the trunk.
+	void findParts(size_t shortest, size_t longest);
+
+	// Rule table indexed by symbol, a symbol without a rule is rewritten to itself
+	std::string productions[kNumSymbols];
+	std::vector<std::pair<unsigned char, size_t>> production_counts[kNumSymbols];	// symbols of every production and how often they occur
+	size_t symbol_counts[kNumSymbols];		// how often every symbol occurs in str, unless the grammar is general
+	std::string next_str;					// str of the next iteration, kept to reuse its memory
+	std::vector<size_t> chunk_offsets;		// where every chunk of str writes its result to next_str
+
+	// Rule table of the grammars the counts cannot rewrite, stochastic or parametric
+	// ones. A symbol without productions is rewritten to itself and keeps its argument.
+	bool general_grammar{false};
+	bool parametric{false};		// str has arguments
+	std::vector<LSystemProduction> general_productions[kNumSymbols];
+	std::vector<float> next_arguments;		// arguments of next_str
+
+	// What str was rewritten from
+	std::map<std::string, std::string> rewritten_rule;
+	std::map<std::string, std::vector<LSystemSuccessor>> rewritten_stochastic_rule;
+	unsigned rewritten_seed{0};
+	std::string rewritten_init_str;
+	int rewritten_iter{-1};
+	size_t rewritten_max_length{0};
+
+	std::vector<LSystemPart> parts;		// of the last parallel interpret, kept to reuse their memory
+
+	// Kept by draw to reuse their memory
+	std::vector<std::pair<int, int>> visible_runs;		// segments found visible
+	std::vector<float> instance_transformations;		// of the visible segments, for drawInstances
 };
 
+// Most systems an LSystemCache keeps, it starts over when it is full
+constexpr size_t kMaxCachedSystems = 256;
+
+// Systems grown from a grammar by grammar, seed and depth, so that a forest of
+// distinct trees is rewritten and interpreted once and then only drawn
+class LSystemCache
+{
+public:
+	// The system of the grammar and depth of prototype grown from seed. It takes
+	// the turtle parameters of prototype and is interpreted again when they change.
+	LSystem& get(const LSystem& prototype, unsigned seed);
+
+	void clear() { systems.clear(); }
+
+	std::map<std::string, std::unique_ptr<LSystem>> systems;		// by grammar, seed and depth
+};
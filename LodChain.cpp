@@ -0,0 +1,197 @@
+#include "LodChain.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+using namespace std;
+
+// Average number of vertices per cell of the nearest neighbour grid
+static const float kGridOccupancy = 2.f;
+
+// Cells along the longest side of the grid at most
+static const int kMaxGridResolution = 128;
+
+// Eye distances are clamped to this, the camera can be inside the bounding sphere
+static const float kMinDistance = 1e-3f;
+
+// Uniform grid over the bind pose positions of a mesh for nearest vertex queries
+class VertexGrid
+{
+public:
+	explicit VertexGrid(const SkinData& skin) : skin(skin)
+	{
+		int n = skin.num_vertices;
+		lo = aiVector3D(1e10f, 1e10f, 1e10f);
+		aiVector3D hi(-1e10f, -1e10f, -1e10f);
+		for (int i = 0; i < n; ++i)
+		{
+			lo.x = min(lo.x, skin.pos_x[i]); hi.x = max(hi.x, skin.pos_x[i]);
+			lo.y = min(lo.y, skin.pos_y[i]); hi.y = max(hi.y, skin.pos_y[i]);
+			lo.z = min(lo.z, skin.pos_z[i]); hi.z = max(hi.z, skin.pos_z[i]);
+		}
+
+		aiVector3D extent = hi - lo;
+		float longest = max(extent.x, max(extent.y, extent.z));
+		int resolution = max(1, min(kMaxGridResolution, int(cbrt(n / kGridOccupancy))));
+		cell = longest > 0.f ? longest / resolution : 1.f;
+		dims[0] = int(extent.x / cell) + 1;
+		dims[1] = int(extent.y / cell) + 1;
+		dims[2] = int(extent.z / cell) + 1;
+
+		// Counting sort of the vertices by cell
+		cell_start.assign(dims[0] * dims[1] * dims[2] + 1, 0);
+		vector<int> vertex_cell(n);
+		for (int i = 0; i < n; ++i)
+		{
+			vertex_cell[i] = cellIndex(cellOf(skin.pos_x[i], 0), cellOf(skin.pos_y[i], 1), cellOf(skin.pos_z[i], 2));
+			++cell_start[vertex_cell[i] + 1];
+		}
+		for (int c = 1; c < cell_start.size(); ++c)
+			cell_start[c] += cell_start[c - 1];
+		cell_vertices.resize(n);
+		vector<int> next(cell_start.begin(), cell_start.end() - 1);
+		for (int i = 0; i < n; ++i)
+			cell_vertices[next[vertex_cell[i]]++] = i;
+	}
+
+	// Distance from p to the closest vertex, searched in growing shells of cells
+	float nearest(const aiVector3D& p) const
+	{
+		if (skin.num_vertices == 0)
+			return 0.f;
+
+		int c[3] = {cellOf(p.x, 0), cellOf(p.y, 1), cellOf(p.z, 2)};
+		int max_shell = max(dims[0], max(dims[1], dims[2]));
+		float best = 1e30f;
+		for (int r = 0; r <= max_shell; ++r)
+		{
+			for (int x = max(0, c[0] - r); x <= min(dims[0] - 1, c[0] + r); ++x)
+			for (int y = max(0, c[1] - r); y <= min(dims[1] - 1, c[1] + r); ++y)
+			for (int z = max(0, c[2] - r); z <= min(dims[2] - 1, c[2] + r); ++z)
+			{
+				// Only the surface of the shell, the inside was searched already
+				if (max(abs(x - c[0]), max(abs(y - c[1]), abs(z - c[2]))) != r)
+					continue;
+				int index = cellIndex(x, y, z);
+				for (int k = cell_start[index]; k < cell_start[index + 1]; ++k)
+				{
+					int v = cell_vertices[k];
+					aiVector3D d(skin.pos_x[v] - p.x, skin.pos_y[v] - p.y, skin.pos_z[v] - p.z);
+					best = min(best, d.SquareLength());
+				}
+			}
+
+			// Vertices in the next shells are at least r cells away
+			if (best <= (r * cell) * (r * cell))
+				break;
+		}
+		return sqrt(best);
+	}
+
+private:
+	int cellOf(float v, int axis) const
+	{
+		return max(0, min(dims[axis] - 1, int((v - lo[axis]) / cell)));
+	}
+
+	int cellIndex(int x, int y, int z) const { return (z * dims[1] + y) * dims[0] + x; }
+
+	const SkinData& skin;
+	aiVector3D lo;
+	float cell;
+	int dims[3];
+	std::vector<int> cell_start;		// vertices of cell c are cell_vertices[cell_start[c], cell_start[c + 1])
+	std::vector<int> cell_vertices;
+};
+
+// Largest distance from a vertex of from to the closest vertex of to
+static float maxNearestDistance(const SkinData& from, const VertexGrid& to)
+{
+	float error = 0.f;
+	for (int i = 0; i < from.num_vertices; ++i)
+		error = max(error, to.nearest(aiVector3D(from.pos_x[i], from.pos_y[i], from.pos_z[i])));
+	return error;
+}
+
+void LodChain::build(const ModelHelper& helper, const vector<int>& mesh_indices)
+{
+	levels = mesh_indices;
+	stable_sort(levels.begin(), levels.end(), [&helper](int a, int b)
+	{
+		return helper.meshes[a].skin.num_vertices > helper.meshes[b].skin.num_vertices;
+	});
+	errors.assign(levels.size(), 0.f);
+	radius = 0.f;
+	if (levels.empty())
+		return;
+
+	const SkinData& finest = helper.meshes[levels[0]].skin;
+	aiVector3D lo(1e10f, 1e10f, 1e10f), hi(-1e10f, -1e10f, -1e10f);
+	for (int i = 0; i < finest.num_vertices; ++i)
+	{
+		lo.x = min(lo.x, finest.pos_x[i]); hi.x = max(hi.x, finest.pos_x[i]);
+		lo.y = min(lo.y, finest.pos_y[i]); hi.y = max(hi.y, finest.pos_y[i]);
+		lo.z = min(lo.z, finest.pos_z[i]); hi.z = max(hi.z, finest.pos_z[i]);
+	}
+	center = finest.num_vertices > 0 ? (lo + hi) * 0.5f : aiVector3D();
+	for (int i = 0; i < finest.num_vertices; ++i)
+		radius = max(radius, (aiVector3D(finest.pos_x[i], finest.pos_y[i], finest.pos_z[i]) - center).Length());
+
+	// Symmetric distance between the vertex sets: a coarse level both has to stay
+	// close to the finest surface and must not leave parts of it uncovered
+	VertexGrid finest_grid(finest);
+	for (int l = 1; l < levels.size(); ++l)
+	{
+		const SkinData& skin = helper.meshes[levels[l]].skin;
+		VertexGrid grid(skin);
+		errors[l] = max(maxNearestDistance(skin, finest_grid), maxNearestDistance(finest, grid));
+
+		// A coarser level is never more accurate than a finer one
+		errors[l] = max(errors[l], errors[l - 1]);
+	}
+
+	cout << "LOD chain:";
+	for (int l = 0; l < levels.size(); ++l)
+		cout << " " << helper.meshes[levels[l]].skin.num_vertices << " vertices (error " << errors[l] << ")";
+	cout << endl;
+}
+
+float LodChain::pixelsPerUnit(const LodView& view, const Affine3x4& root) const
+{
+	const float* m = view.modelview;
+	const float* r = root.data();
+	aiVector3D c(r[0] * center.x + r[1] * center.y + r[2] * center.z + r[3],
+		r[4] * center.x + r[5] * center.y + r[6] * center.z + r[7],
+		r[8] * center.x + r[9] * center.y + r[10] * center.z + r[11]);
+
+	// Uniform scale of the modelview, the root of an instance is rigid
+	float scale = sqrt(m[0] * m[0] + m[1] * m[1] + m[2] * m[2]);
+	float pixels = view.projection[5] * view.viewport_height * 0.5f * scale;
+
+	// Orthographic projections do not shrink with distance
+	if (view.projection[11] == 0.f)
+		return pixels;
+
+	float depth = -(m[2] * c.x + m[6] * c.y + m[10] * c.z + m[14]);
+	return pixels / max(depth - radius * scale, kMinDistance);
+}
+
+int LodChain::select(int current, float pixels_per_unit, float tolerance) const
+{
+	if (levels.empty())
+		return 0;
+	current = max(0, min<int>(current, levels.size() - 1));
+
+	if (errors[current] * pixels_per_unit > tolerance)
+	{
+		while (current > 0 && errors[current] * pixels_per_unit > tolerance)
+			--current;
+		return current;
+	}
+
+	for (int l = levels.size() - 1; l > current; --l)
+		if (errors[l] * pixels_per_unit <= tolerance * kLodHysteresis)
+			return l;
+	return current;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <vector>
+#include "ModelHelper.h"
+
+// Fraction of the tolerance a coarser level has to stay under before it replaces
+// the current one, keeps levels from flickering at the threshold
+constexpr float kLodHysteresis = 0.7f;
+
+// Camera a chain is looked at from, copied from the OpenGL state by the caller.
+// Both matrices are column-major, as glGetFloatv returns them.
+class LodView
+{
+public:
+	float modelview[16];		// at the space the meshes are drawn in
+	float projection[16];
+	int viewport_height{1};		// in pixels
+};
+
+// Meshes showing the same model at decreasing detail.
+// The geometric error of every level is measured once against the finest one
+// in the bind pose, so choosing a level at draw time only has to project it.
+class LodChain
+{
+public:
+	// Sorts the meshes by vertex count, the finest one becomes level 0
+	void build(const ModelHelper& helper, const std::vector<int>& mesh_indices);
+
+	int size() const { return levels.size(); }
+	int meshIndex(int level) const { return levels[level]; }
+	float error(int level) const { return errors[level]; }		// in model units
+
+	// Pixels one model unit covers at the nearest point of the bounding sphere,
+	// for a copy of the model placed by root
+	float pixelsPerUnit(const LodView& view, const Affine3x4& root = Affine3x4()) const;
+
+	// Coarsest level whose error stays within tolerance pixels. A finer level is
+	// taken as soon as current gets too coarse, a coarser one only when it is well
+	// within tolerance.
+	int select(int current, float pixels_per_unit, float tolerance) const;
+
+	// Bind pose bounding sphere of the finest level
+	aiVector3D center;
+	float radius{0.f};
+
+private:
+	std::vector<int> levels;		// mesh indices, finest first
+	std::vector<float> errors;
+};
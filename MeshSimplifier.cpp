@@ -0,0 +1,488 @@
+#include "MeshSimplifier.h"
+
+#include <algorithm>
+#include <queue>
+#include <cmath>
+#include <tuple>
+
+using namespace std;
+
+// Cost of an edge between vertices whose bone weights have nothing in common,
+// relative to its squared length
+static const double kSkinWeightCost = 1.0;
+
+// A collapse must not turn any remaining triangle further than acos of this
+static const float kMinNormalCosine = 0.2f;
+
+// Weight of the planes that keep open borders in place, relative to a face
+static const float kBorderWeight = 10.f;
+
+// Sum of the squared distances to a set of planes, as a symmetric 4x4 matrix
+class Quadric
+{
+public:
+	void addPlane(const aiVector3D& normal, float d, float weight = 1.f)
+	{
+		double a = normal.x, b = normal.y, c = normal.z, e = d;
+		q[0] += weight * a * a; q[1] += weight * a * b; q[2] += weight * a * c; q[3] += weight * a * e;
+		q[4] += weight * b * b; q[5] += weight * b * c; q[6] += weight * b * e;
+		q[7] += weight * c * c; q[8] += weight * c * e;
+		q[9] += weight * e * e;
+	}
+
+	Quadric& operator+=(const Quadric& other)
+	{
+		for (int i = 0; i < 10; ++i)
+			q[i] += other.q[i];
+		return *this;
+	}
+
+	double error(const aiVector3D& v) const
+	{
+		double x = v.x, y = v.y, z = v.z;
+		return q[0] * x * x + 2 * q[1] * x * y + 2 * q[2] * x * z + 2 * q[3] * x
+			+ q[4] * y * y + 2 * q[5] * y * z + 2 * q[6] * y
+			+ q[7] * z * z + 2 * q[8] * z + q[9];
+	}
+
+private:
+	double q[10] = {0.0};
+};
+
+// Half edge collapses on positions. Vertices of source sharing a position, the
+// copies along a texture seam, form one position and collapse together, each
+// onto the vertex of the target position on the same side of the seam.
+class Simplifier
+{
+public:
+	explicit Simplifier(const Mesh& source);
+
+	// Collapse the cheapest edges until at most target_vertices vertices are used
+	void run(int target_vertices);
+
+	// Vertices, indices and skin of the result, the bones are left to the caller
+	void output(Mesh& out) const;
+
+private:
+	class Candidate
+	{
+	public:
+		double cost;
+		int from, to;
+		unsigned from_version, to_version;
+
+		// priority_queue keeps the largest on top
+		bool operator<(const Candidate& other) const { return cost > other.cost; }
+	};
+
+	int cornerPosition(int triangle, int corner) const { return vertex_position[triangles[triangle * 3 + corner]]; }
+	bool hasPosition(int triangle, int p) const;
+	aiVector3D triangleNormal(int triangle, int moved, const aiVector3D& moved_to) const;
+
+	void neighbours(int p, vector<int>& out) const;
+	int edgeTriangles(int p, int q) const;
+	double weightDistance(int p, int q) const;
+
+	void push(int from, int to);
+	bool canCollapse(int from, int to, vector<pair<int, int>>& remap);
+	void collapse(int from, int to, const vector<pair<int, int>>& remap);
+
+	const Mesh& source;
+	const SkinData& skin;
+
+	vector<int> vertex_position;		// position of every vertex of source
+	vector<aiVector3D> positions;
+	vector<Quadric> quadrics;
+	vector<vector<int>> position_vertices;
+	vector<vector<int>> position_triangles;		// may still list removed triangles
+	vector<unsigned> versions;					// bumped whenever the quadric or neighbourhood changes
+	vector<char> removed_positions;
+
+	vector<unsigned int> triangles;		// 3 vertices each, rewritten by the collapses
+	vector<char> removed_triangles;
+
+	priority_queue<Candidate> candidates;
+	vector<int> vertex_uses;		// corners of the remaining triangles at every vertex
+	int num_vertices{0};		// vertices still used by some triangle, those output keeps
+
+	vector<int> scratch_from, scratch_to;
+};
+
+Simplifier::Simplifier(const Mesh& source) : source(source), skin(source.skin)
+{
+	// Group the vertices by exact position
+	int n = skin.num_vertices;
+	vector<int> order(n);
+	for (int i = 0; i < n; ++i)
+		order[i] = i;
+	auto key = [this](int v) { return make_tuple(skin.pos_x[v], skin.pos_y[v], skin.pos_z[v]); };
+	sort(order.begin(), order.end(), [&key](int a, int b) { return key(a) < key(b); });
+
+	vertex_position.resize(n);
+	for (int i = 0; i < n; ++i)
+	{
+		int v = order[i];
+		if (i == 0 || key(v) != key(order[i - 1]))
+		{
+			positions.push_back(aiVector3D(skin.pos_x[v], skin.pos_y[v], skin.pos_z[v]));
+			position_vertices.emplace_back();
+		}
+		vertex_position[v] = positions.size() - 1;
+		position_vertices.back().push_back(v);
+	}
+
+	int num_positions = positions.size();
+	quadrics.resize(num_positions);
+	position_triangles.resize(num_positions);
+	versions.assign(num_positions, 0);
+	removed_positions.assign(num_positions, 0);
+
+	// Degenerate triangles are dropped right away, they only confuse the topology checks
+	vertex_uses.assign(n, 0);
+	for (int i = 0; i + 2 < source.indices.size(); i += 3)
+	{
+		const unsigned int* face = &source.indices[i];
+		int a = vertex_position[face[0]], b = vertex_position[face[1]], c = vertex_position[face[2]];
+		if (a == b || b == c || a == c)
+			continue;
+
+		aiVector3D normal = (positions[b] - positions[a]) ^ (positions[c] - positions[a]);
+		float length = normal.Length();
+		if (length <= 0.f)
+			continue;
+		normal /= length;
+
+		int t = triangles.size() / 3;
+		triangles.insert(triangles.end(), face, face + 3);
+		for (int p : {a, b, c})
+		{
+			quadrics[p].addPlane(normal, -(normal * positions[a]));
+			position_triangles[p].push_back(t);
+		}
+		for (int k = 0; k < 3; ++k)
+			num_vertices += vertex_uses[face[k]]++ == 0;
+	}
+	removed_triangles.assign(triangles.size() / 3, 0);
+
+	// Planes through the open border edges, perpendicular to their face, hold the border in place
+	for (int t = 0; t < removed_triangles.size(); ++t)
+	{
+		aiVector3D normal = triangleNormal(t, -1, aiVector3D()).NormalizeSafe();
+		for (int k = 0; k < 3; ++k)
+		{
+			int a = cornerPosition(t, k), b = cornerPosition(t, (k + 1) % 3);
+			if (edgeTriangles(a, b) != 1)
+				continue;
+			aiVector3D border = (normal ^ (positions[b] - positions[a])).NormalizeSafe();
+			float d = -(border * positions[a]);
+			quadrics[a].addPlane(border, d, kBorderWeight);
+			quadrics[b].addPlane(border, d, kBorderWeight);
+		}
+	}
+}
+
+bool Simplifier::hasPosition(int triangle, int p) const
+{
+	return cornerPosition(triangle, 0) == p || cornerPosition(triangle, 1) == p || cornerPosition(triangle, 2) == p;
+}
+
+// Normal of triangle, with the corner at position moved placed at moved_to
+aiVector3D Simplifier::triangleNormal(int triangle, int moved, const aiVector3D& moved_to) const
+{
+	aiVector3D corners[3];
+	for (int k = 0; k < 3; ++k)
+	{
+		int p = cornerPosition(triangle, k);
+		corners[k] = p == moved ? moved_to : positions[p];
+	}
+	return (corners[1] - corners[0]) ^ (corners[2] - corners[0]);
+}
+
+void Simplifier::neighbours(int p, vector<int>& out) const
+{
+	out.clear();
+	for (int t : position_triangles[p])
+	{
+		if (removed_triangles[t])
+			continue;
+		for (int k = 0; k < 3; ++k)
+		{
+			int r = cornerPosition(t, k);
+			if (r != p)
+				out.push_back(r);
+		}
+	}
+	sort(out.begin(), out.end());
+	out.erase(unique(out.begin(), out.end()), out.end());
+}
+
+int Simplifier::edgeTriangles(int p, int q) const
+{
+	int count = 0;
+	for (int t : position_triangles[p])
+		if (!removed_triangles[t] && hasPosition(t, q))
+			++count;
+	return count;
+}
+
+// L1 distance of the bone weights, between 0 for the same and 2 for disjoint influences
+double Simplifier::weightDistance(int p, int q) const
+{
+	const int* index_p = &skin.bone_index[position_vertices[p][0] * kMaxInfluences];
+	const int* index_q = &skin.bone_index[position_vertices[q][0] * kMaxInfluences];
+	const float* weight_p = &skin.bone_weight[position_vertices[p][0] * kMaxInfluences];
+	const float* weight_q = &skin.bone_weight[position_vertices[q][0] * kMaxInfluences];
+
+	// Unused slots have zero weight and an arbitrary index, they must not match anything
+	double distance = 0.0;
+	for (int i = 0; i < kMaxInfluences; ++i)
+	{
+		if (weight_p[i] == 0.f)
+			continue;
+		float other = 0.f;
+		for (int j = 0; j < kMaxInfluences; ++j)
+			if (weight_q[j] != 0.f && index_q[j] == index_p[i])
+				other += weight_q[j];
+		distance += abs(weight_p[i] - other);
+	}
+	for (int j = 0; j < kMaxInfluences; ++j)
+	{
+		bool shared = false;
+		for (int i = 0; i < kMaxInfluences; ++i)
+			shared = shared || (weight_p[i] != 0.f && index_p[i] == index_q[j]);
+		if (!shared)
+			distance += weight_q[j];
+	}
+	return distance;
+}
+
+void Simplifier::push(int from, int to)
+{
+	Quadric quadric = quadrics[from];
+	quadric += quadrics[to];
+	double error = max(0.0, quadric.error(positions[to]));
+	double length = (positions[from] - positions[to]).SquareLength();
+
+	Candidate candidate;
+	candidate.cost = error + kSkinWeightCost * weightDistance(from, to) * length;
+	candidate.from = from;
+	candidate.to = to;
+	candidate.from_version = versions[from];
+	candidate.to_version = versions[to];
+	candidates.push(candidate);
+}
+
+// remap receives the vertex of to that replaces every used vertex of from
+bool Simplifier::canCollapse(int from, int to, vector<pair<int, int>>& remap)
+{
+	// Only manifold edges, and a vertex on an open border may only slide along it
+	int shared = edgeTriangles(from, to);
+	if (shared == 0 || shared > 2)
+		return false;
+	neighbours(from, scratch_from);
+	for (int r : scratch_from)
+	{
+		int count = edgeTriangles(from, r);
+		if (count > 2 || (count == 1 && shared == 2))
+			return false;
+	}
+
+	// The two may only share the neighbours across the collapsed edge, or the surface folds
+	neighbours(to, scratch_to);
+	int common = 0;
+	for (int i = 0, j = 0; i < scratch_from.size() && j < scratch_to.size(); )
+	{
+		if (scratch_from[i] < scratch_to[j])
+			++i;
+		else if (scratch_to[j] < scratch_from[i])
+			++j;
+		else
+			++common, ++i, ++j;
+	}
+	if (common != shared)
+		return false;
+
+	// Every used vertex of from has to meet exactly one vertex of to across the edge,
+	// a vertex on a texture seam therefore only collapses along the seam
+	remap.clear();
+	for (int v : position_vertices[from])
+	{
+		int target = -1;
+		bool used = false;
+		for (int t : position_triangles[from])
+		{
+			if (removed_triangles[t])
+				continue;
+			const unsigned int* corners = &triangles[t * 3];
+			if (corners[0] != v && corners[1] != v && corners[2] != v)
+				continue;
+			used = true;
+			for (int k = 0; k < 3; ++k)
+			{
+				if (vertex_position[corners[k]] != to)
+					continue;
+				if (target >= 0 && target != corners[k])
+					return false;
+				target = corners[k];
+			}
+		}
+		if (!used)
+			continue;
+		if (target < 0)
+			return false;
+		remap.push_back(make_pair(v, target));
+	}
+
+	// No remaining triangle may flip or collapse to a sliver
+	for (int t : position_triangles[from])
+	{
+		if (removed_triangles[t] || hasPosition(t, to))
+			continue;
+		aiVector3D before = triangleNormal(t, -1, aiVector3D());
+		aiVector3D after = triangleNormal(t, from, positions[to]);
+		if (before * after < kMinNormalCosine * before.Length() * after.Length() || after.SquareLength() == 0.f)
+			return false;
+	}
+	return true;
+}
+
+void Simplifier::collapse(int from, int to, const vector<pair<int, int>>& remap)
+{
+	for (int t : position_triangles[from])
+	{
+		if (removed_triangles[t])
+			continue;
+		// A vertex counts as long as a remaining triangle uses it, also one that was not remapped
+		unsigned int* corners = &triangles[t * 3];
+		if (hasPosition(t, to))
+		{
+			removed_triangles[t] = 1;
+			for (int k = 0; k < 3; ++k)
+				num_vertices -= --vertex_uses[corners[k]] == 0;
+			continue;
+		}
+
+		for (int k = 0; k < 3; ++k)
+		{
+			for (const auto& entry : remap)
+			{
+				if (corners[k] != entry.first)
+					continue;
+				num_vertices -= --vertex_uses[corners[k]] == 0;
+				corners[k] = entry.second;
+				num_vertices += vertex_uses[corners[k]]++ == 0;
+				break;
+			}
+		}
+		position_triangles[to].push_back(t);
+	}
+
+	quadrics[to] += quadrics[from];
+	removed_positions[from] = 1;
+	vector<int>().swap(position_triangles[from]);
+	++versions[to];
+
+	auto& list = position_triangles[to];
+	list.erase(remove_if(list.begin(), list.end(), [this](int t) { return removed_triangles[t] != 0; }), list.end());
+
+	// Every edge at to changed its cost
+	neighbours(to, scratch_to);
+	for (int r : scratch_to)
+	{
+		push(r, to);
+		push(to, r);
+	}
+}
+
+void Simplifier::run(int target_vertices)
+{
+	for (int t = 0; t < removed_triangles.size(); ++t)
+	{
+		for (int k = 0; k < 3; ++k)
+		{
+			int a = cornerPosition(t, k), b = cornerPosition(t, (k + 1) % 3);
+			push(a, b);
+			push(b, a);
+		}
+	}
+
+	vector<pair<int, int>> remap;
+	while (num_vertices > target_vertices && !candidates.empty())
+	{
+		Candidate candidate = candidates.top();
+		candidates.pop();
+
+		// Stale if either end was collapsed or changed since the candidate was pushed
+		int from = candidate.from, to = candidate.to;
+		if (removed_positions[from] || removed_positions[to]
+			|| versions[from] != candidate.from_version || versions[to] != candidate.to_version)
+			continue;
+
+		if (canCollapse(from, to, remap))
+			collapse(from, to, remap);
+	}
+}
+
+void Simplifier::output(Mesh& out) const
+{
+	// Vertices are numbered in the order the triangles first use them
+	vector<int> new_index(skin.num_vertices, -1);
+	vector<int> kept;
+	out.indices.clear();
+	for (int t = 0; t < removed_triangles.size(); ++t)
+	{
+		if (removed_triangles[t])
+			continue;
+		for (int k = 0; k < 3; ++k)
+		{
+			int v = triangles[t * 3 + k];
+			if (new_index[v] < 0)
+			{
+				new_index[v] = kept.size();
+				kept.push_back(v);
+			}
+			out.indices.push_back(new_index[v]);
+		}
+	}
+
+	int n = kept.size();
+	SkinData& result = out.skin;
+	result.num_vertices = n;
+	result.pos_x.resize(n); result.pos_y.resize(n); result.pos_z.resize(n);
+	result.nrm_x.resize(n); result.nrm_y.resize(n); result.nrm_z.resize(n);
+	result.bone_index.resize(n * kMaxInfluences);
+	result.bone_weight.resize(n * kMaxInfluences);
+	out.vertices.resize(n);
+	for (int i = 0; i < n; ++i)
+	{
+		int v = kept[i];
+		result.pos_x[i] = skin.pos_x[v]; result.pos_y[i] = skin.pos_y[v]; result.pos_z[i] = skin.pos_z[v];
+		result.nrm_x[i] = skin.nrm_x[v]; result.nrm_y[i] = skin.nrm_y[v]; result.nrm_z[i] = skin.nrm_z[v];
+		copy_n(&skin.bone_index[v * kMaxInfluences], kMaxInfluences, &result.bone_index[i * kMaxInfluences]);
+		copy_n(&skin.bone_weight[v * kMaxInfluences], kMaxInfluences, &result.bone_weight[i * kMaxInfluences]);
+
+		// Bind pose, until the first skinning
+		out.vertices[i].world_pos = aiVector3D(skin.pos_x[v], skin.pos_y[v], skin.pos_z[v]);
+		out.vertices[i].normal = aiVector3D(skin.nrm_x[v], skin.nrm_y[v], skin.nrm_z[v]);
+		out.vertices[i].tex_coords = source.vertices[v].tex_coords;
+	}
+}
+
+int simplifyMesh(const Mesh& source, int target_vertices, Mesh& out)
+{
+	Simplifier simplifier(source);
+	simplifier.run(target_vertices);
+
+	out = Mesh();
+	out.name = source.name;
+	out.bones = source.bones;
+	for (auto& bone : out.bones)
+	{
+		bone.dirty = true;
+		bone.moved = false;
+	}
+	out.bone_map = source.bone_map;
+	simplifier.output(out);
+	out.skin.buildBoneVertices(out.bones.size());
+	return out.skin.num_vertices;
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include "ModelHelper.h"
+
+// Reduce source to at most target_vertices vertices with quadric error edge
+// collapses, out receives the reduced geometry and skin and the bones of source.
+// Vertices only ever collapse onto other vertices of source, so the positions,
+// texture coordinates and bone weights of out are all copied from source:
+// no blended weight can move a vertex somewhere neither bone would take it.
+// Texture seams and open borders only collapse along themselves, and edges
+// between differently weighted vertices cost more, which keeps the joints.
+// Works on the bind pose in source.skin. Returns the vertex count of out,
+// which stays above the target when no collapse is left that keeps the mesh intact.
+int simplifyMesh(const Mesh& source, int target_vertices, Mesh& out);
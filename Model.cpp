@@ -17,19 +17,27 @@
 #include "LSystem.h"
 #include "IKSolver.h"
 #include "Torus.h"
+#include "Skinning.h"
+#include "Profiler.h"
+#include "FrameScheduler.h"
+#include "Crowd.h"
+#include "LodChain.h"
 
 using namespace std;
 using namespace Assimp;
 using Matrix4f = aiMatrix4x4t<float>;
 
 ModelHelper helper;		// simply use global variable for now
-Matrix4f global_inverse;
-float tick = 0.f;
 float cur_fov = 30.f;
 float cur_zfar = 100.f;
 LSystem l_system;
+LSystemCache forest;		// distinct trees grown from forestTree with different seeds
 IKSolver solver;
-Torus* torus; 
+Torus* torus{nullptr};		// rebuilt when one of its controls changes
+Crowd crowd;				// herd of walking copies of the active mesh
+LodChain lods;				// levels of detail of the deer, finest first
+int deer_level{0};			// level picked for the deer last frame
+const int kDefaultLod = 2;	// LOD slider position that leaves the level to automatic LOD
 
 // To make a SampleModel, we inherit off of ModelerView
 class SampleModel : public ModelerView 
@@ -190,135 +198,12 @@ void frameAll()
 	adjustCamera(point, aspect);
 }
 
-// Animation
-void animate()
-{
-	auto& mesh = helper.meshes[helper.active_index];
-	float left1 = -cos(tick) * 20;
-	float right1 = -sin(tick) * 20;
-	float left2 = -cos(tick) * 45;
-	float right2 = -sin(tick) * 45;
-	float left3 = max(cos(tick) * 110, 0);
-	float right3 = max(sin(tick) * 110, 0);
-	float head = sin(tick) * 2;
-	float neck = cos(tick) * 2;
-	float tail = cos(tick) * 4;
-	float main = sin(tick) * 0.1f;
-	float fore_body = sin(tick) * 1.5f;
-	float rear = cos(tick) * 1.f;
-
-	mesh.applyTranslate("main", aiVector3D(0, 0, main));
-	mesh.applyRotationZ("neck", neck);
-	mesh.applyRotationZ("head", head);
-	mesh.applyRotationZ("tail", tail);
-	mesh.applyRotationZ("foreBody", fore_body);
-	mesh.applyRotationZ("rear", rear);
-	
-	mesh.applyRotationZ("foreLimpLeft1", left1);
-	mesh.applyRotationZ("foreLimpRight1", right1);
-	mesh.applyRotationZ("rearLimpLeft1", left1);
-	mesh.applyRotationZ("rearLimpRight1", right1);
-
-	mesh.applyRotationZ("foreLimpLeft2", left2);
-	mesh.applyRotationZ("foreLimpRight2", right2);
-	mesh.applyRotationZ("rearLimpLeft2", left2);
-	mesh.applyRotationZ("rearLimpRight2", right2);
-
-	mesh.applyRotationZ("foreLimpLeft3", left3);
-	mesh.applyRotationZ("foreLimpRight3", right3);
-	mesh.applyRotationZ("rearLimpLeft3", left3 * 0.5);
-	mesh.applyRotationZ("rearLimpRight3", right3 * 0.5);
-
-	tick += 0.5f;
-	if (tick > 1e4f * AI_MATH_PI_F)
-		tick = 0.f;
-}
-
-
-// aiNode* is a node in the bone hierarchy, it contains the name, its own transformation, and
-// pointers to its parent and children
-void traverseBoneHierarchy(Mesh& mesh, const aiNode* cur, const Matrix4f& parent_transformation)
-{
-	if (cur == nullptr) return;
-	string bone_name(Mesh::processBoneName(cur->mName.data));
-
-	// cur->mTransformation transforms the node from its local space to its parent's space
-	Matrix4f cur_transformation = cur->mTransformation;
-	Matrix4f global_transformation = parent_transformation * cur_transformation;
-
-	// In case some node doesn't represent a bone, we check whether we can find the bone_name in the map
-	if (mesh.bone_map.find(bone_name) != mesh.bone_map.end())
-	{
-		int bone_index = mesh.bone_map[bone_name];
-
-		global_transformation = global_transformation * mesh.bones[bone_index].local_transformation; 
-
-		// final_transformation is used to transform the vertices from local space to world space
-		// any other transformation should be right-multiplied to global_transformation
-		mesh.bones[bone_index].final_transformation = 
-			global_inverse * global_transformation * mesh.bones[bone_index].offset;
-	}
-	else if (mesh.parent != nullptr)
-	{
-		Mesh& p = *(mesh.parent);
-		if (p.bone_map.find(bone_name) != p.bone_map.end())
-			global_transformation = global_transformation * p.bones[p.bone_map[bone_name]].local_transformation;
-	}
-
-	// Recursively visit its children
-	for (int i = 0; i < cur->mNumChildren; ++i)
-	{
-		traverseBoneHierarchy(mesh, cur->mChildren[i], global_transformation);
-	}
-}
-
-
-// Update the position in world space for each vertex
-void processVertices(Mesh& mesh)
-{
-	for (auto& vertex : mesh.vertices)
-	{
-		auto& bone = mesh.bones[vertex.bone_index[0]];
-		Matrix4f transformation = bone.final_transformation * vertex.bone_weight[0];
-
-		for (int i = 1; i < vertex.bone_index.size(); ++i)
-		{
-			auto& bone = mesh.bones[vertex.bone_index[i]];
-			transformation = transformation + bone.final_transformation * vertex.bone_weight[i];
-		}
-		vertex.world_pos = transformation * vertex.original_pos;
-	}
-}
-
-
 void renderMesh(Mesh& mesh)
 {
-	auto* ai_mesh = mesh.data;
-	for (int i = 0; i < ai_mesh->mNumFaces; ++i)
-	{
-		const aiFace& face = ai_mesh->mFaces[i];
-		//auto& vertices = mesh.vertices;
-		//int v1 = face.mIndices[0];
-		//int v2 = face.mIndices[1];
-		//int v3 = face.mIndices[2];
-		
-		// drawTriangle(vertices[v1], vertices[v2], vertices[v3]);
-		drawTriangle(mesh, face);
-	}
+	// One draw call for the whole mesh, unless a .ray file is open
+	drawMesh(mesh);
 
-	// Recalculate aabb for the mesh
-	mesh.aabb_min = mesh.aabb_max = mesh.vertices[0].world_pos;
-	for (auto& vt : mesh.vertices)
-	{
-		aiVector3D& pos = vt.world_pos;
-		mesh.aabb_min.x = min(mesh.aabb_min.x, pos.x);
-		mesh.aabb_min.y = min(mesh.aabb_min.y, pos.y);
-		mesh.aabb_min.z = min(mesh.aabb_min.z, pos.z);
-
-		mesh.aabb_max.x = max(mesh.aabb_max.x, pos.x);
-		mesh.aabb_max.y = max(mesh.aabb_max.y, pos.y);
-		mesh.aabb_max.z = max(mesh.aabb_max.z, pos.z);
-	}
+	// aabb of the mesh is updated by processVertices
 }
 
 
@@ -357,7 +242,7 @@ void renderBones(Mesh& mesh, const aiNode* cur)
 		glRotatef(theta * 180.f / AI_MATH_PI_F, axis.z, axis.x, axis.y);
 
 		// Apply user controls, after change of coordinates
-		applyAiMatrix(inverse_permutation * bone.local_transformation * permutation);
+		applyAiMatrix(inverse_permutation * bone.local_transformation.toMatrix4() * permutation);
 		
 		drawCylinder(bone.length, 0.3, 0.01);	// cylinder for now
 	}
@@ -368,15 +253,89 @@ void renderBones(Mesh& mesh, const aiNode* cur)
 	glPopMatrix();
 }
 
-void render(int mesh_id, void(* applyMethod)())
+SkinningMethod skinningMethod()
+{
+	return VAL(DUAL_QUAT_SKINNING) ? SkinningMethod::DUAL_QUATERNION : SkinningMethod::LINEAR;
+}
+
+// Frustum at the current matrices, contains everything while culling is off
+Frustum cullingFrustum()
 {
-	helper.active_index = mesh_id;
-	helper.meshes[mesh_id].bindTexture();
-	applyMeshControls();
-	applyMethod();
-	traverseBoneHierarchy(helper.meshes[mesh_id], helper.scene->mRootNode, Matrix4f());
-	processVertices(helper.meshes[mesh_id]);
-	renderMesh(helper.meshes[mesh_id]);
+	return VAL(FRUSTUM_CULLING) ? currentFrustum() : Frustum();
+}
+
+// Grammar of the trees of the forest. Every apex picks one of three shapes and
+// passes a shorter length on, the turns take the angle of the L-system controls.
+LSystem& forestTree()
+{
+	static LSystem tree;
+	if (tree.stochastic_rule.empty())
+	{
+		tree.rule.clear();
+		tree.init_str = "A(1)";
+		tree.stochastic_rule["A(l)"] = {
+			{0.5f, "F(l)[&A(l*0.75)]/////[&A(l*0.7)]///////[&A(l*0.65)]"},
+			{0.3f, "F(l)[&A(l*0.8)]////////[&A(l*0.6)]"},
+			{0.2f, "F(l*0.5)F(l*0.5)/(137.5)A(l*0.85)"}};
+		tree.rule["F(l)"] = "F(l*1.05)";
+		tree.max_iter = 6;
+	}
+	return tree;
+}
+
+// Space between the trees of the forest
+const float kForestSpacing = 5.f;
+
+// Controls of the control points of the Bezier curve
+const int curve_points[4][3] = {{POINT_X1, POINT_Y1, POINT_Z1}, {POINT_X2, POINT_Y2, POINT_Z2},
+	{POINT_X3, POINT_Y3, POINT_Z3}, {POINT_X4, POINT_Y4, POINT_Z4}};
+
+// The curve stays within the box of its control points
+void curveBounds(aiVector3D& aabb_min, aiVector3D& aabb_max)
+{
+	aabb_min = aiVector3D(1e10f, 1e10f, 1e10f);
+	aabb_max = aiVector3D(-1e10f, -1e10f, -1e10f);
+	for (const auto& point : curve_points)
+		for (int k = 0; k < 3; ++k)
+		{
+			aabb_min[k] = min(aabb_min[k], VAL(point[k]));
+			aabb_max[k] = max(aabb_max[k], VAL(point[k]));
+		}
+}
+
+// Box around the surface drawRotation sweeps the curve into, around the x axis
+void rotationBounds(aiVector3D& aabb_min, aiVector3D& aabb_max)
+{
+	curveBounds(aabb_min, aabb_max);
+	float radius = 0.f;
+	for (const auto& point : curve_points)
+		radius = max(radius, sqrt(VAL(point[1]) * VAL(point[1]) + VAL(point[2]) * VAL(point[2])));
+	aabb_min.y = aabb_min.z = -radius;
+	aabb_max.y = aabb_max.z = radius;
+}
+
+// Render an accessory posed by the skeleton of the deer, which is already evaluated.
+// Accessories outside frustum are posed but neither skinned nor drawn.
+void render(int mesh_id, const Mesh& skeleton, const Frustum& frustum)
+{
+	auto& mesh = helper.meshes[mesh_id];
+	{
+		ProfileScope scope(ProfileStage::SKELETON);
+		helper.evaluateAttached(mesh, skeleton);
+	}
+	aiVector3D pose_min, pose_max;
+	calPoseBounds(mesh.skin, mesh.bones, skinningMethod(), pose_min, pose_max);
+	if (!frustum.boxVisible(pose_min, pose_max))
+		return;
+
+	mesh.bindTexture();
+	{
+		ProfileScope scope(ProfileStage::SKINNING);
+		mesh.setSkinningMethod(skinningMethod());
+		processVertices(mesh);
+	}
+	ProfileScope scope(ProfileStage::SUBMIT);
+	renderMesh(mesh);
 }
 
 //void adjustLight
@@ -385,7 +344,15 @@ void render(int mesh_id, void(* applyMethod)())
 // method of ModelerView to draw out SampleModel
 void SampleModel::draw()
 {
-	// Change LOD
+	FrameScheduler::Instance()->beginFrame();
+	if (Profiler::enabled)
+		Profiler::Instance()->beginFrame();
+
+	// Every VAL below sees the controls as they are now
+	auto* controls = ControlSnapshot::Instance();
+	controls->beginFrame();
+
+	// Change LOD by hand. Automatic LOD picks the level further down while the slider is at its default.
 	int lod = VAL(LOD);
 	switch (lod)
 	{
@@ -477,6 +444,7 @@ void SampleModel::draw()
 	// Render L-system
 	if (VAL(L_SYSTEM_ENABLE))
 	{
+		ProfileScope scope(ProfileStage::L_SYSTEM);
 		glPushMatrix();
 		glRotated(-90, 1, 0, 0);
 		glTranslated(0, -5, 0);
@@ -486,17 +454,48 @@ void SampleModel::draw()
 			l_system.forward_dist = VAL(L_SYSTEM_BRANCH_LENGTH);
 			l_system.need_regenerate = true;
 		}
-		l_system.draw();
+		l_system.draw(cullingFrustum());
+
+		// The forest fills a grid around the tree above, every tree from a seed of its own
+		int forest_size = VAL(L_SYSTEM_FOREST);
+		if (forest_size > 0)
+		{
+			LSystem& prototype = forestTree();
+			prototype.pitch_angle = prototype.yaw_angle = prototype.roll_angle = VAL(L_SYSTEM_ANGLE);
+			int side = int(ceil(sqrt(forest_size + 1.0)));
+			for (int i = 0, cell = 0; i < forest_size; ++cell)
+			{
+				float x = (cell % side - (side - 1) * 0.5f) * kForestSpacing;
+				float y = (cell / side - (side - 1) * 0.5f) * kForestSpacing;
+				if (x == 0.f && y == 0.f)
+					continue;
+				glPushMatrix();
+				glTranslatef(x, y, 0.f);
+				// Scaled by a large odd number, so that the next forest seed grows other trees
+				// instead of shifting every tree one cell over
+				unsigned seed = unsigned(VAL(L_SYSTEM_SEED)) * 0x9E3779B1u + unsigned(i);
+				forest.get(prototype, seed).draw(cullingFrustum());
+				glPopMatrix();
+				++i;
+			}
+		}
 		glPopMatrix();
 	}
 
+	ProfileScope primitives_scope(ProfileStage::PRIMITIVES);
+	if (controls->changed(TORUS_RING_LR, TORUS_PETAL)) {
+		delete torus;
+		torus = nullptr;
+	}
+
 	if (VAL(POLYGON_TORUS)) {
-		torus = new Torus(VAL(TORUS_TUBE_LR), VAL(TORUS_TUBE_SR), VAL(TORUS_RING_LR), VAL(TORUS_RING_SR), VAL(TORUS_PX),
-			VAL(TORUS_PY), VAL(TORUS_PZ), VAL(TORUS_RX), VAL(TORUS_RY), VAL(TORUS_RZ), VAL(TORUS_FLOWER), VAL(TORUS_PETAL));
+		if (torus == nullptr)
+			torus = new Torus(VAL(TORUS_TUBE_LR), VAL(TORUS_TUBE_SR), VAL(TORUS_RING_LR), VAL(TORUS_RING_SR), VAL(TORUS_PX),
+				VAL(TORUS_PY), VAL(TORUS_PZ), VAL(TORUS_RX), VAL(TORUS_RY), VAL(TORUS_RZ), VAL(TORUS_FLOWER), VAL(TORUS_PETAL));
 		glPushMatrix();
-		torus->draw();
+		if (torus->visible(cullingFrustum()))
+			torus->draw();
 		glPopMatrix();
-		delete torus;
 	}
 
 	if (VAL(PRIMITIVE_TORUS)) {
@@ -505,26 +504,34 @@ void SampleModel::draw()
 		// glRotatef(VAL(TORUS_RX), 1.0, 0.0, 0.0);
 		//glRotatef(VAL(TORUS_RY), 0.0, 1.0, 0.0);
 		//glRotatef(VAL(TORUS_RZ), 0.0, 0.0, 1.0);
-		drawTorus(VAL(TORUS_RING_LR),VAL(TORUS_RING_SR), VAL(TORUS_TUBE_LR),VAL(TORUS_TUBE_SR), 
-			VAL(TORUS_PX), VAL(TORUS_PY), VAL(TORUS_PZ), VAL(TORUS_RX), VAL(TORUS_RY), VAL(TORUS_RZ), VAL(TORUS_FLOWER), VAL(TORUS_PETAL));
+		float radius = Torus::boundingRadius(VAL(TORUS_RING_LR), VAL(TORUS_RING_SR), VAL(TORUS_TUBE_LR), VAL(TORUS_TUBE_SR), VAL(TORUS_FLOWER));
+		if (cullingFrustum().sphereVisible(aiVector3D(VAL(TORUS_PX), VAL(TORUS_PY), VAL(TORUS_PZ)), radius))
+			drawTorus(VAL(TORUS_RING_LR),VAL(TORUS_RING_SR), VAL(TORUS_TUBE_LR),VAL(TORUS_TUBE_SR), 
+				VAL(TORUS_PX), VAL(TORUS_PY), VAL(TORUS_PZ), VAL(TORUS_RX), VAL(TORUS_RY), VAL(TORUS_RZ), VAL(TORUS_FLOWER), VAL(TORUS_PETAL));
 		glPopMatrix();
 	}
 
+	aiVector3D aabb_min, aabb_max;
 	if (VAL(CURVE_ENABLE)) {
 		glPushMatrix();
-		drawCurve(VAL(POINT_X1), VAL(POINT_Y1), VAL(POINT_Z1), VAL(POINT_X2), VAL(POINT_Y2), VAL(POINT_Z2), VAL(POINT_X3), VAL(POINT_Y3), VAL(POINT_Z3), VAL(POINT_X4), VAL(POINT_Y4), VAL(POINT_Z4));
+		curveBounds(aabb_min, aabb_max);
+		if (cullingFrustum().boxVisible(aabb_min, aabb_max))
+			drawCurve(VAL(POINT_X1), VAL(POINT_Y1), VAL(POINT_Z1), VAL(POINT_X2), VAL(POINT_Y2), VAL(POINT_Z2), VAL(POINT_X3), VAL(POINT_Y3), VAL(POINT_Z3), VAL(POINT_X4), VAL(POINT_Y4), VAL(POINT_Z4));
 		glPopMatrix();
 	}
 
 	if (VAL(CURVE_ROTATION)) {
 		glPushMatrix();
 		glRotatef(30, 0.0, 1.0, 0.0);
-		drawRotation(VAL(POINT_X1), VAL(POINT_Y1), VAL(POINT_Z1), VAL(POINT_X2), VAL(POINT_Y2), VAL(POINT_Z2), VAL(POINT_X3), VAL(POINT_Y3), VAL(POINT_Z3), VAL(POINT_X4), VAL(POINT_Y4), VAL(POINT_Z4));
+		rotationBounds(aabb_min, aabb_max);
+		if (cullingFrustum().boxVisible(aabb_min, aabb_max))
+			drawRotation(VAL(POINT_X1), VAL(POINT_Y1), VAL(POINT_Z1), VAL(POINT_X2), VAL(POINT_Y2), VAL(POINT_Z2), VAL(POINT_X3), VAL(POINT_Y3), VAL(POINT_Z3), VAL(POINT_X4), VAL(POINT_Y4), VAL(POINT_Z4));
 		glPopMatrix();
 	}
 
 	if (VAL(DRAW_NURBS))
 		nurbsDemo();
+	primitives_scope.stop();
 	
 	// drawSphere(0.1);
 	// drawCylinder(1, 0.1, 0.01);
@@ -540,10 +547,30 @@ void SampleModel::draw()
 		glRotated(180, 0, 0, 1);
 		glTranslated(0, 0, -5);
 
+		// The meshes are drawn in this space, see the transformations before renderMesh
+		LodView lod_view;
+		glPushMatrix();
+		glTranslated(0, 5, 0);
+		glRotated(180, 1, 0, 0);
+		glGetFloatv(GL_MODELVIEW_MATRIX, lod_view.modelview);
+		glPopMatrix();
+		glGetFloatv(GL_PROJECTION_MATRIX, lod_view.projection);
+		GLint viewport[4];
+		glGetIntegerv(GL_VIEWPORT, viewport);
+		lod_view.viewport_height = viewport[3];
+
+		// Pick the level of detail from the size of the deer on screen, unless the LOD slider
+		// was moved off its default, which forces the level it is at
+		bool auto_lod = VAL(AUTO_LOD) && lod == kDefaultLod && instance != 2 && lods.size() > 0;
+		if (auto_lod)
+		{
+			deer_level = lods.select(deer_level, lods.pixelsPerUnit(lod_view), VAL(LOD_PIXEL_ERROR));
+			helper.active_index = lods.meshIndex(deer_level);
+		}
+
 		// Initialization
 		auto& mesh = helper.meshes[helper.active_index];
 		auto* scene = helper.scene;
-		global_inverse = scene->mRootNode->mTransformation.Inverse();
 
 		mesh.bindTexture();
 
@@ -573,22 +600,38 @@ void SampleModel::draw()
 		}
 
 		// Apply controls to meshes
-		applyMethod();
+		{
+			ProfileScope scope(ProfileStage::CONTROLS);
+			applyMethod();
+		}
 
 		// Animation
 		if (ModelerApplication::Instance()->m_animating && !solver.show_ik_result && int(VAL(MOODS))==0)
+		{
+			ProfileScope scope(ProfileStage::ANIMATE);
 			animate();
+		}
 
 		// Apply the solution of IKSolver
 		if (solver.show_ik_result)
+		{
+			ProfileScope scope(ProfileStage::IK);
 			solver.applyRotation(mesh);
+		}
+
+		// Unless only the controls moved the bones, they have to be applied again next frame
+		if (applyMethod != applyMeshControls || ModelerApplication::Instance()->m_animating || solver.show_ik_result)
+			mesh.control_generation = 0;
 
 		// Apply controls to bones and render them
-		glPushMatrix();
-		glRotated(-90, 1, 0, 0);
-		glRotated(-90, 0, 0, 1);
-		renderBones(mesh, scene->mRootNode);
-		glPopMatrix();
+		{
+			ProfileScope scope(ProfileStage::BONES);
+			glPushMatrix();
+			glRotated(-90, 1, 0, 0);
+			glRotated(-90, 0, 0, 1);
+			renderBones(mesh, scene->mRootNode);
+			glPopMatrix();
+		}
 
 
 		// Avoid overlapping bones and meshes
@@ -597,12 +640,70 @@ void SampleModel::draw()
 
 		// Apply the solution of IKSolver
 		if (solver.show_ik_result)
+		{
+			ProfileScope scope(ProfileStage::IK);
 			solver.applyRotation(mesh);
+		}
 
-		// Render the meshes
-		traverseBoneHierarchy(mesh, scene->mRootNode, Matrix4f());
-		processVertices(mesh);
-		renderMesh(mesh);
+		// Render the meshes. The skeleton is evaluated even when the deer is out of view,
+		// its accessories and the bounds need it, but only a visible deer is skinned and drawn.
+		Frustum frustum = cullingFrustum();
+		{
+			ProfileScope scope(ProfileStage::SKELETON);
+			helper.evaluateSkeleton(mesh);
+		}
+		aiVector3D pose_min, pose_max;
+		calPoseBounds(mesh.skin, mesh.bones, skinningMethod(), pose_min, pose_max);
+		if (frustum.boxVisible(pose_min, pose_max))
+		{
+			{
+				ProfileScope scope(ProfileStage::SKINNING);
+				mesh.setSkinningMethod(skinningMethod());
+				processVertices(mesh);
+			}
+			ProfileScope scope(ProfileStage::SUBMIT);
+			renderMesh(mesh);
+		}
+
+		// Render the herd around the deer, every copy walks at its own phase and picks its own level of detail
+		int crowd_size = VAL(CROWD_SIZE);
+		if (crowd_size > 0)
+		{
+			ProfileScope scope(ProfileStage::CROWD);
+			int crowd_mesh = auto_lod ? lods.meshIndex(0) : helper.active_index;
+			if (!crowd.matches(crowd_mesh, crowd_size, VAL(CROWD_SPACING)))
+				crowd.build(crowd_mesh, crowd_size, VAL(CROWD_SPACING));
+			if (auto_lod)
+			{
+				for (auto& character : crowd.instances)
+				{
+					character.level = lods.select(character.level, lods.pixelsPerUnit(lod_view, character.root), VAL(LOD_PIXEL_ERROR));
+					character.mesh_index = lods.meshIndex(character.level);
+				}
+			}
+			crowd.update(helper, tick, skinningMethod(), frustum);
+
+			int bound_mesh = helper.active_index;
+			for (auto& character : crowd.instances)
+			{
+				if (!character.visible)
+					continue;
+				auto& character_mesh = helper.meshes[character.mesh_index];
+				if (character.mesh_index != bound_mesh)
+				{
+					character_mesh.bindTexture();
+					bound_mesh = character.mesh_index;
+				}
+				glPushMatrix();
+				applyAiMatrix(character.root.toMatrix4());
+				drawMesh(character_mesh, character.vertices);
+				glPopMatrix();
+			}
+		}
+		else if (crowd.size() > 0)
+		{
+			crowd.clear();
+		}
 
 		GLfloat mat_ambient[] = {0.247250, 0.199500, 0.074500, 1.000000};
 		GLfloat mat_diffuse[] = {0.751640, 0.606480, 0.226480, 1.000000};
@@ -613,34 +714,47 @@ void SampleModel::draw()
 		{
 		case 3:		// wreath
 			for (int i = 1; i <= 3; ++i)
-				render(i, applyMethod);
+				render(i, mesh, frustum);
 			break;
 		case 4:		// bells
 			glMaterialfv(GL_FRONT, GL_AMBIENT, mat_ambient);
 			glMaterialfv(GL_FRONT, GL_DIFFUSE, mat_diffuse);
 			glMaterialfv(GL_FRONT, GL_SPECULAR, mat_specular);
 			glMaterialfv(GL_FRONT, GL_SHININESS, mat_shininess);
-			render(8, applyMethod);
+			render(8, mesh, frustum);
 			break;
 		case 5:		// jet pack
 			glMaterialfv(GL_FRONT, GL_AMBIENT, mat_ambient);
 			glMaterialfv(GL_FRONT, GL_DIFFUSE, mat_diffuse);
 			glMaterialfv(GL_FRONT, GL_SPECULAR, mat_specular);
 			glMaterialfv(GL_FRONT, GL_SHININESS, mat_shininess);
-			render(9, applyMethod);
-			render(10, applyMethod);
+			render(9, mesh, frustum);
+			render(10, mesh, frustum);
 			break;
 		}
 	}
 
+	if (Profiler::enabled)
+	{
+		Profiler::Instance()->endFrame();
+		drawProfilerOverlay();
+	}
+	FrameScheduler::Instance()->endFrame();
 }
 
 int main()
 {
 	// Load the model and textures and init IK solver
-	helper.loadModel("./models/lowpolydeer_1.3.dae", "./models/lowpolydeer_bone_1.1.txt");
+	// Three more levels of detail are simplified from the deer, each with half the vertices of the one before
+	LodSettings lod;
+	lod.mesh = 0;
+	lod.levels = 3;
+	lod.ratio = 0.5f;
+	helper.loadModel("./models/lowpolydeer_1.3.dae", "./models/lowpolydeer_bone_1.1.txt", lod);
 
 	helper.meshes[0].loadTexture("./models/wood_texture.bmp");
+	for (int i : helper.lodLevels(0))
+		helper.meshes[i].loadTexture("./models/wood_texture.bmp");
 
 	for (int i = 4; i <= 7; ++i)
 		helper.meshes[i].loadTexture("./models/wood_texture.bmp");
@@ -650,7 +764,7 @@ int main()
 	helper.meshes[2].loadTexture("./models/wreath_diffuse.bmp");
 	
 	auto* scene = helper.scene;
-	std::cout << "Import done, mNumMeshes: " << scene->mNumMeshes << std::endl;
+	std::cout << "Import done, mNumMeshes: " << helper.meshes.size() << std::endl;
 	helper.printMeshInfo();
 
 	for (int i = 1; i <= 3; ++i)
@@ -659,6 +773,13 @@ int main()
 	for (int i = 8; i <= 10; ++i)
 		helper.meshes[i].parent = &helper.meshes[0];
 
+	// The hand made levels of detail of the deer, the same ones the LOD slider switches between,
+	// and the ones simplified from it
+	std::vector<int> deer_levels = {7, 6, 0, 5};
+	for (int i : helper.lodLevels(0))
+		deer_levels.push_back(i);
+	lods.build(helper, deer_levels);
+
 	Mesh& mesh = helper.meshes[helper.active_index];
 	solver.scene = scene;
 	solver.mesh = &mesh;
@@ -684,7 +805,7 @@ int main()
 	controls[LIGHT_INTENSITY] = ModelerControl("Lights'Intensity", 0, 2, 0.1, 1);
 	controls[LIGHT_RGB] = ModelerControl("Lights'color", 0, 3, 1, 0);
 	
-	controls[LOD] = ModelerControl("Level Of Details", 0, 3, 1, 2);
+	controls[LOD] = ModelerControl("Level Of Details", 0, 3, 1, kDefaultLod);
 	controls[INSTANCES] = ModelerControl("Different Instances", 1, 5, 1, 1);
 	controls[MOODS] = ModelerControl("Different Moods", 0, 5, 1, 0);
 
@@ -736,6 +857,8 @@ int main()
 	controls[L_SYSTEM_ENABLE] = ModelerControl("L-system Enable", 0, 1, 1, 0);
 	controls[L_SYSTEM_ANGLE] = ModelerControl("L-system Angle", 0, 60, 1, 22.5);
 	controls[L_SYSTEM_BRANCH_LENGTH] = ModelerControl("L-system Branch Length", 0, 1, 0.001, 0.1);
+	controls[L_SYSTEM_FOREST] = ModelerControl("L-system Forest Size", 0, 24, 1, 0);
+	controls[L_SYSTEM_SEED] = ModelerControl("L-system Forest Seed", 0, 1000, 1, 0);
 
 	controls[CURVE_ENABLE] = ModelerControl("Draw curve", 0, 1, 1, 0);
 	controls[CURVE_ROTATION] = ModelerControl("Rotate the curve", 0, 1, 1, 0);
@@ -769,6 +892,13 @@ int main()
 
 	controls[DRAW_NURBS] = ModelerControl("Extruded Surface", 0, 1, 1, 0);
 
+	controls[DUAL_QUAT_SKINNING] = ModelerControl("Dual Quaternion Skinning", 0, 1, 1, 0);
+	controls[CROWD_SIZE] = ModelerControl("Herd Size", 0, 1000, 1, 0);
+	controls[CROWD_SPACING] = ModelerControl("Herd Spacing", 8, 40, 0.5f, 14);
+	controls[AUTO_LOD] = ModelerControl("Automatic LOD", 0, 1, 1, 1);
+	controls[LOD_PIXEL_ERROR] = ModelerControl("LOD Pixel Error", 0.5f, 10, 0.5f, 1);
+	controls[FRUSTUM_CULLING] = ModelerControl("Frustum Culling", 0, 1, 1, 1);
+
     ModelerApplication::Instance()->Init(&createSampleModel, controls, NUMCONTROLS);
     return ModelerApplication::Instance()->Run();
 }
@@ -0,0 +1,423 @@
+#include "ModelCache.h"
+
+#include <iostream>
+#include <fstream>
+#include <stdexcept>
+#include <type_traits>
+#include <cstdio>
+#include <cstring>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <memory>
+#include <algorithm>
+
+using namespace std;
+
+static const char kModelCacheMagic[8] = {'M', 'D', 'L', 'C', 'A', 'C', 'H', 'E'};
+
+// Size and modification time of a file, zero if it does not exist
+static void fileStamp(const string& filename, uint64_t& size, uint64_t& time)
+{
+	struct stat info;
+	if (filename.empty() || stat(filename.c_str(), &info) != 0)
+	{
+		size = time = 0;
+		return;
+	}
+	size = info.st_size;
+	time = info.st_mtime;
+}
+
+ModelCacheKey ModelCacheKey::of(const string& model, const string& bone, const LodSettings& lod)
+{
+	ModelCacheKey key;
+	fileStamp(model, key.model_size, key.model_time);
+	fileStamp(bone, key.bone_size, key.bone_time);
+	key.bone = bone;
+	if (lod.mesh >= 0 && lod.levels > 0)
+	{
+		key.lod_mesh = lod.mesh;
+		key.lod_levels = lod.levels;
+		key.lod_ratio = lod.ratio;
+	}
+	return key;
+}
+
+bool ModelCacheKey::operator==(const ModelCacheKey& other) const
+{
+	return version == other.version && model_size == other.model_size && model_time == other.model_time
+		&& bone_size == other.bone_size && bone_time == other.bone_time && bone == other.bone
+		&& lod_mesh == other.lod_mesh && lod_levels == other.lod_levels && lod_ratio == other.lod_ratio;
+}
+
+string modelCacheFilename(const string& model)
+{
+	return model + ".cache";
+}
+
+class CacheWriter
+{
+public:
+	explicit CacheWriter(ofstream& fs) : fs(fs) { }
+
+	template <typename T>
+	void write(const T& value)
+	{
+		static_assert(is_trivially_copyable<T>::value, "only plain data can be cached");
+		fs.write(reinterpret_cast<const char*>(&value), sizeof(T));
+		offset += sizeof(T);
+	}
+
+	template <typename T>
+	void writeArray(const vector<T>& values)
+	{
+		static_assert(is_trivially_copyable<T>::value, "only plain data can be cached");
+		write(uint32_t(values.size()));
+		align();
+		fs.write(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(T));
+		offset += values.size() * sizeof(T);
+	}
+
+	void writeString(const string& str)
+	{
+		write(uint32_t(str.size()));
+		fs.write(str.data(), str.size());
+		offset += str.size();
+	}
+
+private:
+	void align()
+	{
+		static const char padding[kModelCacheAlignment] = {0};
+		size_t pad = (kModelCacheAlignment - offset % kModelCacheAlignment) % kModelCacheAlignment;
+		fs.write(padding, pad);
+		offset += pad;
+	}
+
+	ofstream& fs;
+	size_t offset{0};
+};
+
+// Reads from the file contents in memory, throws if the data runs out
+class CacheReader
+{
+public:
+	CacheReader(const char* data, size_t size) : data(data), size(size) { }
+
+	template <typename T>
+	T read()
+	{
+		static_assert(is_trivially_copyable<T>::value, "only plain data can be cached");
+		T value;
+		memcpy(&value, take(sizeof(T)), sizeof(T));
+		return value;
+	}
+
+	template <typename T>
+	void readArray(vector<T>& values)
+	{
+		static_assert(is_trivially_copyable<T>::value, "only plain data can be cached");
+		uint32_t count = read<uint32_t>();
+		offset += (kModelCacheAlignment - offset % kModelCacheAlignment) % kModelCacheAlignment;
+		if (count > (size - min(offset, size)) / sizeof(T))
+			throw runtime_error("truncated array");
+		values.resize(count);
+		if (count > 0)
+			memcpy(values.data(), take(count * sizeof(T)), count * sizeof(T));
+	}
+
+	string readString()
+	{
+		uint32_t length = read<uint32_t>();
+		const char* str = take(length);
+		return string(str, length);
+	}
+
+private:
+	const char* take(size_t bytes)
+	{
+		if (offset > size || bytes > size - offset)
+			throw runtime_error("unexpected end of file");
+		const char* ptr = data + offset;
+		offset += bytes;
+		return ptr;
+	}
+
+	const char* data;
+	size_t size;
+	size_t offset{0};
+};
+
+static void writeKey(CacheWriter& out, const ModelCacheKey& key)
+{
+	out.write(key.version);
+	out.write(key.model_size);
+	out.write(key.model_time);
+	out.write(key.bone_size);
+	out.write(key.bone_time);
+	out.writeString(key.bone);
+	out.write(key.lod_mesh);
+	out.write(key.lod_levels);
+	out.write(key.lod_ratio);
+}
+
+static ModelCacheKey readKey(CacheReader& in)
+{
+	ModelCacheKey key;
+	key.version = in.read<uint32_t>();
+	if (key.version != kModelCacheVersion)
+		return key;
+	key.model_size = in.read<uint64_t>();
+	key.model_time = in.read<uint64_t>();
+	key.bone_size = in.read<uint64_t>();
+	key.bone_time = in.read<uint64_t>();
+	key.bone = in.readString();
+	key.lod_mesh = in.read<int32_t>();
+	key.lod_levels = in.read<int32_t>();
+	key.lod_ratio = in.read<float>();
+	return key;
+}
+
+static void writeMesh(CacheWriter& out, const Mesh& mesh)
+{
+	out.writeString(mesh.name);
+	out.write(int32_t(mesh.lod_source));
+	out.write(int32_t(mesh.lod_level));
+	out.writeArray(mesh.vertices);
+	out.writeArray(mesh.indices);
+
+	const SkinData& skin = mesh.skin;
+	out.write(int32_t(skin.num_vertices));
+	out.writeArray(skin.pos_x);
+	out.writeArray(skin.pos_y);
+	out.writeArray(skin.pos_z);
+	out.writeArray(skin.nrm_x);
+	out.writeArray(skin.nrm_y);
+	out.writeArray(skin.nrm_z);
+	out.writeArray(skin.bone_index);
+	out.writeArray(skin.bone_weight);
+	out.writeArray(skin.bone_vertex_offset);
+	out.writeArray(skin.bone_vertices);
+
+	out.write(uint32_t(mesh.bones.size()));
+	for (const auto& bone : mesh.bones)
+	{
+		out.write(bone.offset.toMatrix4());
+		out.write(bone.start);
+		out.write(bone.end);
+	}
+
+	out.write(uint32_t(mesh.bone_map.size()));
+	for (const auto& entry : mesh.bone_map)
+	{
+		out.writeString(entry.first);
+		out.write(int32_t(entry.second));
+	}
+}
+
+static void readMesh(CacheReader& in, Mesh& mesh)
+{
+	mesh.data = nullptr;
+	mesh.name = in.readString();
+	mesh.lod_source = in.read<int32_t>();
+	mesh.lod_level = in.read<int32_t>();
+	in.readArray(mesh.vertices);
+	in.readArray(mesh.indices);
+
+	SkinData& skin = mesh.skin;
+	skin.num_vertices = in.read<int32_t>();
+	in.readArray(skin.pos_x);
+	in.readArray(skin.pos_y);
+	in.readArray(skin.pos_z);
+	in.readArray(skin.nrm_x);
+	in.readArray(skin.nrm_y);
+	in.readArray(skin.nrm_z);
+	in.readArray(skin.bone_index);
+	in.readArray(skin.bone_weight);
+	in.readArray(skin.bone_vertex_offset);
+	in.readArray(skin.bone_vertices);
+
+	uint32_t num_bones = in.read<uint32_t>();
+	mesh.bones.assign(num_bones, Bone());
+	for (auto& bone : mesh.bones)
+	{
+		bone.offset = Affine3x4(in.read<aiMatrix4x4t<float>>());
+		bone.start = in.read<aiVector3D>();
+		bone.end = in.read<aiVector3D>();
+	}
+
+	uint32_t num_names = in.read<uint32_t>();
+	mesh.bone_map.clear();
+	for (int i = 0; i < num_names; ++i)
+	{
+		string name = in.readString();
+		int index = in.read<int32_t>();
+		if (index < 0 || index >= num_bones)
+			throw runtime_error("bad bone index");
+		mesh.bone_map[name] = index;
+	}
+
+	// Everything the skinning kernels index has to be consistent
+	size_t n = skin.num_vertices;
+	if (mesh.vertices.size() != n || skin.pos_x.size() != n || skin.pos_y.size() != n || skin.pos_z.size() != n
+		|| skin.nrm_x.size() != n || skin.nrm_y.size() != n || skin.nrm_z.size() != n
+		|| skin.bone_index.size() != n * kMaxInfluences || skin.bone_weight.size() != n * kMaxInfluences
+		|| skin.bone_vertex_offset.size() != max(1u, num_bones) + 1)
+		throw runtime_error("inconsistent mesh " + mesh.name);
+	for (unsigned int index : mesh.indices)
+		if (index >= n)
+			throw runtime_error("bad vertex index in mesh " + mesh.name);
+	for (int index : skin.bone_index)
+		if (index < 0 || index >= max(1u, num_bones))
+			throw runtime_error("bad bone influence in mesh " + mesh.name);
+	if (skin.bone_vertex_offset.front() != 0 || skin.bone_vertex_offset.back() != skin.bone_vertices.size()
+		|| !is_sorted(skin.bone_vertex_offset.begin(), skin.bone_vertex_offset.end()))
+		throw runtime_error("bad bone vertex offsets in mesh " + mesh.name);
+	for (int index : skin.bone_vertices)
+		if (index < 0 || index >= n)
+			throw runtime_error("bad bone vertex in mesh " + mesh.name);
+
+	// Derived from what was read, not worth storing
+	skin.buildBoneBounds();
+}
+
+// The node hierarchy is stored as the flattened joints, parents first
+static void writeNodes(CacheWriter& out, const vector<Joint>& joints)
+{
+	out.write(uint32_t(joints.size()));
+	for (const auto& joint : joints)
+	{
+		out.writeString(joint.node->mName.data);
+		out.write(int32_t(joint.parent));
+		out.write(joint.transformation.toMatrix4());
+	}
+}
+
+static aiNode* readNodes(CacheReader& in)
+{
+	uint32_t count = in.read<uint32_t>();
+	if (count == 0)
+		throw runtime_error("missing root node");
+
+	vector<aiNode*> nodes;
+	vector<int> parents;
+	try
+	{
+		for (int i = 0; i < count; ++i)
+		{
+			nodes.push_back(new aiNode(in.readString()));
+			int parent = in.read<int32_t>();
+			nodes.back()->mTransformation = in.read<aiMatrix4x4t<float>>();
+			if ((i == 0) != (parent < 0) || parent >= i)
+				throw runtime_error("bad node hierarchy");
+			parents.push_back(parent);
+		}
+	}
+	catch (...)
+	{
+		for (auto* node : nodes)
+			delete node;
+		throw;
+	}
+
+	for (int i = 1; i < count; ++i)
+		++nodes[parents[i]]->mNumChildren;
+	for (auto* node : nodes)
+	{
+		if (node->mNumChildren > 0)
+			node->mChildren = new aiNode*[node->mNumChildren];
+		node->mNumChildren = 0;
+	}
+	for (int i = 1; i < count; ++i)
+	{
+		aiNode* parent = nodes[parents[i]];
+		nodes[i]->mParent = parent;
+		parent->mChildren[parent->mNumChildren++] = nodes[i];
+	}
+	return nodes[0];
+}
+
+bool readModelCache(ModelHelper& helper, const string& filename, const ModelCacheKey& key)
+{
+	ifstream fs(filename, ios::binary | ios::ate);
+	if (!fs.is_open())
+		return false;
+
+	// One read for the whole file, the arrays are copied out of it
+	vector<char> contents(size_t(fs.tellg()));
+	fs.seekg(0);
+	if (!fs.read(contents.data(), contents.size()))
+		return false;
+
+	try
+	{
+		CacheReader in(contents.data(), contents.size());
+		char magic[sizeof(kModelCacheMagic)];
+		for (auto& c : magic)
+			c = in.read<char>();
+		if (memcmp(magic, kModelCacheMagic, sizeof(magic)) != 0 || readKey(in) != key)
+			return false;
+
+		unique_ptr<aiScene> scene(new aiScene);
+		scene->mRootNode = readNodes(in);
+
+		// The meshes of the helper are only replaced once the whole file checked out
+		uint32_t num_meshes = in.read<uint32_t>();
+		vector<Mesh> meshes(num_meshes);
+		for (auto& mesh : meshes)
+		{
+			readMesh(in, mesh);
+			if (mesh.lod_source >= int(num_meshes))
+				throw runtime_error("bad level of detail in mesh " + mesh.name);
+		}
+
+		helper.meshes.swap(meshes);
+		helper.importer.FreeScene();
+		helper.cached_scene = move(scene);
+		helper.scene = helper.cached_scene.get();
+	}
+	catch (const exception& e)
+	{
+		cerr << "ignoring model cache " << filename << ": " << e.what() << endl;
+		return false;
+	}
+	return true;
+}
+
+bool writeModelCache(const ModelHelper& helper, const string& filename, const ModelCacheKey& key)
+{
+	// Write to a temporary file first, so that a crash never leaves half a cache behind
+	string temp = filename + ".tmp";
+	{
+		ofstream fs(temp, ios::binary | ios::trunc);
+		if (!fs.is_open())
+		{
+			cerr << "failed to write model cache " << filename << endl;
+			return false;
+		}
+
+		CacheWriter out(fs);
+		for (char c : kModelCacheMagic)
+			out.write(c);
+		writeKey(out, key);
+		writeNodes(out, helper.joints);
+		out.write(uint32_t(helper.meshes.size()));
+		for (const auto& mesh : helper.meshes)
+			writeMesh(out, mesh);
+
+		if (!fs)
+		{
+			cerr << "failed to write model cache " << filename << endl;
+			return false;
+		}
+	}
+
+	remove(filename.c_str());
+	if (rename(temp.c_str(), filename.c_str()) != 0)
+	{
+		cerr << "failed to write model cache " << filename << endl;
+		remove(temp.c_str());
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+#include "ModelHelper.h"
+
+// Binary cache of the preprocessed model, so that assimp only has to import
+// the model when it or the bone info changed.
+// Every array is stored as a count followed by its raw elements, aligned to
+// kModelCacheAlignment bytes from the start of the file, so the whole file
+// can be read (or mapped) at once and the arrays copied out directly.
+
+constexpr uint32_t kModelCacheVersion = 2;
+constexpr int kModelCacheAlignment = 16;
+
+// Identifies the sources and settings a cache was built from
+class ModelCacheKey
+{
+public:
+	static ModelCacheKey of(const std::string& model, const std::string& bone, const LodSettings& lod);
+
+	bool operator==(const ModelCacheKey& other) const;
+	bool operator!=(const ModelCacheKey& other) const { return !(*this == other); }
+
+	uint32_t version{kModelCacheVersion};
+	uint64_t model_size{0}, model_time{0};
+	uint64_t bone_size{0}, bone_time{0};
+	std::string bone;
+	int32_t lod_mesh{-1}, lod_levels{0};
+	float lod_ratio{0.f};
+};
+
+std::string modelCacheFilename(const std::string& model);
+
+// Fill the meshes, bone endpoints and node hierarchy of helper from the cache,
+// returns false if there is no usable cache for key
+bool readModelCache(ModelHelper& helper, const std::string& filename, const ModelCacheKey& key);
+
+// Returns false if the cache could not be written, which is not fatal
+bool writeModelCache(const ModelHelper& helper, const std::string& filename, const ModelCacheKey& key);
@@ -0,0 +1,802 @@
+#include "ModelHelper.h"
+
+#include <cmath>
+
+#include "modelerview.h"
+#include "modelerapp.h"
+#include "modelerdraw.h"
+#include <FL/gl.h>
+#include <gl/GLU.h>
+
+#include "modelerglobals.h"
+
+// The parts of the model that read the UI controls or talk to OpenGL,
+// everything else is in ModelHelper.cpp
+
+using namespace std;
+
+extern ModelHelper helper;
+
+void Mesh::bindTexture()
+{
+	if (tex == nullptr)
+	{
+		glDisable(GL_TEXTURE_2D);
+		return;
+	}
+
+	glEnable(GL_TEXTURE_2D);
+	if (!tex_loaded)
+	{
+		unsigned int texture_id;
+		glGenTextures(1, &texture_id);
+		glBindTexture(GL_TEXTURE_2D, texture_id);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, tex_width, tex_height,
+		0, GL_RGB, GL_UNSIGNED_BYTE, tex);
+
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		tex_loaded = true;
+		tex_id = texture_id;
+	}
+	else
+		glBindTexture(GL_TEXTURE_2D, tex_id);
+}
+
+// Apply all the user controls to meshes in one place
+void applyMeshControls()
+{
+	auto& mesh = helper.meshes[helper.active_index];
+	const BoneHandle* bones = mesh.controlBones();
+
+	// The bones still hold the values of the controls, leave them clean
+	unsigned generation = ControlSnapshot::Instance()->generation();
+	if (mesh.control_generation == generation)
+		return;
+	mesh.control_generation = generation;
+
+	mesh.restoreIdentity(bones[BONE_MAIN]);
+	mesh.applyRotationX(bones[BONE_MAIN], VAL(ROTATE_ALL));
+
+	float x = VAL(XPOS), y = VAL(YPOS), z = VAL(ZPOS);
+
+	mesh.applyTranslate(bones[BONE_MAIN], aiVector3D(x, y, z));
+
+	//===========================================================
+		mesh.restoreIdentity(bones[BONE_NECK]);
+
+
+		mesh.applyRotationZ(bones[BONE_NECK], VAL(NECK_PITCH));
+		mesh.applyRotationX(bones[BONE_NECK], VAL(NECK_YAW));
+		mesh.applyRotationY(bones[BONE_NECK], VAL(NECK_ROLL));
+
+		mesh.restoreIdentity(bones[BONE_HEAD]);
+		mesh.applyRotationZ(bones[BONE_HEAD], VAL(HEAD_PITCH));
+		mesh.applyRotationX(bones[BONE_HEAD], VAL(HEAD_YAW));
+		mesh.applyRotationY(bones[BONE_HEAD], VAL(HEAD_ROLL));
+
+		//============================================================
+
+		mesh.restoreIdentity(bones[BONE_FORE_LIMP_LEFT_1]);
+		mesh.applyRotationZ(bones[BONE_FORE_LIMP_LEFT_1], VAL(LEFT_FORELIMP_1));
+		mesh.applyRotationX(bones[BONE_FORE_LIMP_LEFT_1], VAL(LEFT_FORELIMP_1_YAW));
+
+		mesh.restoreIdentity(bones[BONE_FORE_LIMP_RIGHT_1]);
+		mesh.applyRotationZ(bones[BONE_FORE_LIMP_RIGHT_1], VAL(RIGHT_FORELIMP_1));
+		mesh.applyRotationX(bones[BONE_FORE_LIMP_RIGHT_1], VAL(RIGHT_FORELIMP_1_YAW));
+
+		mesh.restoreIdentity(bones[BONE_REAR_LIMP_LEFT_1]);
+		mesh.applyRotationZ(bones[BONE_REAR_LIMP_LEFT_1], VAL(LEFT_REARLIMP_1));
+		mesh.applyRotationX(bones[BONE_REAR_LIMP_LEFT_1], VAL(LEFT_REARLIMP_1_YAW));
+
+		mesh.restoreIdentity(bones[BONE_REAR_LIMP_RIGHT_1]);
+		mesh.applyRotationZ(bones[BONE_REAR_LIMP_RIGHT_1], VAL(RIGHT_REARLIMP_1));
+		mesh.applyRotationX(bones[BONE_REAR_LIMP_RIGHT_1], VAL(RIGHT_REARLIMP_1_YAW));
+
+		//============================================================
+
+		mesh.restoreIdentity(bones[BONE_FORE_LIMP_LEFT_2]);
+		mesh.applyRotationZ(bones[BONE_FORE_LIMP_LEFT_2], VAL(LEFT_FORELIMP_2));
+
+		mesh.restoreIdentity(bones[BONE_FORE_LIMP_RIGHT_2]);
+		mesh.applyRotationZ(bones[BONE_FORE_LIMP_RIGHT_2], VAL(RIGHT_FORELIMP_2));
+
+		mesh.restoreIdentity(bones[BONE_REAR_LIMP_LEFT_2]);
+		mesh.applyRotationZ(bones[BONE_REAR_LIMP_LEFT_2], VAL(LEFT_REARLIMP_2));
+
+		mesh.restoreIdentity(bones[BONE_REAR_LIMP_RIGHT_2]);
+		mesh.applyRotationZ(bones[BONE_REAR_LIMP_RIGHT_2], VAL(RIGHT_REARLIMP_2));
+
+		//=============================================================
+
+		mesh.applyRotationX(bones[BONE_FORE_LIMP_LEFT_2], VAL(LEFT_FORELIMP_2_YAW));
+
+		mesh.applyRotationX(bones[BONE_FORE_LIMP_RIGHT_2], VAL(RIGHT_FORELIMP_2_YAW));
+
+		mesh.applyRotationX(bones[BONE_REAR_LIMP_LEFT_2], VAL(LEFT_REARLIMP_2_YAW));
+
+		mesh.applyRotationX(bones[BONE_REAR_LIMP_RIGHT_2], VAL(RIGHT_REARLIMP_2_YAW));
+
+		//=============================================================
+
+		mesh.restoreIdentity(bones[BONE_FORE_LIMP_LEFT_3]);
+		mesh.applyRotationZ(bones[BONE_FORE_LIMP_LEFT_3], VAL(LEFT_FORELIMP_3));
+		mesh.applyRotationX(bones[BONE_FORE_LIMP_LEFT_3], VAL(LEFT_FORELIMP_3_YAW));
+
+		mesh.restoreIdentity(bones[BONE_FORE_LIMP_RIGHT_3]);
+		mesh.applyRotationZ(bones[BONE_FORE_LIMP_RIGHT_3], VAL(RIGHT_FORELIMP_3));
+		mesh.applyRotationX(bones[BONE_FORE_LIMP_RIGHT_3], VAL(RIGHT_FORELIMP_3_YAW));
+
+		mesh.restoreIdentity(bones[BONE_REAR_LIMP_LEFT_3]);
+		mesh.applyRotationZ(bones[BONE_REAR_LIMP_LEFT_3], VAL(LEFT_REARLIMP_3));
+		mesh.applyRotationX(bones[BONE_REAR_LIMP_LEFT_3], VAL(LEFT_REARLIMP_3_YAW));
+
+		mesh.restoreIdentity(bones[BONE_REAR_LIMP_RIGHT_3]);
+		mesh.applyRotationZ(bones[BONE_REAR_LIMP_RIGHT_3], VAL(RIGHT_REARLIMP_3));
+		mesh.applyRotationX(bones[BONE_REAR_LIMP_RIGHT_3], VAL(RIGHT_REARLIMP_3_YAW));
+
+		//==============================================================
+
+		mesh.restoreIdentity(bones[BONE_TAIL]);
+		mesh.applyRotationZ(bones[BONE_TAIL], VAL(TAIL_PITCH));
+		mesh.applyRotationX(bones[BONE_TAIL], VAL(TAIL_YAW));
+
+
+	// For basic requirements: one slider control multiple bones
+	float angle = VAL(LIMP_FOLDING);
+	mesh.applyRotationZ(bones[BONE_FORE_LIMP_LEFT_2], -angle);
+	mesh.applyRotationZ(bones[BONE_FORE_LIMP_LEFT_3], angle * 3);
+	
+	mesh.applyRotationZ(bones[BONE_FORE_LIMP_RIGHT_2], -angle);
+	mesh.applyRotationZ(bones[BONE_FORE_LIMP_RIGHT_3], angle * 3);
+	
+	mesh.applyRotationZ(bones[BONE_REAR_LIMP_LEFT_2], -angle);
+	mesh.applyRotationZ(bones[BONE_REAR_LIMP_LEFT_3], angle * 3);
+
+	mesh.applyRotationZ(bones[BONE_REAR_LIMP_RIGHT_2], -angle);
+	mesh.applyRotationZ(bones[BONE_REAR_LIMP_RIGHT_3], angle * 3);
+}
+
+
+void applyPeaceMood() {
+	auto& mesh = helper.meshes[helper.active_index];
+	const BoneHandle* bones = mesh.controlBones();
+
+	mesh.restoreIdentity(bones[BONE_MAIN]);
+	mesh.applyRotationX(bones[BONE_MAIN], VAL(ROTATE_ALL));
+
+	float x = VAL(XPOS), y = VAL(YPOS), z = VAL(ZPOS);
+
+	mesh.applyTranslate(bones[BONE_MAIN], aiVector3D(x, y, z));
+
+	//===========================================================
+	mesh.restoreIdentity(bones[BONE_NECK]);
+
+
+	mesh.applyRotationZ(bones[BONE_NECK],5);
+	mesh.applyRotationX(bones[BONE_NECK], 30);
+	mesh.applyRotationY(bones[BONE_NECK], 50);
+	mesh.applyRotationZ(bones[BONE_NECK], VAL(NECK_PITCH) / 3);
+	mesh.applyRotationX(bones[BONE_NECK], VAL(NECK_YAW) / 3);
+	mesh.applyRotationY(bones[BONE_NECK], VAL(NECK_ROLL) / 3);
+
+
+	mesh.restoreIdentity(bones[BONE_HEAD]);
+	mesh.applyRotationZ(bones[BONE_HEAD], 25);
+	mesh.applyRotationX(bones[BONE_HEAD], 27);
+	mesh.applyRotationY(bones[BONE_HEAD], -19);
+	mesh.applyRotationZ(bones[BONE_HEAD], VAL(HEAD_PITCH) / 3);
+	mesh.applyRotationX(bones[BONE_HEAD], VAL(HEAD_YAW) / 3);
+	mesh.applyRotationY(bones[BONE_HEAD], VAL(HEAD_ROLL) / 3);
+
+	//============================================================
+
+	mesh.restoreIdentity(bones[BONE_FORE_LIMP_LEFT_1]);
+	mesh.applyRotationZ(bones[BONE_FORE_LIMP_LEFT_1],40);
+	mesh.applyRotationX(bones[BONE_FORE_LIMP_LEFT_1],8);
+
+	mesh.restoreIdentity(bones[BONE_FORE_LIMP_RIGHT_1]);
+	mesh.applyRotationZ(bones[BONE_FORE_LIMP_RIGHT_1], 40);
+	mesh.applyRotationX(bones[BONE_FORE_LIMP_RIGHT_1], -8);
+
+	mesh.restoreIdentity(bones[BONE_REAR_LIMP_LEFT_1]);
+	mesh.applyRotationZ(bones[BONE_REAR_LIMP_LEFT_1], -60);
+	mesh.applyRotationX(bones[BONE_REAR_LIMP_LEFT_1], 17);
+
+	mesh.restoreIdentity(bones[BONE_REAR_LIMP_RIGHT_1]);
+	mesh.applyRotationZ(bones[BONE_REAR_LIMP_RIGHT_1],-60);
+	mesh.applyRotationX(bones[BONE_REAR_LIMP_RIGHT_1], -17);
+
+	//============================================================
+
+	mesh.restoreIdentity(bones[BONE_FORE_LIMP_LEFT_2]);
+	mesh.applyRotationZ(bones[BONE_FORE_LIMP_LEFT_2], -119);
+
+	mesh.restoreIdentity(bones[BONE_FORE_LIMP_RIGHT_2]);
+	mesh.applyRotationZ(bones[BONE_FORE_LIMP_RIGHT_2], -119);
+
+	mesh.restoreIdentity(bones[BONE_REAR_LIMP_LEFT_2]);
+	mesh.applyRotationZ(bones[BONE_REAR_LIMP_LEFT_2], 93);
+
+	mesh.restoreIdentity(bones[BONE_REAR_LIMP_RIGHT_2]);
+	mesh.applyRotationZ(bones[BONE_REAR_LIMP_RIGHT_2], 93);
+
+	//=============================================================
+
+	mesh.applyRotationX(bones[BONE_FORE_LIMP_LEFT_2], 0);
+
+	mesh.applyRotationX(bones[BONE_FORE_LIMP_RIGHT_2], 0);
+
+	mesh.applyRotationX(bones[BONE_REAR_LIMP_LEFT_2],-13);
+
+	mesh.applyRotationX(bones[BONE_REAR_LIMP_RIGHT_2],-13);
+
+	//=============================================================
+
+	mesh.restoreIdentity(bones[BONE_FORE_LIMP_LEFT_3]);
+	mesh.applyRotationZ(bones[BONE_FORE_LIMP_LEFT_3],180);
+	mesh.applyRotationX(bones[BONE_FORE_LIMP_LEFT_3], -15);
+
+	mesh.restoreIdentity(bones[BONE_FORE_LIMP_RIGHT_3]);
+	mesh.applyRotationZ(bones[BONE_FORE_LIMP_RIGHT_3],180);
+	mesh.applyRotationX(bones[BONE_FORE_LIMP_RIGHT_3],15);
+
+	mesh.restoreIdentity(bones[BONE_REAR_LIMP_LEFT_3]);
+	mesh.applyRotationZ(bones[BONE_REAR_LIMP_LEFT_3], -127);
+	mesh.applyRotationX(bones[BONE_REAR_LIMP_LEFT_3], -44);
+
+	mesh.restoreIdentity(bones[BONE_REAR_LIMP_RIGHT_3]);
+	mesh.applyRotationZ(bones[BONE_REAR_LIMP_RIGHT_3],-127);
+	mesh.applyRotationX(bones[BONE_REAR_LIMP_RIGHT_3], 44);
+
+	//==============================================================
+
+	mesh.restoreIdentity(bones[BONE_TAIL]);
+	mesh.applyRotationZ(bones[BONE_TAIL],-45);
+	mesh.applyRotationX(bones[BONE_TAIL], 30);
+	mesh.applyRotationZ(bones[BONE_TAIL], VAL(TAIL_PITCH) / 3);
+	mesh.applyRotationX(bones[BONE_TAIL], VAL(TAIL_YAW) / 3);
+}
+
+
+void applyWatchMood() {
+	auto& mesh = helper.meshes[helper.active_index];
+	const BoneHandle* bones = mesh.controlBones();
+
+	mesh.restoreIdentity(bones[BONE_MAIN]);
+	mesh.applyRotationX(bones[BONE_MAIN], VAL(ROTATE_ALL));
+
+	float x = VAL(XPOS), y = VAL(YPOS), z = VAL(ZPOS);
+
+	mesh.applyTranslate(bones[BONE_MAIN], aiVector3D(x, y, z));
+
+	//===========================================================
+	mesh.restoreIdentity(bones[BONE_NECK]);
+
+
+	mesh.applyRotationZ(bones[BONE_NECK], -27);
+	mesh.applyRotationX(bones[BONE_NECK], 0);
+	mesh.applyRotationY(bones[BONE_NECK], 0);
+	mesh.applyRotationZ(bones[BONE_NECK], max(VAL(NECK_PITCH), 0));
+	mesh.applyRotationX(bones[BONE_NECK], VAL(NECK_YAW));
+	mesh.applyRotationY(bones[BONE_NECK], VAL(NECK_ROLL));
+
+	mesh.restoreIdentity(bones[BONE_HEAD]);
+	mesh.applyRotationZ(bones[BONE_HEAD], -25);
+	mesh.applyRotationX(bones[BONE_HEAD], 0);
+	mesh.applyRotationY(bones[BONE_HEAD],0);
+	mesh.applyRotationZ(bones[BONE_HEAD], min(0, -VAL(NECK_PITCH)));
+	mesh.applyRotationX(bones[BONE_HEAD], -VAL(NECK_YAW));
+	mesh.applyRotationY(bones[BONE_HEAD], VAL(HEAD_ROLL) / 3);
+
+	//============================================================
+
+	mesh.restoreIdentity(bones[BONE_FORE_LIMP_LEFT_1]);
+	mesh.applyRotationZ(bones[BONE_FORE_LIMP_LEFT_1], -17);
+	mesh.applyRotationX(bones[BONE_FORE_LIMP_LEFT_1],0);
+	mesh.applyRotationZ(bones[BONE_FORE_LIMP_LEFT_1], VAL(LEFT_FORELIMP_1));
+	mesh.applyRotationX(bones[BONE_FORE_LIMP_LEFT_1], VAL(LEFT_FORELIMP_1_YAW));
+
+	mesh.restoreIdentity(bones[BONE_FORE_LIMP_RIGHT_1]);
+	mesh.applyRotationZ(bones[BONE_FORE_LIMP_RIGHT_1],5);
+	mesh.applyRotationX(bones[BONE_FORE_LIMP_RIGHT_1], 0);
+	mesh.applyRotationZ(bones[BONE_FORE_LIMP_RIGHT_1], VAL(RIGHT_FORELIMP_1));
+	mesh.applyRotationX(bones[BONE_FORE_LIMP_RIGHT_1], VAL(RIGHT_FORELIMP_1_YAW));
+
+	mesh.restoreIdentity(bones[BONE_REAR_LIMP_LEFT_1]);
+	mesh.applyRotationZ(bones[BONE_REAR_LIMP_LEFT_1], -14);
+	mesh.applyRotationX(bones[BONE_REAR_LIMP_LEFT_1], 0);
+	mesh.applyRotationZ(bones[BONE_REAR_LIMP_LEFT_1], VAL(LEFT_REARLIMP_1));
+	mesh.applyRotationX(bones[BONE_REAR_LIMP_LEFT_1], VAL(LEFT_REARLIMP_1_YAW));
+
+
+	mesh.restoreIdentity(bones[BONE_REAR_LIMP_RIGHT_1]);
+	mesh.applyRotationZ(bones[BONE_REAR_LIMP_RIGHT_1], 8);
+	mesh.applyRotationX(bones[BONE_REAR_LIMP_RIGHT_1], 0);
+	mesh.applyRotationZ(bones[BONE_REAR_LIMP_RIGHT_1], VAL(RIGHT_REARLIMP_1));
+	mesh.applyRotationX(bones[BONE_REAR_LIMP_RIGHT_1], VAL(RIGHT_REARLIMP_1_YAW));
+
+	//============================================================
+
+	mesh.restoreIdentity(bones[BONE_FORE_LIMP_LEFT_2]);
+	mesh.applyRotationZ(bones[BONE_FORE_LIMP_LEFT_2], -5);
+	mesh.applyRotationZ(bones[BONE_FORE_LIMP_LEFT_2], VAL(LEFT_FORELIMP_2));
+
+	mesh.restoreIdentity(bones[BONE_FORE_LIMP_RIGHT_2]);
+	mesh.applyRotationZ(bones[BONE_FORE_LIMP_RIGHT_2], 0);
+	mesh.applyRotationZ(bones[BONE_FORE_LIMP_RIGHT_2], VAL(RIGHT_FORELIMP_2));
+
+	mesh.restoreIdentity(bones[BONE_REAR_LIMP_LEFT_2]);
+	mesh.applyRotationZ(bones[BONE_REAR_LIMP_LEFT_2],9);
+	mesh.applyRotationZ(bones[BONE_REAR_LIMP_LEFT_2], VAL(LEFT_REARLIMP_2));
+
+	mesh.restoreIdentity(bones[BONE_REAR_LIMP_RIGHT_2]);
+	mesh.applyRotationZ(bones[BONE_REAR_LIMP_RIGHT_2], 0);
+	mesh.applyRotationZ(bones[BONE_REAR_LIMP_RIGHT_2], VAL(RIGHT_REARLIMP_2));
+
+	//=============================================================
+
+	mesh.applyRotationX(bones[BONE_FORE_LIMP_LEFT_2], 0);
+
+	mesh.applyRotationX(bones[BONE_FORE_LIMP_RIGHT_2], 0);
+
+	mesh.applyRotationX(bones[BONE_REAR_LIMP_LEFT_2], 0);
+
+	mesh.applyRotationX(bones[BONE_REAR_LIMP_RIGHT_2],0);
+
+	mesh.applyRotationX(bones[BONE_FORE_LIMP_LEFT_2], VAL(LEFT_FORELIMP_2_YAW));
+
+	mesh.applyRotationX(bones[BONE_FORE_LIMP_RIGHT_2], VAL(RIGHT_FORELIMP_2_YAW));
+
+	mesh.applyRotationX(bones[BONE_REAR_LIMP_LEFT_2], VAL(LEFT_REARLIMP_2_YAW));
+
+	mesh.applyRotationX(bones[BONE_REAR_LIMP_RIGHT_2], VAL(RIGHT_REARLIMP_2_YAW));
+
+	//=============================================================
+
+	mesh.restoreIdentity(bones[BONE_FORE_LIMP_LEFT_3]);
+	mesh.applyRotationZ(bones[BONE_FORE_LIMP_LEFT_3], 27);
+	mesh.applyRotationX(bones[BONE_FORE_LIMP_LEFT_3],0);
+	mesh.applyRotationZ(bones[BONE_FORE_LIMP_LEFT_3], VAL(LEFT_FORELIMP_3));
+	mesh.applyRotationX(bones[BONE_FORE_LIMP_LEFT_3], VAL(LEFT_FORELIMP_3_YAW));
+
+	mesh.restoreIdentity(bones[BONE_FORE_LIMP_RIGHT_3]);
+	mesh.applyRotationZ(bones[BONE_FORE_LIMP_RIGHT_3], 0);
+	mesh.applyRotationX(bones[BONE_FORE_LIMP_RIGHT_3], 0);
+	mesh.applyRotationZ(bones[BONE_FORE_LIMP_RIGHT_3], VAL(RIGHT_FORELIMP_3));
+	mesh.applyRotationX(bones[BONE_FORE_LIMP_RIGHT_3], VAL(RIGHT_FORELIMP_3_YAW));
+
+	mesh.restoreIdentity(bones[BONE_REAR_LIMP_LEFT_3]);
+	mesh.applyRotationZ(bones[BONE_REAR_LIMP_LEFT_3],-9);
+	mesh.applyRotationX(bones[BONE_REAR_LIMP_LEFT_3], 0);
+	mesh.applyRotationZ(bones[BONE_REAR_LIMP_LEFT_3], VAL(LEFT_REARLIMP_3));
+	mesh.applyRotationX(bones[BONE_REAR_LIMP_LEFT_3], VAL(LEFT_REARLIMP_3_YAW));
+
+	mesh.restoreIdentity(bones[BONE_REAR_LIMP_RIGHT_3]);
+	mesh.applyRotationZ(bones[BONE_REAR_LIMP_RIGHT_3], 0);
+	mesh.applyRotationX(bones[BONE_REAR_LIMP_RIGHT_3],0);
+	mesh.applyRotationZ(bones[BONE_REAR_LIMP_RIGHT_3], VAL(RIGHT_REARLIMP_3));
+	mesh.applyRotationX(bones[BONE_REAR_LIMP_RIGHT_3], VAL(RIGHT_REARLIMP_3_YAW));
+
+	//==============================================================
+
+	mesh.restoreIdentity(bones[BONE_TAIL]);
+	mesh.applyRotationZ(bones[BONE_TAIL], 8);
+	mesh.applyRotationX(bones[BONE_TAIL], 0);
+	mesh.applyRotationZ(bones[BONE_TAIL], VAL(TAIL_PITCH));
+	mesh.applyRotationX(bones[BONE_TAIL], VAL(TAIL_YAW));
+}
+
+
+void applyPreJumpMood() {
+	auto& mesh = helper.meshes[helper.active_index];
+	const BoneHandle* bones = mesh.controlBones();
+
+	mesh.restoreIdentity(bones[BONE_MAIN]);
+	mesh.applyRotationX(bones[BONE_MAIN], VAL(ROTATE_ALL));
+	mesh.applyRotationZ(bones[BONE_MAIN], -17);
+
+	float x = VAL(XPOS), y = VAL(YPOS), z = VAL(ZPOS);
+
+	mesh.applyTranslate(bones[BONE_MAIN], aiVector3D(x, y, z));
+
+	//===========================================================
+	mesh.restoreIdentity(bones[BONE_NECK]);
+
+
+	mesh.applyRotationZ(bones[BONE_NECK], -18);
+	mesh.applyRotationX(bones[BONE_NECK], 0);
+	mesh.applyRotationY(bones[BONE_NECK], 0);
+	mesh.applyRotationZ(bones[BONE_NECK], max(VAL(NECK_PITCH), 0));
+	mesh.applyRotationX(bones[BONE_NECK], VAL(NECK_YAW));
+	mesh.applyRotationY(bones[BONE_NECK], VAL(NECK_ROLL));
+
+	mesh.restoreIdentity(bones[BONE_HEAD]);
+	mesh.applyRotationZ(bones[BONE_HEAD], -12);
+	mesh.applyRotationX(bones[BONE_HEAD], 0);
+	mesh.applyRotationY(bones[BONE_HEAD], 0);
+	mesh.applyRotationZ(bones[BONE_HEAD], min(0, -VAL(NECK_PITCH)));
+	mesh.applyRotationX(bones[BONE_NECK], -VAL(NECK_YAW));
+	mesh.applyRotationY(bones[BONE_HEAD], VAL(HEAD_ROLL) / 2);
+
+	//============================================================
+
+	mesh.restoreIdentity(bones[BONE_FORE_LIMP_LEFT_1]);
+	mesh.applyRotationZ(bones[BONE_FORE_LIMP_LEFT_1], -8);
+	mesh.applyRotationX(bones[BONE_FORE_LIMP_LEFT_1], 17);
+	mesh.applyRotationZ(bones[BONE_FORE_LIMP_LEFT_1], -abs(VAL(LEFT_FORELIMP_1)));
+	mesh.applyRotationX(bones[BONE_FORE_LIMP_LEFT_1], VAL(LEFT_FORELIMP_1_YAW));
+
+	mesh.restoreIdentity(bones[BONE_FORE_LIMP_RIGHT_1]);
+	mesh.applyRotationZ(bones[BONE_FORE_LIMP_RIGHT_1], -4);
+	mesh.applyRotationX(bones[BONE_FORE_LIMP_RIGHT_1], -10);
+	mesh.applyRotationZ(bones[BONE_FORE_LIMP_RIGHT_1], -abs(VAL(RIGHT_FORELIMP_1)));
+	mesh.applyRotationX(bones[BONE_FORE_LIMP_RIGHT_1], VAL(RIGHT_FORELIMP_1_YAW));
+
+	mesh.restoreIdentity(bones[BONE_REAR_LIMP_LEFT_1]);
+	mesh.applyRotationZ(bones[BONE_REAR_LIMP_LEFT_1], -14);
+	mesh.applyRotationX(bones[BONE_REAR_LIMP_LEFT_1], 10);
+	mesh.applyRotationZ(bones[BONE_REAR_LIMP_LEFT_1], -abs(VAL(LEFT_REARLIMP_1)));
+	mesh.applyRotationX(bones[BONE_REAR_LIMP_LEFT_1], VAL(LEFT_REARLIMP_1_YAW));
+
+	mesh.restoreIdentity(bones[BONE_REAR_LIMP_RIGHT_1]);
+	mesh.applyRotationZ(bones[BONE_REAR_LIMP_RIGHT_1], -5);
+	mesh.applyRotationX(bones[BONE_REAR_LIMP_RIGHT_1], -16);
+	mesh.applyRotationZ(bones[BONE_REAR_LIMP_RIGHT_1], -abs(VAL(RIGHT_REARLIMP_1)));
+	mesh.applyRotationX(bones[BONE_REAR_LIMP_RIGHT_1], VAL(RIGHT_REARLIMP_1_YAW));
+
+	//============================================================
+
+	mesh.restoreIdentity(bones[BONE_FORE_LIMP_LEFT_2]);
+	mesh.applyRotationZ(bones[BONE_FORE_LIMP_LEFT_2], 13);
+	mesh.applyRotationZ(bones[BONE_FORE_LIMP_LEFT_2], -abs(VAL(LEFT_FORELIMP_2)));
+
+	mesh.restoreIdentity(bones[BONE_FORE_LIMP_RIGHT_2]);
+	mesh.applyRotationZ(bones[BONE_FORE_LIMP_RIGHT_2], 9);
+	mesh.applyRotationZ(bones[BONE_FORE_LIMP_RIGHT_2], -abs(VAL(RIGHT_FORELIMP_2)));
+
+	mesh.restoreIdentity(bones[BONE_REAR_LIMP_LEFT_2]);
+	mesh.applyRotationZ(bones[BONE_REAR_LIMP_LEFT_2], 27);
+	mesh.applyRotationZ(bones[BONE_REAR_LIMP_LEFT_2], abs(VAL(LEFT_REARLIMP_2)));
+
+	mesh.restoreIdentity(bones[BONE_REAR_LIMP_RIGHT_2]);
+	mesh.applyRotationZ(bones[BONE_REAR_LIMP_RIGHT_2], 25);
+	mesh.applyRotationZ(bones[BONE_REAR_LIMP_RIGHT_2], abs(VAL(RIGHT_REARLIMP_2)));
+
+	//=============================================================
+
+	mesh.applyRotationX(bones[BONE_FORE_LIMP_LEFT_2], -8);
+	mesh.applyRotationX(bones[BONE_FORE_LIMP_LEFT_2], VAL(LEFT_FORELIMP_2_YAW));
+
+	mesh.applyRotationX(bones[BONE_FORE_LIMP_RIGHT_2], 6);
+	mesh.applyRotationX(bones[BONE_FORE_LIMP_RIGHT_2], VAL(RIGHT_FORELIMP_2_YAW));
+
+	mesh.applyRotationX(bones[BONE_REAR_LIMP_LEFT_2], 0);
+	mesh.applyRotationX(bones[BONE_REAR_LIMP_LEFT_2], VAL(LEFT_REARLIMP_2_YAW));
+
+	mesh.applyRotationX(bones[BONE_REAR_LIMP_RIGHT_2], 0);
+	mesh.applyRotationX(bones[BONE_REAR_LIMP_RIGHT_2], VAL(RIGHT_REARLIMP_2_YAW));
+
+	//=============================================================
+
+	mesh.restoreIdentity(bones[BONE_FORE_LIMP_LEFT_3]);
+	mesh.applyRotationZ(bones[BONE_FORE_LIMP_LEFT_3], 25);
+	mesh.applyRotationX(bones[BONE_FORE_LIMP_LEFT_3], -8);
+	mesh.applyRotationZ(bones[BONE_FORE_LIMP_LEFT_3], abs(VAL(LEFT_FORELIMP_3)));
+	mesh.applyRotationX(bones[BONE_FORE_LIMP_LEFT_3], VAL(LEFT_FORELIMP_3_YAW));
+
+	mesh.restoreIdentity(bones[BONE_FORE_LIMP_RIGHT_3]);
+	mesh.applyRotationZ(bones[BONE_FORE_LIMP_RIGHT_3], 25);
+	mesh.applyRotationX(bones[BONE_FORE_LIMP_RIGHT_3], 6);
+	mesh.applyRotationZ(bones[BONE_FORE_LIMP_RIGHT_3], abs(VAL(RIGHT_FORELIMP_3)));
+	mesh.applyRotationX(bones[BONE_FORE_LIMP_RIGHT_3], VAL(RIGHT_FORELIMP_3_YAW));
+
+	mesh.restoreIdentity(bones[BONE_REAR_LIMP_LEFT_3]);
+	mesh.applyRotationZ(bones[BONE_REAR_LIMP_LEFT_3], -34);
+	mesh.applyRotationX(bones[BONE_REAR_LIMP_LEFT_3], -6);
+	mesh.applyRotationZ(bones[BONE_REAR_LIMP_LEFT_3], -abs(VAL(LEFT_REARLIMP_3)));
+	mesh.applyRotationX(bones[BONE_REAR_LIMP_LEFT_3], VAL(LEFT_REARLIMP_3_YAW));
+
+	mesh.restoreIdentity(bones[BONE_REAR_LIMP_RIGHT_3]);
+	mesh.applyRotationZ(bones[BONE_REAR_LIMP_RIGHT_3], -25);
+	mesh.applyRotationX(bones[BONE_REAR_LIMP_RIGHT_3], 9);
+	mesh.applyRotationZ(bones[BONE_REAR_LIMP_RIGHT_3], -abs(VAL(RIGHT_REARLIMP_3)));
+	mesh.applyRotationX(bones[BONE_REAR_LIMP_RIGHT_3], VAL(RIGHT_REARLIMP_3_YAW));
+
+	//==============================================================
+
+	mesh.restoreIdentity(bones[BONE_TAIL]);
+	mesh.applyRotationZ(bones[BONE_TAIL], -14);
+	mesh.applyRotationX(bones[BONE_TAIL], 0);
+	mesh.applyRotationZ(bones[BONE_TAIL], VAL(TAIL_PITCH) * 2);
+	mesh.applyRotationX(bones[BONE_TAIL], VAL(TAIL_YAW) * 2);
+}
+
+
+void applyJumpMood() {
+	auto& mesh = helper.meshes[helper.active_index];
+	const BoneHandle* bones = mesh.controlBones();
+
+	mesh.restoreIdentity(bones[BONE_MAIN]);
+	mesh.applyRotationX(bones[BONE_MAIN], VAL(ROTATE_ALL));
+	mesh.applyRotationZ(bones[BONE_MAIN], -25);
+
+	float x = VAL(XPOS), y = VAL(YPOS), z = VAL(ZPOS);
+
+	mesh.applyTranslate(bones[BONE_MAIN], aiVector3D(x, y, z));
+
+	//===========================================================
+	mesh.restoreIdentity(bones[BONE_NECK]);
+
+
+	mesh.applyRotationZ(bones[BONE_NECK], -9);
+	mesh.applyRotationX(bones[BONE_NECK], 0);
+	mesh.applyRotationY(bones[BONE_NECK], 0);
+	mesh.applyRotationZ(bones[BONE_NECK], VAL(NECK_PITCH));
+	mesh.applyRotationX(bones[BONE_NECK], VAL(NECK_YAW));
+	mesh.applyRotationY(bones[BONE_NECK], VAL(NECK_ROLL));
+
+	mesh.restoreIdentity(bones[BONE_HEAD]);
+	mesh.applyRotationZ(bones[BONE_HEAD], 4);
+	mesh.applyRotationX(bones[BONE_HEAD], 24);
+	mesh.applyRotationY(bones[BONE_HEAD], -30);
+	mesh.applyRotationZ(bones[BONE_HEAD], VAL(HEAD_PITCH));
+	mesh.applyRotationX(bones[BONE_HEAD], VAL(HEAD_YAW));
+	mesh.applyRotationY(bones[BONE_HEAD], VAL(HEAD_ROLL));
+
+	//============================================================
+
+	mesh.restoreIdentity(bones[BONE_FORE_LIMP_LEFT_1]);
+	mesh.applyRotationZ(bones[BONE_FORE_LIMP_LEFT_1], -48);
+	mesh.applyRotationX(bones[BONE_FORE_LIMP_LEFT_1], 11);
+
+	mesh.restoreIdentity(bones[BONE_FORE_LIMP_RIGHT_1]);
+	mesh.applyRotationZ(bones[BONE_FORE_LIMP_RIGHT_1], -51);
+	mesh.applyRotationX(bones[BONE_FORE_LIMP_RIGHT_1], -17);
+
+	mesh.restoreIdentity(bones[BONE_REAR_LIMP_LEFT_1]);
+	mesh.applyRotationZ(bones[BONE_REAR_LIMP_LEFT_1], 44);
+	mesh.applyRotationX(bones[BONE_REAR_LIMP_LEFT_1], 23);
+
+	mesh.restoreIdentity(bones[BONE_REAR_LIMP_RIGHT_1]);
+	mesh.applyRotationZ(bones[BONE_REAR_LIMP_RIGHT_1], 41);
+	mesh.applyRotationX(bones[BONE_REAR_LIMP_RIGHT_1], -15);
+
+	//============================================================
+
+	mesh.restoreIdentity(bones[BONE_FORE_LIMP_LEFT_2]);
+	mesh.applyRotationZ(bones[BONE_FORE_LIMP_LEFT_2], -13);
+
+	mesh.restoreIdentity(bones[BONE_FORE_LIMP_RIGHT_2]);
+	mesh.applyRotationZ(bones[BONE_FORE_LIMP_RIGHT_2], -19);
+
+	mesh.restoreIdentity(bones[BONE_REAR_LIMP_LEFT_2]);
+	mesh.applyRotationZ(bones[BONE_REAR_LIMP_LEFT_2], 17);
+
+	mesh.restoreIdentity(bones[BONE_REAR_LIMP_RIGHT_2]);
+	mesh.applyRotationZ(bones[BONE_REAR_LIMP_RIGHT_2], 7);
+
+	//=============================================================
+
+	mesh.applyRotationX(bones[BONE_FORE_LIMP_LEFT_2], 1);
+
+	mesh.applyRotationX(bones[BONE_FORE_LIMP_RIGHT_2], 6);
+
+	mesh.applyRotationX(bones[BONE_REAR_LIMP_LEFT_2], 0);
+
+	mesh.applyRotationX(bones[BONE_REAR_LIMP_RIGHT_2], 0);
+
+	//=============================================================
+
+	mesh.restoreIdentity(bones[BONE_FORE_LIMP_LEFT_3]);
+	mesh.applyRotationZ(bones[BONE_FORE_LIMP_LEFT_3], 135);
+	mesh.applyRotationX(bones[BONE_FORE_LIMP_LEFT_3], 40);
+
+	mesh.restoreIdentity(bones[BONE_FORE_LIMP_RIGHT_3]);
+	mesh.applyRotationZ(bones[BONE_FORE_LIMP_RIGHT_3], 145);
+	mesh.applyRotationX(bones[BONE_FORE_LIMP_RIGHT_3], -31);
+
+	mesh.restoreIdentity(bones[BONE_REAR_LIMP_LEFT_3]);
+	mesh.applyRotationZ(bones[BONE_REAR_LIMP_LEFT_3], 15);
+	mesh.applyRotationX(bones[BONE_REAR_LIMP_LEFT_3], 0);
+
+	mesh.restoreIdentity(bones[BONE_REAR_LIMP_RIGHT_3]);
+	mesh.applyRotationZ(bones[BONE_REAR_LIMP_RIGHT_3], 21);
+	mesh.applyRotationX(bones[BONE_REAR_LIMP_RIGHT_3], 0);
+
+	//==============================================================
+
+	mesh.restoreIdentity(bones[BONE_TAIL]);
+	mesh.applyRotationZ(bones[BONE_TAIL], 14);
+	mesh.applyRotationX(bones[BONE_TAIL], 0);
+	mesh.applyRotationX(bones[BONE_TAIL], VAL(TAIL_YAW) * 2);
+}
+
+
+void applyJumpDoneMood() {
+	auto& mesh = helper.meshes[helper.active_index];
+	const BoneHandle* bones = mesh.controlBones();
+
+	mesh.restoreIdentity(bones[BONE_MAIN]);
+	mesh.applyRotationZ(bones[BONE_MAIN], 32);
+	mesh.applyRotationX(bones[BONE_MAIN], VAL(ROTATE_ALL));
+
+	float x = VAL(XPOS), y = VAL(YPOS), z = VAL(ZPOS);
+
+	mesh.applyTranslate(bones[BONE_MAIN], aiVector3D(x, y, z));
+
+	//===========================================================
+	mesh.restoreIdentity(bones[BONE_NECK]);
+
+
+	mesh.applyRotationZ(bones[BONE_NECK], -38);
+	mesh.applyRotationX(bones[BONE_NECK], 41);
+	mesh.applyRotationY(bones[BONE_NECK], 44);
+	mesh.applyRotationZ(bones[BONE_NECK], VAL(NECK_PITCH));
+	mesh.applyRotationX(bones[BONE_NECK], VAL(NECK_YAW));
+	mesh.applyRotationY(bones[BONE_NECK], VAL(NECK_ROLL));
+
+	mesh.restoreIdentity(bones[BONE_HEAD]);
+	mesh.applyRotationZ(bones[BONE_HEAD], 45);
+	mesh.applyRotationX(bones[BONE_HEAD], 30);
+	mesh.applyRotationY(bones[BONE_HEAD], 19);
+	mesh.applyRotationZ(bones[BONE_HEAD], VAL(HEAD_PITCH));
+	mesh.applyRotationX(bones[BONE_HEAD], VAL(HEAD_YAW));
+	mesh.applyRotationY(bones[BONE_HEAD], VAL(HEAD_ROLL));
+
+	//============================================================
+
+	mesh.restoreIdentity(bones[BONE_FORE_LIMP_LEFT_1]);
+	mesh.applyRotationZ(bones[BONE_FORE_LIMP_LEFT_1], -60);
+	mesh.applyRotationX(bones[BONE_FORE_LIMP_LEFT_1], 18);
+	mesh.applyRotationZ(bones[BONE_FORE_LIMP_LEFT_1], abs(VAL(LEFT_FORELIMP_1)));
+	mesh.applyRotationX(bones[BONE_FORE_LIMP_LEFT_1], VAL(LEFT_FORELIMP_1_YAW));
+
+	mesh.restoreIdentity(bones[BONE_FORE_LIMP_RIGHT_1]);
+	mesh.applyRotationZ(bones[BONE_FORE_LIMP_RIGHT_1], -60);
+	mesh.applyRotationX(bones[BONE_FORE_LIMP_RIGHT_1], -15);
+	mesh.applyRotationZ(bones[BONE_FORE_LIMP_RIGHT_1], abs(VAL(RIGHT_FORELIMP_1)));
+	mesh.applyRotationX(bones[BONE_FORE_LIMP_RIGHT_1], VAL(RIGHT_FORELIMP_1_YAW));
+
+	mesh.restoreIdentity(bones[BONE_REAR_LIMP_LEFT_1]);
+	mesh.applyRotationZ(bones[BONE_REAR_LIMP_LEFT_1], -18);
+	mesh.applyRotationX(bones[BONE_REAR_LIMP_LEFT_1], 0);
+	mesh.applyRotationZ(bones[BONE_REAR_LIMP_LEFT_1], abs(VAL(LEFT_REARLIMP_1)));
+	mesh.applyRotationX(bones[BONE_REAR_LIMP_LEFT_1], VAL(LEFT_REARLIMP_1_YAW));
+
+
+	mesh.restoreIdentity(bones[BONE_REAR_LIMP_RIGHT_1]);
+	mesh.applyRotationZ(bones[BONE_REAR_LIMP_RIGHT_1], -13);
+	mesh.applyRotationX(bones[BONE_REAR_LIMP_RIGHT_1], 0);
+	mesh.applyRotationZ(bones[BONE_REAR_LIMP_RIGHT_1], abs(VAL(RIGHT_REARLIMP_1)));
+	mesh.applyRotationX(bones[BONE_REAR_LIMP_RIGHT_1], VAL(RIGHT_REARLIMP_1_YAW));
+
+	//============================================================
+
+	mesh.restoreIdentity(bones[BONE_FORE_LIMP_LEFT_2]);
+	mesh.applyRotationZ(bones[BONE_FORE_LIMP_LEFT_2], 7);
+	mesh.applyRotationZ(bones[BONE_FORE_LIMP_LEFT_2], abs(VAL(LEFT_FORELIMP_2)));
+
+	mesh.restoreIdentity(bones[BONE_FORE_LIMP_RIGHT_2]);
+	mesh.applyRotationZ(bones[BONE_FORE_LIMP_RIGHT_2], -32);
+	mesh.applyRotationZ(bones[BONE_FORE_LIMP_RIGHT_2], abs(VAL(RIGHT_FORELIMP_2)));
+
+	mesh.restoreIdentity(bones[BONE_REAR_LIMP_LEFT_2]);
+	mesh.applyRotationZ(bones[BONE_REAR_LIMP_LEFT_2], 50);
+	mesh.applyRotationZ(bones[BONE_REAR_LIMP_LEFT_2], -abs(VAL(LEFT_REARLIMP_2)));
+
+	mesh.restoreIdentity(bones[BONE_REAR_LIMP_RIGHT_2]);
+	mesh.applyRotationZ(bones[BONE_REAR_LIMP_RIGHT_2], 50);
+	mesh.applyRotationZ(bones[BONE_REAR_LIMP_RIGHT_2], -abs(VAL(RIGHT_REARLIMP_2)));
+
+	//=============================================================
+
+	mesh.applyRotationX(bones[BONE_FORE_LIMP_LEFT_2], -4);
+	mesh.applyRotationX(bones[BONE_FORE_LIMP_LEFT_2], VAL(LEFT_FORELIMP_2_YAW));
+
+	mesh.applyRotationX(bones[BONE_FORE_LIMP_RIGHT_2], -21);
+	mesh.applyRotationX(bones[BONE_FORE_LIMP_RIGHT_2], VAL(RIGHT_FORELIMP_2_YAW));
+
+	mesh.applyRotationX(bones[BONE_REAR_LIMP_LEFT_2], 0);
+	mesh.applyRotationX(bones[BONE_REAR_LIMP_LEFT_2], VAL(LEFT_REARLIMP_2_YAW));
+
+	mesh.applyRotationX(bones[BONE_REAR_LIMP_RIGHT_2], 0);
+	mesh.applyRotationX(bones[BONE_REAR_LIMP_RIGHT_2], VAL(RIGHT_REARLIMP_2_YAW));
+
+	//=============================================================
+
+	mesh.restoreIdentity(bones[BONE_FORE_LIMP_LEFT_3]);
+	mesh.applyRotationZ(bones[BONE_FORE_LIMP_LEFT_3], 5);
+	mesh.applyRotationX(bones[BONE_FORE_LIMP_LEFT_3], -18);
+	mesh.applyRotationZ(bones[BONE_FORE_LIMP_LEFT_3], -abs(VAL(LEFT_FORELIMP_3)));
+	mesh.applyRotationX(bones[BONE_FORE_LIMP_LEFT_3], VAL(LEFT_FORELIMP_3_YAW));
+
+	mesh.restoreIdentity(bones[BONE_FORE_LIMP_RIGHT_3]);
+	mesh.applyRotationZ(bones[BONE_FORE_LIMP_RIGHT_3], 109);
+	mesh.applyRotationX(bones[BONE_FORE_LIMP_RIGHT_3], -90);
+	mesh.applyRotationZ(bones[BONE_FORE_LIMP_RIGHT_3], -abs(VAL(RIGHT_FORELIMP_3)));
+	mesh.applyRotationX(bones[BONE_FORE_LIMP_RIGHT_3], VAL(RIGHT_FORELIMP_3_YAW));
+
+	mesh.restoreIdentity(bones[BONE_REAR_LIMP_LEFT_3]);
+	mesh.applyRotationZ(bones[BONE_REAR_LIMP_LEFT_3], -54);
+	mesh.applyRotationX(bones[BONE_REAR_LIMP_LEFT_3], 0);
+	mesh.applyRotationZ(bones[BONE_REAR_LIMP_LEFT_3], abs(VAL(LEFT_REARLIMP_3)));
+	mesh.applyRotationX(bones[BONE_REAR_LIMP_LEFT_3], VAL(LEFT_REARLIMP_3_YAW));
+
+	mesh.restoreIdentity(bones[BONE_REAR_LIMP_RIGHT_3]);
+	mesh.applyRotationZ(bones[BONE_REAR_LIMP_RIGHT_3], -78);
+	mesh.applyRotationX(bones[BONE_REAR_LIMP_RIGHT_3], 0);
+	mesh.applyRotationZ(bones[BONE_REAR_LIMP_RIGHT_3], abs(VAL(RIGHT_REARLIMP_3)));
+	mesh.applyRotationX(bones[BONE_REAR_LIMP_RIGHT_3], VAL(RIGHT_REARLIMP_3_YAW));
+
+	//==============================================================
+
+	mesh.restoreIdentity(bones[BONE_TAIL]);
+	mesh.applyRotationZ(bones[BONE_TAIL], 23);
+	mesh.applyRotationX(bones[BONE_TAIL], 0);
+	mesh.applyRotationZ(bones[BONE_TAIL], VAL(TAIL_PITCH));
+	mesh.applyRotationX(bones[BONE_TAIL], VAL(TAIL_YAW));
+}
+
+
+void nurbsDemo()
+{
+	glPushMatrix();
+	glDisable(GL_TEXTURE_2D);
+
+	GLfloat ambient[] = {0.4, 0.6, 0.2, 1.0};
+	GLfloat position[] = {5.0, 5.0, 5.0, 1.0};
+
+	//glEnable(GL_LIGHTING);
+	//glEnable(GL_LIGHT0);
+	//glLightfv(GL_LIGHT0, GL_AMBIENT, ambient);
+	//glLightfv(GL_LIGHT0, GL_POSITION, position);
+
+	GLfloat mat_ambient[] = {0.247250, 0.199500, 0.074500, 1.000000};
+	GLfloat mat_diffuse[] = {0.751640, 0.606480, 0.226480, 1.000000};
+	GLfloat mat_specular[] = {0.628281, 0.555802, 0.366065, 1.000000};
+	GLfloat mat_shininess[] = {51.200001};
+
+	glMaterialfv(GL_FRONT, GL_AMBIENT, mat_ambient);
+	glMaterialfv(GL_FRONT, GL_DIFFUSE, mat_diffuse);
+	glMaterialfv(GL_FRONT, GL_SPECULAR, mat_specular);
+	glMaterialfv(GL_FRONT, GL_SHININESS, mat_shininess);
+
+	glScaled(0.5, 0.5, 0.5);
+	glRotated(135, 1, 0, 0);
+	glTranslated(-10, -10, 5);
+	
+	constexpr int n = 20;
+	float control_points[n * n * 3];
+	float t = 0;
+	aiVector3D aabb_min(1e10f, 1e10f, 1e10f), aabb_max(-1e10f, -1e10f, -1e10f);
+
+	for (int i = 0; i < n; ++i)
+		for (int j = 0; j < n; ++j)
+		{
+			int index = (i + j * n) * 3;
+			control_points[index] = i;
+			control_points[index + 1] = j;
+			control_points[index + 2] = cos(i) * 2 + sin(j) * 2;
+			for (int k = 0; k < 3; ++k)
+			{
+				aabb_min[k] = min(aabb_min[k], control_points[index + k]);
+				aabb_max[k] = max(aabb_max[k], control_points[index + k]);
+			}
+		}
+
+	// The surface lies within the box of its control points
+	if (VAL(FRUSTUM_CULLING) && !currentFrustum().boxVisible(aabb_min, aabb_max))
+	{
+		glPopMatrix();
+		return;
+	}
+
+	glEnable(GL_AUTO_NORMAL);
+    glEnable(GL_NORMALIZE);
+	drawNurbs(control_points, n, n);
+
+	glDisable(GL_AUTO_NORMAL);
+    glDisable(GL_NORMALIZE);
+	glPopMatrix();
+}
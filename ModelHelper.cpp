@@ -3,49 +3,95 @@
 #include <iostream>
 #include <fstream>
 #include <cmath>
+#include <algorithm>
 #include "bitmap.h"
 
-#include "modelerview.h"
-#include "modelerapp.h"
-#include "modelerdraw.h"
-#include <FL/gl.h>
-#include <gl/GLU.h>
-
-#include "modelerglobals.h"
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
-#include "bitmap.h"
-#include "camera.h"
-#include "modelerui.h"
-#include "LSystem.h"
-#include "IKSolver.h"
+#include "Skinning.h"
+#include "ModelCache.h"
+#include "MeshSimplifier.h"
+
+// Nothing in this file may depend on the UI or OpenGL, so that the pose and
+// skinning pipeline can run headless, see bench/pipeline_bench.cpp.
+// Those parts live in ModelControls.cpp.
 
 using namespace Assimp;
 using namespace std;
 
 extern ModelHelper helper;
 
-void ModelHelper::loadModel(const string& model, const string& bone)
+void ModelHelper::loadModel(const string& model, const string& bone, const LodSettings& lod)
 {
-	const auto* new_scene = importer.ReadFile(model, aiProcess_CalcTangentSpace | aiProcess_Triangulate |
-	                                    aiProcess_JoinIdenticalVertices | aiProcess_SortByPType);
-	if (new_scene == nullptr)
-		throw runtime_error("failed to parse model file");
-	
-	delete scene;
-	scene = new_scene;
-	preprocess();
-	if (!bone.empty())
+	// Skip the import and the simplification if nothing changed since the last run
+	string cache = modelCacheFilename(model);
+	ModelCacheKey key = ModelCacheKey::of(model, bone, lod);
+	bool cached = readModelCache(*this, cache, key);
+	if (cached)
+	{
+		cout << "Loaded model from cache " << cache << endl;
+	}
+	else
 	{
-		for (auto& mesh : meshes)
-			parseBoneInfo(mesh, bone);
+		const auto* new_scene = importer.ReadFile(model, aiProcess_CalcTangentSpace | aiProcess_Triangulate |
+		                                    aiProcess_JoinIdenticalVertices | aiProcess_SortByPType);
+		if (new_scene == nullptr)
+			throw runtime_error("failed to parse model file");
+
+		// The imported scene is owned by the importer
+		cached_scene.reset();
+		scene = new_scene;
+		preprocess();
+
+		if (!bone.empty())
+		{
+			for (auto& mesh : meshes)
+				parseBoneInfo(mesh, bone);
+		}
+		generateLods(lod);
 	}
+
+	joints.clear();
+	for (auto& mesh : meshes)
+	{
+		mesh.joint_bones.clear();
+		mesh.bone_joints.assign(mesh.bones.size(), -1);
+		mesh.control_bones.clear();
+		mesh.control_generation = 0;
+		mesh.pose_valid = false;
+	}
+	buildSkeleton(scene->mRootNode, -1);
+	aiMatrix4x4t<float> root_inverse = scene->mRootNode->mTransformation;
+	global_inverse = Affine3x4(root_inverse.Inverse());
 	calBoneTransformation(aiQuaternion(), scene->mRootNode);
+
+	if (!cached)
+		writeModelCache(*this, cache, key);
+
+	// Use the fastest skinning kernel as long as it matches the scalar reference
+	skinning_kernel = bestSkinningKernel();
+	for (auto& mesh : meshes)
+	{
+		if (verifySkinningKernel(skinning_kernel, mesh.skin, mesh.bones.size()))
+			continue;
+		skinning_kernel = SkinningKernel::SCALAR;
+		break;
+	}
+	cout << "Skinning kernel: " << skinningKernelName(skinning_kernel) << endl;
+
+	// Meshes can be switched to dual quaternion skinning, which has to agree with linear blend skinning on rigid poses
+	for (auto& mesh : meshes)
+	{
+		if (!verifyDualQuatSkinning(mesh.skin, mesh.bones.size()))
+			cout << "Dual quaternion skinning of " << mesh.name << " is unreliable" << endl;
+	}
 }
 
 void ModelHelper::preprocess()
 {
+	// Start from empty meshes, nothing of a previous model or a rejected cache is kept
+	meshes.clear();
 	meshes.resize(scene->mNumMeshes);
 	for (int i = 0; i < scene->mNumMeshes; ++i)
 	{
@@ -58,7 +104,7 @@ void ModelHelper::preprocess()
 
 		vertices.resize(mesh->mNumVertices);
 		for (int j = 0; j < mesh->mNumVertices; ++j)
-			vertices[j].original_pos = (mesh->mVertices[j]);
+			vertices[j].world_pos = (mesh->mVertices[j]);
 
 		if (mesh->HasTextureCoords(0))
 		{
@@ -66,19 +112,369 @@ void ModelHelper::preprocess()
 				vertices[j].tex_coords = (mesh->mTextureCoords[0][j]);
 		}
 
+		auto& indices = meshes[i].indices;
+		indices.clear();
+		for (int j = 0; j < mesh->mNumFaces; ++j)
+		{
+			const aiFace& face = mesh->mFaces[j];
+			if (face.mNumIndices != 3)
+				continue;
+			indices.insert(indices.end(), face.mIndices, face.mIndices + 3);
+		}
+
 		bones.resize(mesh->mNumBones);
 		for (int j = 0; j < mesh->mNumBones; ++j)
 		{
 			auto* bone = mesh->mBones[j];
 			bone_map[Mesh::processBoneName(string(bone->mName.data))] = j;
-			bones[j].offset = bone->mOffsetMatrix;
+			bones[j].offset = Affine3x4(bone->mOffsetMatrix);
+		}
+
+		auto& skin = meshes[i].skin;
+		skin.build(mesh);
+		for (int j = 0; j < mesh->mNumVertices; ++j)
+			vertices[j].normal = aiVector3D(skin.nrm_x[j], skin.nrm_y[j], skin.nrm_z[j]);
+	}
+}
+
+void ModelHelper::generateLods(const LodSettings& lod)
+{
+	if (lod.mesh < 0 || lod.mesh >= meshes.size())
+		return;
+
+	// Every level is simplified from the source itself, errors do not add up along the chain
+	int previous = meshes[lod.mesh].skin.num_vertices;
+	for (int level = 1; level <= lod.levels; ++level)
+	{
+		Mesh simplified;
+		int num_vertices = simplifyMesh(meshes[lod.mesh], int(previous * lod.ratio), simplified);
+		if (num_vertices == 0 || num_vertices >= previous)
+			break;
+
+		simplified.name = meshes[lod.mesh].name + "_lod" + to_string(level);
+		simplified.lod_source = lod.mesh;
+		simplified.lod_level = level;
+		cout << "Generated " << simplified.name << " with " << num_vertices << " vertices" << endl;
+		meshes.push_back(move(simplified));
+		previous = num_vertices;
+	}
+}
+
+vector<int> ModelHelper::lodLevels(int mesh) const
+{
+	vector<int> levels;
+	for (int i = 0; i < meshes.size(); ++i)
+		if (meshes[i].lod_source == mesh)
+			levels.push_back(i);
+	sort(levels.begin(), levels.end(), [this](int a, int b) { return meshes[a].lod_level < meshes[b].lod_level; });
+	return levels;
+}
+
+void SkinData::build(const aiMesh* mesh)
+{
+	num_vertices = mesh->mNumVertices;
+	pos_x.resize(num_vertices);
+	pos_y.resize(num_vertices);
+	pos_z.resize(num_vertices);
+	for (int i = 0; i < num_vertices; ++i)
+	{
+		pos_x[i] = mesh->mVertices[i].x;
+		pos_y[i] = mesh->mVertices[i].y;
+		pos_z[i] = mesh->mVertices[i].z;
+	}
+
+	vector<aiVector3D> normals(num_vertices);
+	if (mesh->HasNormals())
+	{
+		copy(mesh->mNormals, mesh->mNormals + num_vertices, normals.begin());
+	}
+	else
+	{
+		// Area weighted average of the adjacent faces
+		for (int j = 0; j < mesh->mNumFaces; ++j)
+		{
+			const aiFace& face = mesh->mFaces[j];
+			if (face.mNumIndices != 3)
+				continue;
+			const aiVector3D& v1 = mesh->mVertices[face.mIndices[0]];
+			const aiVector3D& v2 = mesh->mVertices[face.mIndices[1]];
+			const aiVector3D& v3 = mesh->mVertices[face.mIndices[2]];
+			aiVector3D normal = (v2 - v1) ^ (v3 - v1);
+			for (int k = 0; k < 3; ++k)
+				normals[face.mIndices[k]] += normal;
+		}
+	}
+
+	nrm_x.resize(num_vertices);
+	nrm_y.resize(num_vertices);
+	nrm_z.resize(num_vertices);
+	for (int i = 0; i < num_vertices; ++i)
+	{
+		normals[i].NormalizeSafe();
+		nrm_x[i] = normals[i].x;
+		nrm_y[i] = normals[i].y;
+		nrm_z[i] = normals[i].z;
+	}
+
+	bone_index.assign(num_vertices * kMaxInfluences, 0);
+	bone_weight.assign(num_vertices * kMaxInfluences, 0.f);
+	vector<int> count(num_vertices, 0);
+
+	for (int j = 0; j < mesh->mNumBones; ++j)
+	{
+		auto* bone = mesh->mBones[j];
+		for (int k = 0; k < bone->mNumWeights; ++k)
+		{
+			int vertex_id = bone->mWeights[k].mVertexId;
+			float weight = bone->mWeights[k].mWeight;
+			int* index = &bone_index[vertex_id * kMaxInfluences];
+			float* w = &bone_weight[vertex_id * kMaxInfluences];
+
+			if (count[vertex_id] < kMaxInfluences)
+			{
+				index[count[vertex_id]] = j;
+				w[count[vertex_id]++] = weight;
+				continue;
+			}
+
+			// All slots are taken, replace the smallest influence if this one is larger
+			int smallest = 0;
+			for (int s = 1; s < kMaxInfluences; ++s)
+				if (w[s] < w[smallest]) smallest = s;
+			if (weight > w[smallest])
+			{
+				index[smallest] = j;
+				w[smallest] = weight;
+			}
+		}
+	}
+
+	for (int i = 0; i < num_vertices; ++i)
+	{
+		float* w = &bone_weight[i * kMaxInfluences];
+		float sum = 0.f;
+		for (int s = 0; s < kMaxInfluences; ++s)
+			sum += w[s];
+
+		// Unweighted vertices simply follow the first bone
+		if (sum <= 0.f)
+		{
+			w[0] = 1.f;
+			continue;
+		}
+		for (int s = 0; s < kMaxInfluences; ++s)
+			w[s] /= sum;
+	}
+
+	buildBoneVertices(mesh->mNumBones);
+}
+
+void SkinData::buildBoneVertices(int num_bones)
+{
+	// Invert the packed influences into per bone vertex lists
+	num_bones = max(1, num_bones);
+	bone_vertex_offset.assign(num_bones + 1, 0);
+	for (int i = 0; i < num_vertices * kMaxInfluences; ++i)
+		if (bone_weight[i] != 0.f)
+			++bone_vertex_offset[bone_index[i] + 1];
+	for (int b = 0; b < num_bones; ++b)
+		bone_vertex_offset[b + 1] += bone_vertex_offset[b];
+
+	bone_vertices.resize(bone_vertex_offset[num_bones]);
+	vector<int> cursor(bone_vertex_offset.begin(), bone_vertex_offset.end() - 1);
+	for (int i = 0; i < num_vertices * kMaxInfluences; ++i)
+		if (bone_weight[i] != 0.f)
+			bone_vertices[cursor[bone_index[i]]++] = i / kMaxInfluences;
+
+	buildBoneBounds();
+}
+
+void SkinData::buildBoneBounds()
+{
+	int num_bones = bone_vertex_offset.size() - 1;
+	bone_aabb_min.assign(num_bones, aiVector3D(1e10f, 1e10f, 1e10f));
+	bone_aabb_max.assign(num_bones, aiVector3D(-1e10f, -1e10f, -1e10f));
+	for (int b = 0; b < num_bones; ++b)
+	{
+		aiVector3D& lo = bone_aabb_min[b];
+		aiVector3D& hi = bone_aabb_max[b];
+		for (int i = bone_vertex_offset[b]; i < bone_vertex_offset[b + 1]; ++i)
+		{
+			int v = bone_vertices[i];
+			lo.x = min(lo.x, pos_x[v]); hi.x = max(hi.x, pos_x[v]);
+			lo.y = min(lo.y, pos_y[v]); hi.y = max(hi.y, pos_y[v]);
+			lo.z = min(lo.z, pos_z[v]); hi.z = max(hi.z, pos_z[v]);
+		}
+	}
 
-			for (int k = 0; k < bone->mNumWeights; ++k)
+	influence_pairs.clear();
+	pair_aabb_min.clear();
+	pair_aabb_max.clear();
+	map<pair<int, int>, int> pair_slots;
+	for (int v = 0; v < num_vertices; ++v)
+	{
+		const int* index = &bone_index[v * kMaxInfluences];
+		const float* weight = &bone_weight[v * kMaxInfluences];
+		aiVector3D pos(pos_x[v], pos_y[v], pos_z[v]);
+		for (int k = 1; k < kMaxInfluences; ++k)
+		{
+			if (weight[k] == 0.f || index[k] == index[0])
+				continue;
+			auto found = pair_slots.insert(make_pair(make_pair(index[0], index[k]), int(influence_pairs.size())));
+			if (found.second)
 			{
-				int vertex_id = bone->mWeights[k].mVertexId;
-				vertices[vertex_id].bone_index.push_back(j);
-				vertices[vertex_id].bone_weight.push_back(bone->mWeights[k].mWeight);
+				influence_pairs.push_back(found.first->first);
+				pair_aabb_min.push_back(pos);
+				pair_aabb_max.push_back(pos);
 			}
+			aiVector3D& lo = pair_aabb_min[found.first->second];
+			aiVector3D& hi = pair_aabb_max[found.first->second];
+			lo.x = min(lo.x, pos.x); hi.x = max(hi.x, pos.x);
+			lo.y = min(lo.y, pos.y); hi.y = max(hi.y, pos.y);
+			lo.z = min(lo.z, pos.z); hi.z = max(hi.z, pos.z);
+		}
+	}
+}
+
+// Flatten the hierarchy in pre-order and resolve the bone of every joint,
+// so that evaluating a pose needs neither recursion nor string lookups
+void ModelHelper::buildSkeleton(const aiNode* cur, int parent)
+{
+	Joint joint;
+	joint.node = cur;
+	joint.name = Mesh::processBoneName(cur->mName.data);
+	joint.parent = parent;
+	joint.transformation = Affine3x4(cur->mTransformation);
+
+	for (auto& mesh : meshes)
+	{
+		auto it = mesh.bone_map.find(joint.name);
+		mesh.joint_bones.push_back(it == mesh.bone_map.end() ? -1 : it->second);
+		if (it != mesh.bone_map.end())
+			mesh.bone_joints[it->second] = joints.size();
+	}
+
+	int index = joints.size();
+	joints.push_back(joint);
+	for (int i = 0; i < cur->mNumChildren; ++i)
+		buildSkeleton(cur->mChildren[i], index);
+}
+
+// One linear pass over the joints, a parent is always evaluated before its children.
+// A joint is only recomputed when its local transformation or one of its ancestors changed.
+void ModelHelper::evaluateSkeleton(Mesh& mesh)
+{
+	if (mesh.parent != nullptr)
+	{
+		evaluateAttached(mesh, *mesh.parent);
+		return;
+	}
+
+	auto& globals = mesh.joint_transformations;
+	if (globals.size() != joints.size())
+	{
+		globals.resize(joints.size());
+		mesh.joint_locals.resize(joints.size());
+		mesh.joint_changed.resize(joints.size());
+		mesh.pose_valid = false;
+	}
+
+	for (int i = 0; i < joints.size(); ++i)
+	{
+		const Joint& joint = joints[i];
+		bool changed = !mesh.pose_valid || (joint.parent >= 0 && mesh.joint_changed[joint.parent]);
+
+		// In case some node doesn't represent a bone, joint_bones is -1
+		Bone* bone = nullptr;
+		const Affine3x4* local = nullptr;
+		bool touched = false;
+
+		int bone_index = mesh.joint_bones[i];
+		if (bone_index >= 0)
+		{
+			bone = &mesh.bones[bone_index];
+			local = &bone->local_transformation;
+			touched = bone->dirty;
+			bone->dirty = false;
+		}
+
+		// Controls are usually reset and applied again every frame, so compare with what we used last time
+		if (local != nullptr && (!mesh.pose_valid || (touched && !(*local == mesh.joint_locals[i]))))
+		{
+			mesh.joint_locals[i] = *local;
+			changed = true;
+		}
+
+		mesh.joint_changed[i] = changed;
+		if (!changed)
+			continue;
+
+		// joint.transformation transforms the node from its local space to its parent's space
+		if (joint.parent < 0)
+			globals[i] = joint.transformation;
+		else
+			globals[i] = globals[joint.parent] * joint.transformation;
+		if (local != nullptr)
+			globals[i] = globals[i] * (*local);
+
+		if (bone != nullptr)
+		{
+			// final_transformation is used to transform the vertices from local space to world space
+			// any other transformation should be right-multiplied to the global transformation
+			bone->final_transformation = global_inverse * globals[i] * bone->offset;
+			if (!bone->moved)
+			{
+				bone->moved = true;
+				mesh.moved_bones.push_back(bone_index);
+			}
+		}
+	}
+	mesh.pose_valid = true;
+}
+
+void ModelHelper::evaluateAttached(Mesh& mesh, const Mesh& skeleton)
+{
+	if (skeleton.joint_transformations.size() != joints.size())
+		return;
+
+	// The joint transformations of skeleton may have been updated by any number of
+	// frames since this mesh was drawn last, so compare instead of relying on joint_changed
+	for (int b = 0; b < mesh.bones.size(); ++b)
+	{
+		int joint = mesh.bone_joints[b];
+		if (joint < 0)
+			continue;
+
+		Bone& bone = mesh.bones[b];
+		Affine3x4 final_transformation = global_inverse * skeleton.joint_transformations[joint] * bone.offset;
+		if (mesh.pose_valid && final_transformation == bone.final_transformation)
+			continue;
+
+		bone.final_transformation = final_transformation;
+		if (!bone.moved)
+		{
+			bone.moved = true;
+			mesh.moved_bones.push_back(b);
+		}
+	}
+	mesh.pose_valid = true;
+}
+
+void ModelHelper::evaluatePose(const Mesh& mesh, const Affine3x4* bone_locals, Affine3x4* joint_globals, Affine3x4* bone_finals) const
+{
+	for (int i = 0; i < joints.size(); ++i)
+	{
+		const Joint& joint = joints[i];
+		if (joint.parent < 0)
+			joint_globals[i] = joint.transformation;
+		else
+			joint_globals[i] = joint_globals[joint.parent] * joint.transformation;
+
+		int bone_index = mesh.joint_bones[i];
+		if (bone_index >= 0)
+		{
+			joint_globals[i] = joint_globals[i] * bone_locals[bone_index];
+			bone_finals[bone_index] = global_inverse * joint_globals[i] * mesh.bones[bone_index].offset;
 		}
 	}
 }
@@ -149,40 +545,14 @@ void Mesh::loadTexture(const std::string& filename)
 	tex_loaded = false;		// not loaded or updated in openGL
 }
 
-void Mesh::bindTexture()
-{
-	if (tex == nullptr)
-	{
-		glDisable(GL_TEXTURE_2D);
-		return;
-	}
-
-	glEnable(GL_TEXTURE_2D);
-	if (!tex_loaded)
-	{
-		unsigned int texture_id;
-		glGenTextures(1, &texture_id);
-		glBindTexture(GL_TEXTURE_2D, texture_id);
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, tex_width, tex_height,
-		0, GL_RGB, GL_UNSIGNED_BYTE, tex);
-
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-		tex_loaded = true;
-		tex_id = texture_id;
-	}
-	else
-		glBindTexture(GL_TEXTURE_2D, tex_id);
-}
-
 void ModelHelper::printMeshInfo(bool showBoneHierarchy)
 {
 	for (int i = 0; i < meshes.size(); ++i)
 	{
 		std::cout << "mesh " << i << ": " << meshes[i].name << std::endl
-			<< "mNumVertices: " << scene->mMeshes[i]->mNumVertices << std::endl
-			<< "mNumFaces: " << scene->mMeshes[i]->mNumFaces << std::endl
-			<< "mNumBones: " << scene->mMeshes[i]->mNumBones << std::endl;
+			<< "mNumVertices: " << meshes[i].vertices.size() << std::endl
+			<< "mNumFaces: " << meshes[i].indices.size() / 3 << std::endl
+			<< "mNumBones: " << meshes[i].bones.size() << std::endl;
 	
 		if (showBoneHierarchy)
 		{
@@ -251,62 +621,144 @@ aiMatrix4x4t<float> ModelHelper::calViewingTransformation(Vec3f& eye, Vec3f& at,
 	return mat;
 }
 
-bool Mesh::applyTranslate(const std::string& bone_name, const aiVector3D& translation)
+BoneHandle Mesh::findBone(const std::string& bone_name) const
+{
+	auto it = bone_map.find(bone_name);
+	if (it == bone_map.end())
+		return BoneHandle();
+	return BoneHandle{it->second};
+}
+
+const BoneHandle* Mesh::controlBones()
+{
+	static const char* names[NUM_CONTROL_BONES] = {
+	"main", "neck", "head", "tail", "foreBody", "rear",
+	"foreLimpLeft1", "foreLimpLeft2", "foreLimpLeft3",
+	"foreLimpRight1", "foreLimpRight2", "foreLimpRight3",
+	"rearLimpLeft1", "rearLimpLeft2", "rearLimpLeft3",
+	"rearLimpRight1", "rearLimpRight2", "rearLimpRight3"
+	};
+
+	if (control_bones.empty())
+	{
+		for (const char* name : names)
+			control_bones.push_back(findBone(name));
+	}
+	return control_bones.data();
+}
+
+void Mesh::setSkinningMethod(SkinningMethod method)
+{
+	if (method == skinning_method)
+		return;
+
+	skinning_method = method;
+	for (int i = 0; i < bones.size(); ++i)
+	{
+		if (!bones[i].moved)
+		{
+			bones[i].moved = true;
+			moved_bones.push_back(i);
+		}
+	}
+}
+
+bool Mesh::applyTranslate(BoneHandle bone, const aiVector3D& translation)
 {
 	aiMatrix4x4t<float> mat;
 	aiMatrix4x4t<float>::Translation(translation, mat);
-	return applyMatrix(bone_name, mat);
+	return applyMatrix(bone, mat);
 }
 
-bool Mesh::applyRotationX(const std::string& bone_name, float angle)
+bool Mesh::applyRotationX(BoneHandle bone, float angle)
 {
 	angle = AI_MATH_PI_F * angle / 180.f;
 	aiMatrix4x4t<float> mat;
 	aiMatrix4x4t<float>::RotationX(angle, mat);
-	return applyMatrix(bone_name, mat);
+	return applyMatrix(bone, mat);
 }
 
-bool Mesh::applyRotationY(const std::string& bone_name, float angle)
+bool Mesh::applyRotationY(BoneHandle bone, float angle)
 {
 	angle = AI_MATH_PI_F * angle / 180.f;
 	aiMatrix4x4t<float> mat;
 	aiMatrix4x4t<float>::RotationY(angle, mat);
-	return applyMatrix(bone_name, mat);
+	return applyMatrix(bone, mat);
 }
 
-bool Mesh::applyRotationZ(const std::string& bone_name, float angle)
+bool Mesh::applyRotationZ(BoneHandle bone, float angle)
 {
 	angle = AI_MATH_PI_F * angle / 180.f;
 	aiMatrix4x4t<float> mat;
 	aiMatrix4x4t<float>::RotationZ(angle, mat);
-	return applyMatrix(bone_name, mat);
+	return applyMatrix(bone, mat);
 }
 
-bool Mesh::applyScaling(const std::string& bone_name, const aiVector3D& scale)
+bool Mesh::applyScaling(BoneHandle bone, const aiVector3D& scale)
 {
 	aiMatrix4x4t<float> mat;
 	aiMatrix4x4t<float>::Scaling(scale, mat);
-	return applyMatrix(bone_name, mat);
+	return applyMatrix(bone, mat);
 }
 
-bool Mesh::restoreIdentity(const std::string& bone_name)
+bool Mesh::restoreIdentity(BoneHandle bone)
 {
-	if (bone_map.find(bone_name) == bone_map.end())
+	if (!bone.valid())
 		return false;
-	int index = bone_map[bone_name];
-	bones[index].local_transformation = aiMatrix4x4t<float>();
+	bones[bone.index].local_transformation = Affine3x4();
+	bones[bone.index].dirty = true;
 	return true;
 }
 
-bool Mesh::applyMatrix(const std::string& bone_name, const aiMatrix4x4t<float>& mat)
+bool Mesh::applyMatrix(BoneHandle bone, const aiMatrix4x4t<float>& mat)
 {
-	if (bone_map.find(bone_name) == bone_map.end())
+	return applyMatrix(bone, Affine3x4(mat));
+}
+
+bool Mesh::applyMatrix(BoneHandle bone, const Affine3x4& mat)
+{
+	if (!bone.valid())
 		return false;
-	int index = bone_map[bone_name];
-	bones[index].local_transformation = mat * bones[index].local_transformation;
+	bones[bone.index].local_transformation = mat * bones[bone.index].local_transformation;
+	bones[bone.index].dirty = true;
 	return true;
 }
 
+bool Mesh::applyTranslate(const std::string& bone_name, const aiVector3D& translation)
+{
+	return applyTranslate(findBone(bone_name), translation);
+}
+
+bool Mesh::applyRotationX(const std::string& bone_name, float angle)
+{
+	return applyRotationX(findBone(bone_name), angle);
+}
+
+bool Mesh::applyRotationY(const std::string& bone_name, float angle)
+{
+	return applyRotationY(findBone(bone_name), angle);
+}
+
+bool Mesh::applyRotationZ(const std::string& bone_name, float angle)
+{
+	return applyRotationZ(findBone(bone_name), angle);
+}
+
+bool Mesh::applyScaling(const std::string& bone_name, const aiVector3D& scale)
+{
+	return applyScaling(findBone(bone_name), scale);
+}
+
+bool Mesh::restoreIdentity(const std::string& bone_name)
+{
+	return restoreIdentity(findBone(bone_name));
+}
+
+bool Mesh::applyMatrix(const std::string& bone_name, const aiMatrix4x4t<float>& mat)
+{
+	return applyMatrix(findBone(bone_name), mat);
+}
+
 void Mesh::printBoneHierarchy(const aiNode* cur, int depth)
 {
 	string name = processBoneName(cur->mName.data);
@@ -336,737 +788,63 @@ std::string Mesh::processBoneName(const std::string& name)
 	return name;
 }
 
+float tick = 0.f;
 
-// Apply all the user controls to meshes in one place
-void applyMeshControls()
+// Animation
+void walkCycle(float t, Affine3x4* pose)
 {
-	auto& mesh = helper.meshes[helper.active_index];
-
-	mesh.restoreIdentity("main");
-	mesh.applyRotationX("main", VAL(ROTATE_ALL));
-
-	float x = VAL(XPOS), y = VAL(YPOS), z = VAL(ZPOS);
-
-	mesh.applyTranslate("main", aiVector3D(x, y, z));
-
-	//===========================================================
-		mesh.restoreIdentity("neck");
-
-
-		mesh.applyRotationZ("neck", VAL(NECK_PITCH));
-		mesh.applyRotationX("neck", VAL(NECK_YAW));
-		mesh.applyRotationY("neck", VAL(NECK_ROLL));
-
-		mesh.restoreIdentity("head");
-		mesh.applyRotationZ("head", VAL(HEAD_PITCH));
-		mesh.applyRotationX("head", VAL(HEAD_YAW));
-		mesh.applyRotationY("head", VAL(HEAD_ROLL));
-
-		//============================================================
-
-		mesh.restoreIdentity("foreLimpLeft1");
-		mesh.applyRotationZ("foreLimpLeft1", VAL(LEFT_FORELIMP_1));
-		mesh.applyRotationX("foreLimpLeft1", VAL(LEFT_FORELIMP_1_YAW));
-
-		mesh.restoreIdentity("foreLimpRight1");
-		mesh.applyRotationZ("foreLimpRight1", VAL(RIGHT_FORELIMP_1));
-		mesh.applyRotationX("foreLimpRight1", VAL(RIGHT_FORELIMP_1_YAW));
-
-		mesh.restoreIdentity("rearLimpLeft1");
-		mesh.applyRotationZ("rearLimpLeft1", VAL(LEFT_REARLIMP_1));
-		mesh.applyRotationX("rearLimpLeft1", VAL(LEFT_REARLIMP_1_YAW));
-
-		mesh.restoreIdentity("rearLimpRight1");
-		mesh.applyRotationZ("rearLimpRight1", VAL(RIGHT_REARLIMP_1));
-		mesh.applyRotationX("rearLimpRight1", VAL(RIGHT_REARLIMP_1_YAW));
-
-		//============================================================
-
-		mesh.restoreIdentity("foreLimpLeft2");
-		mesh.applyRotationZ("foreLimpLeft2", VAL(LEFT_FORELIMP_2));
-
-		mesh.restoreIdentity("foreLimpRight2");
-		mesh.applyRotationZ("foreLimpRight2", VAL(RIGHT_FORELIMP_2));
-
-		mesh.restoreIdentity("rearLimpLeft2");
-		mesh.applyRotationZ("rearLimpLeft2", VAL(LEFT_REARLIMP_2));
-
-		mesh.restoreIdentity("rearLimpRight2");
-		mesh.applyRotationZ("rearLimpRight2", VAL(RIGHT_REARLIMP_2));
-
-		//=============================================================
-
-		mesh.applyRotationX("foreLimpLeft2", VAL(LEFT_FORELIMP_2_YAW));
-
-		mesh.applyRotationX("foreLimpRight2", VAL(RIGHT_FORELIMP_2_YAW));
-
-		mesh.applyRotationX("rearLimpLeft2", VAL(LEFT_REARLIMP_2_YAW));
-
-		mesh.applyRotationX("rearLimpRight2", VAL(RIGHT_REARLIMP_2_YAW));
-
-		//=============================================================
-
-		mesh.restoreIdentity("foreLimpLeft3");
-		mesh.applyRotationZ("foreLimpLeft3", VAL(LEFT_FORELIMP_3));
-		mesh.applyRotationX("foreLimpLeft3", VAL(LEFT_FORELIMP_3_YAW));
-
-		mesh.restoreIdentity("foreLimpRight3");
-		mesh.applyRotationZ("foreLimpRight3", VAL(RIGHT_FORELIMP_3));
-		mesh.applyRotationX("foreLimpRight3", VAL(RIGHT_FORELIMP_3_YAW));
-
-		mesh.restoreIdentity("rearLimpLeft3");
-		mesh.applyRotationZ("rearLimpLeft3", VAL(LEFT_REARLIMP_3));
-		mesh.applyRotationX("rearLimpLeft3", VAL(LEFT_REARLIMP_3_YAW));
-
-		mesh.restoreIdentity("rearLimpRight3");
-		mesh.applyRotationZ("rearLimpRight3", VAL(RIGHT_REARLIMP_3));
-		mesh.applyRotationX("rearLimpRight3", VAL(RIGHT_REARLIMP_3_YAW));
-
-		//==============================================================
-
-		mesh.restoreIdentity("tail");
-		mesh.applyRotationZ("tail", VAL(TAIL_PITCH));
-		mesh.applyRotationX("tail", VAL(TAIL_YAW));
-
-
-	// For basic requirements: one slider control multiple bones
-	float angle = VAL(LIMP_FOLDING);
-	mesh.applyRotationZ("foreLimpLeft2", -angle);
-	mesh.applyRotationZ("foreLimpLeft3", angle * 3);
-	
-	mesh.applyRotationZ("foreLimpRight2", -angle);
-	mesh.applyRotationZ("foreLimpRight3", angle * 3);
-	
-	mesh.applyRotationZ("rearLimpLeft2", -angle);
-	mesh.applyRotationZ("rearLimpLeft3", angle * 3);
-
-	mesh.applyRotationZ("rearLimpRight2", -angle);
-	mesh.applyRotationZ("rearLimpRight3", angle * 3);
-}
-
-
-void applyPeaceMood() {
-	auto& mesh = helper.meshes[helper.active_index];
-
-	mesh.restoreIdentity("main");
-	mesh.applyRotationX("main", VAL(ROTATE_ALL));
-
-	float x = VAL(XPOS), y = VAL(YPOS), z = VAL(ZPOS);
-
-	mesh.applyTranslate("main", aiVector3D(x, y, z));
-
-	//===========================================================
-	mesh.restoreIdentity("neck");
-
-
-	mesh.applyRotationZ("neck",5);
-	mesh.applyRotationX("neck", 30);
-	mesh.applyRotationY("neck", 50);
-	mesh.applyRotationZ("neck", VAL(NECK_PITCH) / 3);
-	mesh.applyRotationX("neck", VAL(NECK_YAW) / 3);
-	mesh.applyRotationY("neck", VAL(NECK_ROLL) / 3);
-
-
-	mesh.restoreIdentity("head");
-	mesh.applyRotationZ("head", 25);
-	mesh.applyRotationX("head", 27);
-	mesh.applyRotationY("head", -19);
-	mesh.applyRotationZ("head", VAL(HEAD_PITCH) / 3);
-	mesh.applyRotationX("head", VAL(HEAD_YAW) / 3);
-	mesh.applyRotationY("head", VAL(HEAD_ROLL) / 3);
-
-	//============================================================
-
-	mesh.restoreIdentity("foreLimpLeft1");
-	mesh.applyRotationZ("foreLimpLeft1",40);
-	mesh.applyRotationX("foreLimpLeft1",8);
-
-	mesh.restoreIdentity("foreLimpRight1");
-	mesh.applyRotationZ("foreLimpRight1", 40);
-	mesh.applyRotationX("foreLimpRight1", -8);
-
-	mesh.restoreIdentity("rearLimpLeft1");
-	mesh.applyRotationZ("rearLimpLeft1", -60);
-	mesh.applyRotationX("rearLimpLeft1", 17);
-
-	mesh.restoreIdentity("rearLimpRight1");
-	mesh.applyRotationZ("rearLimpRight1",-60);
-	mesh.applyRotationX("rearLimpRight1", -17);
-
-	//============================================================
-
-	mesh.restoreIdentity("foreLimpLeft2");
-	mesh.applyRotationZ("foreLimpLeft2", -119);
-
-	mesh.restoreIdentity("foreLimpRight2");
-	mesh.applyRotationZ("foreLimpRight2", -119);
-
-	mesh.restoreIdentity("rearLimpLeft2");
-	mesh.applyRotationZ("rearLimpLeft2", 93);
-
-	mesh.restoreIdentity("rearLimpRight2");
-	mesh.applyRotationZ("rearLimpRight2", 93);
-
-	//=============================================================
-
-	mesh.applyRotationX("foreLimpLeft2", 0);
-
-	mesh.applyRotationX("foreLimpRight2", 0);
-
-	mesh.applyRotationX("rearLimpLeft2",-13);
-
-	mesh.applyRotationX("rearLimpRight2",-13);
-
-	//=============================================================
-
-	mesh.restoreIdentity("foreLimpLeft3");
-	mesh.applyRotationZ("foreLimpLeft3",180);
-	mesh.applyRotationX("foreLimpLeft3", -15);
-
-	mesh.restoreIdentity("foreLimpRight3");
-	mesh.applyRotationZ("foreLimpRight3",180);
-	mesh.applyRotationX("foreLimpRight3",15);
-
-	mesh.restoreIdentity("rearLimpLeft3");
-	mesh.applyRotationZ("rearLimpLeft3", -127);
-	mesh.applyRotationX("rearLimpLeft3", -44);
-
-	mesh.restoreIdentity("rearLimpRight3");
-	mesh.applyRotationZ("rearLimpRight3",-127);
-	mesh.applyRotationX("rearLimpRight3", 44);
-
-	//==============================================================
-
-	mesh.restoreIdentity("tail");
-	mesh.applyRotationZ("tail",-45);
-	mesh.applyRotationX("tail", 30);
-	mesh.applyRotationZ("tail", VAL(TAIL_PITCH) / 3);
-	mesh.applyRotationX("tail", VAL(TAIL_YAW) / 3);
-}
-
-
-void applyWatchMood() {
-	auto& mesh = helper.meshes[helper.active_index];
-
-	mesh.restoreIdentity("main");
-	mesh.applyRotationX("main", VAL(ROTATE_ALL));
-
-	float x = VAL(XPOS), y = VAL(YPOS), z = VAL(ZPOS);
-
-	mesh.applyTranslate("main", aiVector3D(x, y, z));
-
-	//===========================================================
-	mesh.restoreIdentity("neck");
-
-
-	mesh.applyRotationZ("neck", -27);
-	mesh.applyRotationX("neck", 0);
-	mesh.applyRotationY("neck", 0);
-	mesh.applyRotationZ("neck", max(VAL(NECK_PITCH), 0));
-	mesh.applyRotationX("neck", VAL(NECK_YAW));
-	mesh.applyRotationY("neck", VAL(NECK_ROLL));
-
-	mesh.restoreIdentity("head");
-	mesh.applyRotationZ("head", -25);
-	mesh.applyRotationX("head", 0);
-	mesh.applyRotationY("head",0);
-	mesh.applyRotationZ("head", min(0, -VAL(NECK_PITCH)));
-	mesh.applyRotationX("head", -VAL(NECK_YAW));
-	mesh.applyRotationY("head", VAL(HEAD_ROLL) / 3);
-
-	//============================================================
-
-	mesh.restoreIdentity("foreLimpLeft1");
-	mesh.applyRotationZ("foreLimpLeft1", -17);
-	mesh.applyRotationX("foreLimpLeft1",0);
-	mesh.applyRotationZ("foreLimpLeft1", VAL(LEFT_FORELIMP_1));
-	mesh.applyRotationX("foreLimpLeft1", VAL(LEFT_FORELIMP_1_YAW));
-
-	mesh.restoreIdentity("foreLimpRight1");
-	mesh.applyRotationZ("foreLimpRight1",5);
-	mesh.applyRotationX("foreLimpRight1", 0);
-	mesh.applyRotationZ("foreLimpRight1", VAL(RIGHT_FORELIMP_1));
-	mesh.applyRotationX("foreLimpRight1", VAL(RIGHT_FORELIMP_1_YAW));
-
-	mesh.restoreIdentity("rearLimpLeft1");
-	mesh.applyRotationZ("rearLimpLeft1", -14);
-	mesh.applyRotationX("rearLimpLeft1", 0);
-	mesh.applyRotationZ("rearLimpLeft1", VAL(LEFT_REARLIMP_1));
-	mesh.applyRotationX("rearLimpLeft1", VAL(LEFT_REARLIMP_1_YAW));
-
-
-	mesh.restoreIdentity("rearLimpRight1");
-	mesh.applyRotationZ("rearLimpRight1", 8);
-	mesh.applyRotationX("rearLimpRight1", 0);
-	mesh.applyRotationZ("rearLimpRight1", VAL(RIGHT_REARLIMP_1));
-	mesh.applyRotationX("rearLimpRight1", VAL(RIGHT_REARLIMP_1_YAW));
-
-	//============================================================
-
-	mesh.restoreIdentity("foreLimpLeft2");
-	mesh.applyRotationZ("foreLimpLeft2", -5);
-	mesh.applyRotationZ("foreLimpLeft2", VAL(LEFT_FORELIMP_2));
-
-	mesh.restoreIdentity("foreLimpRight2");
-	mesh.applyRotationZ("foreLimpRight2", 0);
-	mesh.applyRotationZ("foreLimpRight2", VAL(RIGHT_FORELIMP_2));
-
-	mesh.restoreIdentity("rearLimpLeft2");
-	mesh.applyRotationZ("rearLimpLeft2",9);
-	mesh.applyRotationZ("rearLimpLeft2", VAL(LEFT_REARLIMP_2));
-
-	mesh.restoreIdentity("rearLimpRight2");
-	mesh.applyRotationZ("rearLimpRight2", 0);
-	mesh.applyRotationZ("rearLimpRight2", VAL(RIGHT_REARLIMP_2));
-
-	//=============================================================
-
-	mesh.applyRotationX("foreLimpLeft2", 0);
-
-	mesh.applyRotationX("foreLimpRight2", 0);
-
-	mesh.applyRotationX("rearLimpLeft2", 0);
-
-	mesh.applyRotationX("rearLimpRight2",0);
-
-	mesh.applyRotationX("foreLimpLeft2", VAL(LEFT_FORELIMP_2_YAW));
-
-	mesh.applyRotationX("foreLimpRight2", VAL(RIGHT_FORELIMP_2_YAW));
-
-	mesh.applyRotationX("rearLimpLeft2", VAL(LEFT_REARLIMP_2_YAW));
-
-	mesh.applyRotationX("rearLimpRight2", VAL(RIGHT_REARLIMP_2_YAW));
-
-	//=============================================================
-
-	mesh.restoreIdentity("foreLimpLeft3");
-	mesh.applyRotationZ("foreLimpLeft3", 27);
-	mesh.applyRotationX("foreLimpLeft3",0);
-	mesh.applyRotationZ("foreLimpLeft3", VAL(LEFT_FORELIMP_3));
-	mesh.applyRotationX("foreLimpLeft3", VAL(LEFT_FORELIMP_3_YAW));
-
-	mesh.restoreIdentity("foreLimpRight3");
-	mesh.applyRotationZ("foreLimpRight3", 0);
-	mesh.applyRotationX("foreLimpRight3", 0);
-	mesh.applyRotationZ("foreLimpRight3", VAL(RIGHT_FORELIMP_3));
-	mesh.applyRotationX("foreLimpRight3", VAL(RIGHT_FORELIMP_3_YAW));
-
-	mesh.restoreIdentity("rearLimpLeft3");
-	mesh.applyRotationZ("rearLimpLeft3",-9);
-	mesh.applyRotationX("rearLimpLeft3", 0);
-	mesh.applyRotationZ("rearLimpLeft3", VAL(LEFT_REARLIMP_3));
-	mesh.applyRotationX("rearLimpLeft3", VAL(LEFT_REARLIMP_3_YAW));
-
-	mesh.restoreIdentity("rearLimpRight3");
-	mesh.applyRotationZ("rearLimpRight3", 0);
-	mesh.applyRotationX("rearLimpRight3",0);
-	mesh.applyRotationZ("rearLimpRight3", VAL(RIGHT_REARLIMP_3));
-	mesh.applyRotationX("rearLimpRight3", VAL(RIGHT_REARLIMP_3_YAW));
-
-	//==============================================================
-
-	mesh.restoreIdentity("tail");
-	mesh.applyRotationZ("tail", 8);
-	mesh.applyRotationX("tail", 0);
-	mesh.applyRotationZ("tail", VAL(TAIL_PITCH));
-	mesh.applyRotationX("tail", VAL(TAIL_YAW));
-}
-
-
-void applyPreJumpMood() {
-	auto& mesh = helper.meshes[helper.active_index];
-
-	mesh.restoreIdentity("main");
-	mesh.applyRotationX("main", VAL(ROTATE_ALL));
-	mesh.applyRotationZ("main", -17);
-
-	float x = VAL(XPOS), y = VAL(YPOS), z = VAL(ZPOS);
-
-	mesh.applyTranslate("main", aiVector3D(x, y, z));
-
-	//===========================================================
-	mesh.restoreIdentity("neck");
-
-
-	mesh.applyRotationZ("neck", -18);
-	mesh.applyRotationX("neck", 0);
-	mesh.applyRotationY("neck", 0);
-	mesh.applyRotationZ("neck", max(VAL(NECK_PITCH), 0));
-	mesh.applyRotationX("neck", VAL(NECK_YAW));
-	mesh.applyRotationY("neck", VAL(NECK_ROLL));
-
-	mesh.restoreIdentity("head");
-	mesh.applyRotationZ("head", -12);
-	mesh.applyRotationX("head", 0);
-	mesh.applyRotationY("head", 0);
-	mesh.applyRotationZ("head", min(0, -VAL(NECK_PITCH)));
-	mesh.applyRotationX("neck", -VAL(NECK_YAW));
-	mesh.applyRotationY("head", VAL(HEAD_ROLL) / 2);
-
-	//============================================================
-
-	mesh.restoreIdentity("foreLimpLeft1");
-	mesh.applyRotationZ("foreLimpLeft1", -8);
-	mesh.applyRotationX("foreLimpLeft1", 17);
-	mesh.applyRotationZ("foreLimpLeft1", -abs(VAL(LEFT_FORELIMP_1)));
-	mesh.applyRotationX("foreLimpLeft1", VAL(LEFT_FORELIMP_1_YAW));
-
-	mesh.restoreIdentity("foreLimpRight1");
-	mesh.applyRotationZ("foreLimpRight1", -4);
-	mesh.applyRotationX("foreLimpRight1", -10);
-	mesh.applyRotationZ("foreLimpRight1", -abs(VAL(RIGHT_FORELIMP_1)));
-	mesh.applyRotationX("foreLimpRight1", VAL(RIGHT_FORELIMP_1_YAW));
-
-	mesh.restoreIdentity("rearLimpLeft1");
-	mesh.applyRotationZ("rearLimpLeft1", -14);
-	mesh.applyRotationX("rearLimpLeft1", 10);
-	mesh.applyRotationZ("rearLimpLeft1", -abs(VAL(LEFT_REARLIMP_1)));
-	mesh.applyRotationX("rearLimpLeft1", VAL(LEFT_REARLIMP_1_YAW));
-
-	mesh.restoreIdentity("rearLimpRight1");
-	mesh.applyRotationZ("rearLimpRight1", -5);
-	mesh.applyRotationX("rearLimpRight1", -16);
-	mesh.applyRotationZ("rearLimpRight1", -abs(VAL(RIGHT_REARLIMP_1)));
-	mesh.applyRotationX("rearLimpRight1", VAL(RIGHT_REARLIMP_1_YAW));
-
-	//============================================================
-
-	mesh.restoreIdentity("foreLimpLeft2");
-	mesh.applyRotationZ("foreLimpLeft2", 13);
-	mesh.applyRotationZ("foreLimpLeft2", -abs(VAL(LEFT_FORELIMP_2)));
-
-	mesh.restoreIdentity("foreLimpRight2");
-	mesh.applyRotationZ("foreLimpRight2", 9);
-	mesh.applyRotationZ("foreLimpRight2", -abs(VAL(RIGHT_FORELIMP_2)));
-
-	mesh.restoreIdentity("rearLimpLeft2");
-	mesh.applyRotationZ("rearLimpLeft2", 27);
-	mesh.applyRotationZ("rearLimpLeft2", abs(VAL(LEFT_REARLIMP_2)));
-
-	mesh.restoreIdentity("rearLimpRight2");
-	mesh.applyRotationZ("rearLimpRight2", 25);
-	mesh.applyRotationZ("rearLimpRight2", abs(VAL(RIGHT_REARLIMP_2)));
-
-	//=============================================================
-
-	mesh.applyRotationX("foreLimpLeft2", -8);
-	mesh.applyRotationX("foreLimpLeft2", VAL(LEFT_FORELIMP_2_YAW));
-
-	mesh.applyRotationX("foreLimpRight2", 6);
-	mesh.applyRotationX("foreLimpRight2", VAL(RIGHT_FORELIMP_2_YAW));
-
-	mesh.applyRotationX("rearLimpLeft2", 0);
-	mesh.applyRotationX("rearLimpLeft2", VAL(LEFT_REARLIMP_2_YAW));
-
-	mesh.applyRotationX("rearLimpRight2", 0);
-	mesh.applyRotationX("rearLimpRight2", VAL(RIGHT_REARLIMP_2_YAW));
-
-	//=============================================================
-
-	mesh.restoreIdentity("foreLimpLeft3");
-	mesh.applyRotationZ("foreLimpLeft3", 25);
-	mesh.applyRotationX("foreLimpLeft3", -8);
-	mesh.applyRotationZ("foreLimpLeft3", abs(VAL(LEFT_FORELIMP_3)));
-	mesh.applyRotationX("foreLimpLeft3", VAL(LEFT_FORELIMP_3_YAW));
-
-	mesh.restoreIdentity("foreLimpRight3");
-	mesh.applyRotationZ("foreLimpRight3", 25);
-	mesh.applyRotationX("foreLimpRight3", 6);
-	mesh.applyRotationZ("foreLimpRight3", abs(VAL(RIGHT_FORELIMP_3)));
-	mesh.applyRotationX("foreLimpRight3", VAL(RIGHT_FORELIMP_3_YAW));
-
-	mesh.restoreIdentity("rearLimpLeft3");
-	mesh.applyRotationZ("rearLimpLeft3", -34);
-	mesh.applyRotationX("rearLimpLeft3", -6);
-	mesh.applyRotationZ("rearLimpLeft3", -abs(VAL(LEFT_REARLIMP_3)));
-	mesh.applyRotationX("rearLimpLeft3", VAL(LEFT_REARLIMP_3_YAW));
-
-	mesh.restoreIdentity("rearLimpRight3");
-	mesh.applyRotationZ("rearLimpRight3", -25);
-	mesh.applyRotationX("rearLimpRight3", 9);
-	mesh.applyRotationZ("rearLimpRight3", -abs(VAL(RIGHT_REARLIMP_3)));
-	mesh.applyRotationX("rearLimpRight3", VAL(RIGHT_REARLIMP_3_YAW));
-
-	//==============================================================
-
-	mesh.restoreIdentity("tail");
-	mesh.applyRotationZ("tail", -14);
-	mesh.applyRotationX("tail", 0);
-	mesh.applyRotationZ("tail", VAL(TAIL_PITCH) * 2);
-	mesh.applyRotationX("tail", VAL(TAIL_YAW) * 2);
-}
-
-
-void applyJumpMood() {
-	auto& mesh = helper.meshes[helper.active_index];
-
-	mesh.restoreIdentity("main");
-	mesh.applyRotationX("main", VAL(ROTATE_ALL));
-	mesh.applyRotationZ("main", -25);
-
-	float x = VAL(XPOS), y = VAL(YPOS), z = VAL(ZPOS);
-
-	mesh.applyTranslate("main", aiVector3D(x, y, z));
-
-	//===========================================================
-	mesh.restoreIdentity("neck");
-
-
-	mesh.applyRotationZ("neck", -9);
-	mesh.applyRotationX("neck", 0);
-	mesh.applyRotationY("neck", 0);
-	mesh.applyRotationZ("neck", VAL(NECK_PITCH));
-	mesh.applyRotationX("neck", VAL(NECK_YAW));
-	mesh.applyRotationY("neck", VAL(NECK_ROLL));
-
-	mesh.restoreIdentity("head");
-	mesh.applyRotationZ("head", 4);
-	mesh.applyRotationX("head", 24);
-	mesh.applyRotationY("head", -30);
-	mesh.applyRotationZ("head", VAL(HEAD_PITCH));
-	mesh.applyRotationX("head", VAL(HEAD_YAW));
-	mesh.applyRotationY("head", VAL(HEAD_ROLL));
-
-	//============================================================
-
-	mesh.restoreIdentity("foreLimpLeft1");
-	mesh.applyRotationZ("foreLimpLeft1", -48);
-	mesh.applyRotationX("foreLimpLeft1", 11);
-
-	mesh.restoreIdentity("foreLimpRight1");
-	mesh.applyRotationZ("foreLimpRight1", -51);
-	mesh.applyRotationX("foreLimpRight1", -17);
-
-	mesh.restoreIdentity("rearLimpLeft1");
-	mesh.applyRotationZ("rearLimpLeft1", 44);
-	mesh.applyRotationX("rearLimpLeft1", 23);
-
-	mesh.restoreIdentity("rearLimpRight1");
-	mesh.applyRotationZ("rearLimpRight1", 41);
-	mesh.applyRotationX("rearLimpRight1", -15);
-
-	//============================================================
-
-	mesh.restoreIdentity("foreLimpLeft2");
-	mesh.applyRotationZ("foreLimpLeft2", -13);
-
-	mesh.restoreIdentity("foreLimpRight2");
-	mesh.applyRotationZ("foreLimpRight2", -19);
-
-	mesh.restoreIdentity("rearLimpLeft2");
-	mesh.applyRotationZ("rearLimpLeft2", 17);
-
-	mesh.restoreIdentity("rearLimpRight2");
-	mesh.applyRotationZ("rearLimpRight2", 7);
-
-	//=============================================================
-
-	mesh.applyRotationX("foreLimpLeft2", 1);
-
-	mesh.applyRotationX("foreLimpRight2", 6);
-
-	mesh.applyRotationX("rearLimpLeft2", 0);
-
-	mesh.applyRotationX("rearLimpRight2", 0);
-
-	//=============================================================
-
-	mesh.restoreIdentity("foreLimpLeft3");
-	mesh.applyRotationZ("foreLimpLeft3", 135);
-	mesh.applyRotationX("foreLimpLeft3", 40);
-
-	mesh.restoreIdentity("foreLimpRight3");
-	mesh.applyRotationZ("foreLimpRight3", 145);
-	mesh.applyRotationX("foreLimpRight3", -31);
-
-	mesh.restoreIdentity("rearLimpLeft3");
-	mesh.applyRotationZ("rearLimpLeft3", 15);
-	mesh.applyRotationX("rearLimpLeft3", 0);
-
-	mesh.restoreIdentity("rearLimpRight3");
-	mesh.applyRotationZ("rearLimpRight3", 21);
-	mesh.applyRotationX("rearLimpRight3", 0);
-
-	//==============================================================
-
-	mesh.restoreIdentity("tail");
-	mesh.applyRotationZ("tail", 14);
-	mesh.applyRotationX("tail", 0);
-	mesh.applyRotationX("tail", VAL(TAIL_YAW) * 2);
-}
-
-
-void applyJumpDoneMood() {
-	auto& mesh = helper.meshes[helper.active_index];
-
-	mesh.restoreIdentity("main");
-	mesh.applyRotationZ("main", 32);
-	mesh.applyRotationX("main", VAL(ROTATE_ALL));
-
-	float x = VAL(XPOS), y = VAL(YPOS), z = VAL(ZPOS);
-
-	mesh.applyTranslate("main", aiVector3D(x, y, z));
-
-	//===========================================================
-	mesh.restoreIdentity("neck");
-
-
-	mesh.applyRotationZ("neck", -38);
-	mesh.applyRotationX("neck", 41);
-	mesh.applyRotationY("neck", 44);
-	mesh.applyRotationZ("neck", VAL(NECK_PITCH));
-	mesh.applyRotationX("neck", VAL(NECK_YAW));
-	mesh.applyRotationY("neck", VAL(NECK_ROLL));
-
-	mesh.restoreIdentity("head");
-	mesh.applyRotationZ("head", 45);
-	mesh.applyRotationX("head", 30);
-	mesh.applyRotationY("head", 19);
-	mesh.applyRotationZ("head", VAL(HEAD_PITCH));
-	mesh.applyRotationX("head", VAL(HEAD_YAW));
-	mesh.applyRotationY("head", VAL(HEAD_ROLL));
-
-	//============================================================
-
-	mesh.restoreIdentity("foreLimpLeft1");
-	mesh.applyRotationZ("foreLimpLeft1", -60);
-	mesh.applyRotationX("foreLimpLeft1", 18);
-	mesh.applyRotationZ("foreLimpLeft1", abs(VAL(LEFT_FORELIMP_1)));
-	mesh.applyRotationX("foreLimpLeft1", VAL(LEFT_FORELIMP_1_YAW));
-
-	mesh.restoreIdentity("foreLimpRight1");
-	mesh.applyRotationZ("foreLimpRight1", -60);
-	mesh.applyRotationX("foreLimpRight1", -15);
-	mesh.applyRotationZ("foreLimpRight1", abs(VAL(RIGHT_FORELIMP_1)));
-	mesh.applyRotationX("foreLimpRight1", VAL(RIGHT_FORELIMP_1_YAW));
-
-	mesh.restoreIdentity("rearLimpLeft1");
-	mesh.applyRotationZ("rearLimpLeft1", -18);
-	mesh.applyRotationX("rearLimpLeft1", 0);
-	mesh.applyRotationZ("rearLimpLeft1", abs(VAL(LEFT_REARLIMP_1)));
-	mesh.applyRotationX("rearLimpLeft1", VAL(LEFT_REARLIMP_1_YAW));
-
-
-	mesh.restoreIdentity("rearLimpRight1");
-	mesh.applyRotationZ("rearLimpRight1", -13);
-	mesh.applyRotationX("rearLimpRight1", 0);
-	mesh.applyRotationZ("rearLimpRight1", abs(VAL(RIGHT_REARLIMP_1)));
-	mesh.applyRotationX("rearLimpRight1", VAL(RIGHT_REARLIMP_1_YAW));
-
-	//============================================================
-
-	mesh.restoreIdentity("foreLimpLeft2");
-	mesh.applyRotationZ("foreLimpLeft2", 7);
-	mesh.applyRotationZ("foreLimpLeft2", abs(VAL(LEFT_FORELIMP_2)));
-
-	mesh.restoreIdentity("foreLimpRight2");
-	mesh.applyRotationZ("foreLimpRight2", -32);
-	mesh.applyRotationZ("foreLimpRight2", abs(VAL(RIGHT_FORELIMP_2)));
-
-	mesh.restoreIdentity("rearLimpLeft2");
-	mesh.applyRotationZ("rearLimpLeft2", 50);
-	mesh.applyRotationZ("rearLimpLeft2", -abs(VAL(LEFT_REARLIMP_2)));
-
-	mesh.restoreIdentity("rearLimpRight2");
-	mesh.applyRotationZ("rearLimpRight2", 50);
-	mesh.applyRotationZ("rearLimpRight2", -abs(VAL(RIGHT_REARLIMP_2)));
-
-	//=============================================================
-
-	mesh.applyRotationX("foreLimpLeft2", -4);
-	mesh.applyRotationX("foreLimpLeft2", VAL(LEFT_FORELIMP_2_YAW));
-
-	mesh.applyRotationX("foreLimpRight2", -21);
-	mesh.applyRotationX("foreLimpRight2", VAL(RIGHT_FORELIMP_2_YAW));
-
-	mesh.applyRotationX("rearLimpLeft2", 0);
-	mesh.applyRotationX("rearLimpLeft2", VAL(LEFT_REARLIMP_2_YAW));
-
-	mesh.applyRotationX("rearLimpRight2", 0);
-	mesh.applyRotationX("rearLimpRight2", VAL(RIGHT_REARLIMP_2_YAW));
-
-	//=============================================================
-
-	mesh.restoreIdentity("foreLimpLeft3");
-	mesh.applyRotationZ("foreLimpLeft3", 5);
-	mesh.applyRotationX("foreLimpLeft3", -18);
-	mesh.applyRotationZ("foreLimpLeft3", -abs(VAL(LEFT_FORELIMP_3)));
-	mesh.applyRotationX("foreLimpLeft3", VAL(LEFT_FORELIMP_3_YAW));
-
-	mesh.restoreIdentity("foreLimpRight3");
-	mesh.applyRotationZ("foreLimpRight3", 109);
-	mesh.applyRotationX("foreLimpRight3", -90);
-	mesh.applyRotationZ("foreLimpRight3", -abs(VAL(RIGHT_FORELIMP_3)));
-	mesh.applyRotationX("foreLimpRight3", VAL(RIGHT_FORELIMP_3_YAW));
-
-	mesh.restoreIdentity("rearLimpLeft3");
-	mesh.applyRotationZ("rearLimpLeft3", -54);
-	mesh.applyRotationX("rearLimpLeft3", 0);
-	mesh.applyRotationZ("rearLimpLeft3", abs(VAL(LEFT_REARLIMP_3)));
-	mesh.applyRotationX("rearLimpLeft3", VAL(LEFT_REARLIMP_3_YAW));
-
-	mesh.restoreIdentity("rearLimpRight3");
-	mesh.applyRotationZ("rearLimpRight3", -78);
-	mesh.applyRotationX("rearLimpRight3", 0);
-	mesh.applyRotationZ("rearLimpRight3", abs(VAL(RIGHT_REARLIMP_3)));
-	mesh.applyRotationX("rearLimpRight3", VAL(RIGHT_REARLIMP_3_YAW));
-
-	//==============================================================
-
-	mesh.restoreIdentity("tail");
-	mesh.applyRotationZ("tail", 23);
-	mesh.applyRotationX("tail", 0);
-	mesh.applyRotationZ("tail", VAL(TAIL_PITCH));
-	mesh.applyRotationX("tail", VAL(TAIL_YAW));
+	float left1 = -cos(t) * 20;
+	float right1 = -sin(t) * 20;
+	float left2 = -cos(t) * 45;
+	float right2 = -sin(t) * 45;
+	float left3 = max(cos(t) * 110.f, 0.f);
+	float right3 = max(sin(t) * 110.f, 0.f);
+	float head = sin(t) * 2;
+	float neck = cos(t) * 2;
+	float tail = cos(t) * 4;
+	float main = sin(t) * 0.1f;
+	float fore_body = sin(t) * 1.5f;
+	float rear = cos(t) * 1.f;
+
+	auto rotationZ = [](float angle)
+	{
+		aiMatrix4x4t<float> mat;
+		return Affine3x4(aiMatrix4x4t<float>::RotationZ(AI_MATH_PI_F * angle / 180.f, mat));
+	};
+	aiMatrix4x4t<float> translation;
+	pose[BONE_MAIN] = Affine3x4(aiMatrix4x4t<float>::Translation(aiVector3D(0, 0, main), translation));
+	pose[BONE_NECK] = rotationZ(neck);
+	pose[BONE_HEAD] = rotationZ(head);
+	pose[BONE_TAIL] = rotationZ(tail);
+	pose[BONE_FORE_BODY] = rotationZ(fore_body);
+	pose[BONE_REAR] = rotationZ(rear);
+
+	pose[BONE_FORE_LIMP_LEFT_1] = rotationZ(left1);
+	pose[BONE_FORE_LIMP_RIGHT_1] = rotationZ(right1);
+	pose[BONE_REAR_LIMP_LEFT_1] = rotationZ(left1);
+	pose[BONE_REAR_LIMP_RIGHT_1] = rotationZ(right1);
+
+	pose[BONE_FORE_LIMP_LEFT_2] = rotationZ(left2);
+	pose[BONE_FORE_LIMP_RIGHT_2] = rotationZ(right2);
+	pose[BONE_REAR_LIMP_LEFT_2] = rotationZ(left2);
+	pose[BONE_REAR_LIMP_RIGHT_2] = rotationZ(right2);
+
+	pose[BONE_FORE_LIMP_LEFT_3] = rotationZ(left3);
+	pose[BONE_FORE_LIMP_RIGHT_3] = rotationZ(right3);
+	pose[BONE_REAR_LIMP_LEFT_3] = rotationZ(left3 * 0.5f);
+	pose[BONE_REAR_LIMP_RIGHT_3] = rotationZ(right3 * 0.5f);
 }
 
-
-void nurbsDemo()
+void animate()
 {
-	glPushMatrix();
-	glDisable(GL_TEXTURE_2D);
-
-	GLfloat ambient[] = {0.4, 0.6, 0.2, 1.0};
-	GLfloat position[] = {5.0, 5.0, 5.0, 1.0};
-
-	//glEnable(GL_LIGHTING);
-	//glEnable(GL_LIGHT0);
-	//glLightfv(GL_LIGHT0, GL_AMBIENT, ambient);
-	//glLightfv(GL_LIGHT0, GL_POSITION, position);
-
-	GLfloat mat_ambient[] = {0.247250, 0.199500, 0.074500, 1.000000};
-	GLfloat mat_diffuse[] = {0.751640, 0.606480, 0.226480, 1.000000};
-	GLfloat mat_specular[] = {0.628281, 0.555802, 0.366065, 1.000000};
-	GLfloat mat_shininess[] = {51.200001};
-
-	glMaterialfv(GL_FRONT, GL_AMBIENT, mat_ambient);
-	glMaterialfv(GL_FRONT, GL_DIFFUSE, mat_diffuse);
-	glMaterialfv(GL_FRONT, GL_SPECULAR, mat_specular);
-	glMaterialfv(GL_FRONT, GL_SHININESS, mat_shininess);
-
-	glEnable(GL_AUTO_NORMAL);
-    glEnable(GL_NORMALIZE);
-	
-	glScaled(0.5, 0.5, 0.5);
-	glRotated(135, 1, 0, 0);
-	glTranslated(-10, -10, 5);
-	
-	constexpr int n = 20;
-	float control_points[n * n * 3];
-	float t = 0;
-
-	for (int i = 0; i < n; ++i)
-		for (int j = 0; j < n; ++j)
-		{
-			int index = (i + j * n) * 3;
-			control_points[index] = i;
-			control_points[index + 1] = j;
-			control_points[index + 2] = cos(i) * 2 + sin(j) * 2;
-		}
-
-	drawNurbs(control_points, n, n);
-
-	glDisable(GL_AUTO_NORMAL);
-    glDisable(GL_NORMALIZE);
-	glPopMatrix();
+	auto& mesh = helper.meshes[helper.active_index];
+	const BoneHandle* bones = mesh.controlBones();
+	Affine3x4 pose[NUM_CONTROL_BONES];
+	walkCycle(tick, pose);
+	for (int b = 0; b < NUM_CONTROL_BONES; ++b)
+		mesh.applyMatrix(bones[b], pose[b]);
+
+	tick += 0.5f;
+	if (tick > 1e4f * AI_MATH_PI_F)
+		tick = 0.f;
 }
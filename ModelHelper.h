@@ -6,17 +6,81 @@
 #include <vector>
 #include <string>
 #include <map>
+#include <memory>
 #include "mat.h"
 #include "vec.h"
+#include "Affine3x4.h"
 
+// Max number of bones that can influence a single vertex
+constexpr int kMaxInfluences = 4;
+
+// Layout is used directly as OpenGL vertex arrays, see drawMesh
 class Vertex
 {
 public:
-	aiVector3D original_pos;
 	aiVector3D world_pos;
+	aiVector3D normal;
 	aiVector3D tex_coords;
-	std::vector<int> bone_index;
-	std::vector<float> bone_weight;
+};
+
+// Packed skinning input of a mesh, built once in ModelHelper::preprocess
+// Positions are stored as separate x/y/z arrays, and every vertex owns exactly
+// kMaxInfluences (index, weight) slots, unused slots have zero weight
+class SkinData
+{
+public:
+	void build(const aiMesh* mesh);
+
+	// Fill bone_vertex_offset and bone_vertices from the packed influences, and the bone boxes
+	void buildBoneVertices(int num_bones);
+
+	// Fill bone_aabb_min and bone_aabb_max from bone_vertices, and the influence pairs
+	void buildBoneBounds();
+
+	int num_vertices{0};
+	std::vector<float> pos_x, pos_y, pos_z;		// bind pose positions
+	std::vector<float> nrm_x, nrm_y, nrm_z;		// bind pose unit normals, smooth if the model has none
+	std::vector<int> bone_index;				// num_vertices * kMaxInfluences
+	std::vector<float> bone_weight;				// normalized so that they sum to 1
+
+	// Vertices influenced by bone b are bone_vertices[bone_vertex_offset[b], bone_vertex_offset[b + 1])
+	std::vector<int> bone_vertex_offset;
+	std::vector<int> bone_vertices;
+
+	// Bind pose box of the vertices every bone influences, empty boxes have min > max
+	std::vector<aiVector3D> bone_aabb_min, bone_aabb_max;
+
+	// Every (first influence, other influence) pair of bones some vertex has, with the
+	// bind pose box of those vertices. Bound dual quaternion skinning, see calPoseBounds.
+	std::vector<std::pair<int, int>> influence_pairs;
+	std::vector<aiVector3D> pair_aabb_min, pair_aabb_max;
+};
+
+enum class SkinningMethod
+{
+	LINEAR,				// blend the bone matrices
+	DUAL_QUATERNION		// blend rigid transformations, keeps the volume at twisting joints
+};
+
+// Bones of the deer driven by the controls, the moods and the animation
+enum ControlBone
+{
+	BONE_MAIN, BONE_NECK, BONE_HEAD, BONE_TAIL, BONE_FORE_BODY, BONE_REAR,
+	BONE_FORE_LIMP_LEFT_1, BONE_FORE_LIMP_LEFT_2, BONE_FORE_LIMP_LEFT_3,
+	BONE_FORE_LIMP_RIGHT_1, BONE_FORE_LIMP_RIGHT_2, BONE_FORE_LIMP_RIGHT_3,
+	BONE_REAR_LIMP_LEFT_1, BONE_REAR_LIMP_LEFT_2, BONE_REAR_LIMP_LEFT_3,
+	BONE_REAR_LIMP_RIGHT_1, BONE_REAR_LIMP_RIGHT_2, BONE_REAR_LIMP_RIGHT_3,
+	NUM_CONTROL_BONES
+};
+
+// Index of a bone in Mesh::bones, resolved once by name so that the bone can
+// be changed without a string lookup
+class BoneHandle
+{
+public:
+	int index{-1};
+
+	bool valid() const { return index >= 0; }
 };
 
 class Bone
@@ -26,42 +90,100 @@ public:
 	std::string name;
 	
 	// Matrices used for rendering the mesh
-	aiMatrix4x4t<float> final_transformation;	// final matrix applied to vertices
-	aiMatrix4x4t<float> local_transformation;	// all the user specified transformations
-	aiMatrix4x4t<float> offset;					// transform vertex from local to bone space
+	Affine3x4 final_transformation;		// final matrix applied to vertices
+	Affine3x4 local_transformation;		// all the user specified transformations
+	Affine3x4 offset;					// transform vertex from local to bone space
 
 	// Info for rendering the bone and IK
 	float length;
 	aiVector3D start, end;			// world space coords for end points
 	aiQuaternion rotation;			// rotation from parent to local space
 	aiQuaternion global_rotation;	// from world to bone space, for IK
+
+	// Incremental pose evaluation
+	bool dirty{true};		// local_transformation was touched since the last evaluation
+	bool moved{false};		// final_transformation changed since the last skinning
+};
+
+// A node of the scene hierarchy, flattened at load time so that parents
+// always come before their children
+class Joint
+{
+public:
+	const aiNode* node;
+	std::string name;						// processed bone name
+	int parent{-1};							// index of the parent joint
+	Affine3x4 transformation;				// from local space to parent space
 };
 
 class Mesh
 {
 public:
-	const aiMesh* data;
-	Mesh* parent{nullptr};
+	const aiMesh* data{nullptr};		// nullptr if the model was loaded from the cache or generated
+	Mesh* parent{nullptr};				// follows the skeleton of parent, see ModelHelper::evaluateAttached
 	std::string name;
+	int lod_source{-1};		// index of the mesh this one was simplified from, -1 if it comes from the model
+	int lod_level{0};		// 1 for the finest generated level of lod_source
 	std::vector<Vertex> vertices;
+	std::vector<unsigned int> indices;		// triangle list for glDrawElements
+	SkinData skin;
 	std::vector<Bone> bones;
 	std::map<std::string, int> bone_map;
+	std::vector<float> palette;		// final_transformation of bones packed for skinning
+	SkinningMethod skinning_method{SkinningMethod::LINEAR};
+	std::vector<int> joint_bones;	// bone index of every joint, -1 if it's not a bone of this mesh
+	std::vector<int> bone_joints;	// joint index of every bone, -1 if the scene has no node of that name
+	std::vector<Affine3x4> joint_transformations;		// global transformation of every joint
 	aiVector3D aabb_min, aabb_max;
+	std::vector<aiVector3D> chunk_aabb_min, chunk_aabb_max;		// partial results of parallel skinning
+
+	// Only joints whose local transformation or ancestors changed are re-evaluated,
+	// and only vertices influenced by moved bones are skinned again
+	bool pose_valid{false};							// false forces a full evaluation
+	std::vector<Affine3x4> joint_locals;			// local transformation used by the last evaluation
+	std::vector<char> joint_changed;
+	std::vector<int> moved_bones;
+	std::vector<char> vertex_dirty;
+
+	std::vector<BoneHandle> control_bones;		// indexed by ControlBone, see controlBones
+
+	// Generation of the ControlSnapshot the bones were posed from by applyMeshControls,
+	// 0 when anything else moved them since
+	unsigned control_generation{0};
 
 	unsigned int tex_id;
 	unsigned char* tex{nullptr};
 	int tex_height, tex_width;
 	bool tex_loaded{false};
 
+	// The handle is invalid if the mesh has no such bone
+	BoneHandle findBone(const std::string& bone_name) const;
+
+	// Handles of all the ControlBones, resolved on first use
+	const BoneHandle* controlBones();
+
+	// Takes effect with the next processVertices, which then skins every vertex
+	void setSkinningMethod(SkinningMethod method);
+
+	// All of these return false for an invalid handle or unknown name,
+	// the string versions resolve the handle every call
+	bool applyTranslate(BoneHandle bone, const aiVector3D& translation);
 	bool applyTranslate(const std::string& bone_name, const aiVector3D& translation);
 
 	// angle in degrees
+	bool applyRotationX(BoneHandle bone, float angle);
+	bool applyRotationY(BoneHandle bone, float angle);
+	bool applyRotationZ(BoneHandle bone, float angle);
 	bool applyRotationX(const std::string& bone_name, float angle);
 	bool applyRotationY(const std::string& bone_name, float angle);
 	bool applyRotationZ(const std::string& bone_name, float angle);
 	
+	bool applyScaling(BoneHandle bone, const aiVector3D& scale);
 	bool applyScaling(const std::string& bone_name, const aiVector3D& scale);
+	bool restoreIdentity(BoneHandle bone);
 	bool restoreIdentity(const std::string& bone_name);
+	bool applyMatrix(BoneHandle bone, const aiMatrix4x4t<float>& mat);
+	bool applyMatrix(BoneHandle bone, const Affine3x4& mat);
 	bool applyMatrix(const std::string& bone_name, const aiMatrix4x4t<float>& mat);
 
 	void printBoneHierarchy(const aiNode* cur, int depth);
@@ -73,11 +195,42 @@ public:
 	static std::string processBoneName(const std::string& name);
 };
 
+// Levels of detail generated from one mesh while loading the model, they are
+// appended to the meshes and kept in the model cache
+class LodSettings
+{
+public:
+	int mesh{-1};			// mesh the levels are simplified from, -1 for none
+	int levels{0};
+	float ratio{0.5f};		// vertex budget of every level relative to the one before
+};
+
 class ModelHelper
 {
 public:
-	void loadModel(const std::string& model, const std::string& bone);
+	void loadModel(const std::string& model, const std::string& bone, const LodSettings& lod = LodSettings());
 	void preprocess();
+
+	// Simplify lod.mesh and append its levels of detail to the meshes
+	void generateLods(const LodSettings& lod);
+
+	// Indices of the levels generated from mesh, finest first
+	std::vector<int> lodLevels(int mesh) const;
+
+	void buildSkeleton(const aiNode* cur, int parent);
+	// Attached meshes are handed to evaluateAttached with their parent
+	void evaluateSkeleton(Mesh& mesh);
+
+	// Pose the bones of mesh with the joint transformations of skeleton, which has to be
+	// evaluated first. The hierarchy is walked once for skeleton and every mesh attached
+	// to it only needs one product per bone, which follows the pose of skeleton exactly.
+	void evaluateAttached(Mesh& mesh, const Mesh& skeleton);
+
+	// Evaluate the whole skeleton of mesh in some other pose, the mesh itself is not touched.
+	// bone_locals holds a local transformation for every bone of the mesh, joint_globals
+	// receives the global transformation of every joint and bone_finals the final
+	// transformation of every bone. Safe to call from several threads at once.
+	void evaluatePose(const Mesh& mesh, const Affine3x4* bone_locals, Affine3x4* joint_globals, Affine3x4* bone_finals) const;
 	void calBoneTransformation(const aiQuaternion& global_rotation, const aiNode* cur);
 	void parseBoneInfo(Mesh& mesh, const std::string& filename);
 	void printMeshInfo(bool showBoneHierarchy = true);
@@ -87,12 +240,23 @@ public:
 	static aiMatrix4x4t<float> calViewingTransformation(Vec3f& eye, Vec3f& at, Vec3f& up);
 	
 	Assimp::Importer importer;
-	const aiScene* scene{nullptr};
+	const aiScene* scene{nullptr};				// only the node hierarchy if loaded from the cache
+	std::unique_ptr<aiScene> cached_scene;		// owns scene when it was loaded from the cache
 	std::vector<Mesh> meshes;
+	std::vector<Joint> joints;
+	Affine3x4 global_inverse;		// inverse of the root transformation
 
 	int active_index{0};
 };
 
+// Transformations of the walk cycle at time t, indexed by ControlBone,
+// each one is applied on top of the local transformation of its bone
+void walkCycle(float t, Affine3x4* pose);
+
+// Drive the active mesh with a simple walk cycle, advances tick
+extern float tick;
+void animate();
+
 void applyMeshControls();
 
 void applyPeaceMood();
@@ -0,0 +1,122 @@
+#include "Profiler.h"
+
+#include <fstream>
+#include <iomanip>
+#include <algorithm>
+
+using namespace std;
+
+bool Profiler::enabled = false;
+
+Profiler* Profiler::Instance()
+{
+	static Profiler profiler;
+	return &profiler;
+}
+
+Profiler::Profiler() : origin(chrono::steady_clock::now())
+{
+	trace.reserve(kProfileTraceCapacity);
+	clear();
+}
+
+double Profiler::now() const
+{
+	return chrono::duration<double, micro>(chrono::steady_clock::now() - origin).count();
+}
+
+const char* Profiler::stageName(ProfileStage stage)
+{
+	static const char* names[kNumProfileStages] = {
+		"controls", "animate", "IK apply", "bone render", "hierarchy", "skinning",
+		"mesh submit", "L-system", "primitives", "crowd", "frame"
+	};
+	return names[int(stage)];
+}
+
+void Profiler::clear()
+{
+	fill(begin(current), end(current), 0.0);
+	for (auto& frame : history)
+		fill(begin(frame), end(frame), 0.0);
+	num_frames = 0;
+	frame_begin = -1.0;
+	trace.clear();
+	trace_next = 0;
+}
+
+void Profiler::beginFrame()
+{
+	frame_begin = now();
+}
+
+void Profiler::record(ProfileStage stage, double begin_us, double end_us)
+{
+	current[int(stage)] += (end_us - begin_us) / 1000.0;
+
+	Event event{stage, begin_us, end_us - begin_us};
+	if (trace.size() < kProfileTraceCapacity)
+		trace.push_back(event);
+	else
+		trace[trace_next] = event;
+	trace_next = (trace_next + 1) % kProfileTraceCapacity;
+}
+
+void Profiler::endFrame()
+{
+	// Profiling was switched on in the middle of the frame
+	if (frame_begin < 0.0)
+	{
+		fill(begin(current), end(current), 0.0);
+		return;
+	}
+
+	record(ProfileStage::FRAME, frame_begin, now());
+	frame_begin = -1.0;
+
+	copy(begin(current), end(current), history[num_frames % kProfileWindow]);
+	fill(begin(current), end(current), 0.0);
+	++num_frames;
+}
+
+double Profiler::average(ProfileStage stage) const
+{
+	int count = min(num_frames, kProfileWindow);
+	if (count == 0)
+		return 0.0;
+
+	double sum = 0.0;
+	for (int i = 0; i < count; ++i)
+		sum += history[i][int(stage)];
+	return sum / count;
+}
+
+double Profiler::maximum(ProfileStage stage) const
+{
+	double result = 0.0;
+	for (int i = 0; i < min(num_frames, kProfileWindow); ++i)
+		result = max(result, history[i][int(stage)]);
+	return result;
+}
+
+bool Profiler::writeTrace(const string& filename) const
+{
+	ofstream fs(filename);
+	if (!fs.is_open())
+		return false;
+
+	// Complete events, oldest first, the frame on its own row so that the stages nest below it
+	fs << fixed << setprecision(3);
+	fs << "{\"traceEvents\":[" << endl;
+	int count = trace.size();
+	int first = count < kProfileTraceCapacity ? 0 : trace_next;
+	for (int i = 0; i < count; ++i)
+	{
+		const Event& event = trace[(first + i) % count];
+		fs << "{\"name\":\"" << stageName(event.stage) << "\",\"cat\":\"frame\",\"ph\":\"X\",\"pid\":1,\"tid\":"
+			<< (event.stage == ProfileStage::FRAME ? 0 : 1) << ",\"ts\":" << event.begin << ",\"dur\":" << event.duration
+			<< "}" << (i + 1 < count ? "," : "") << endl;
+	}
+	fs << "],\"displayTimeUnit\":\"ms\"}" << endl;
+	return bool(fs);
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <chrono>
+
+// Stages of a frame in SampleModel::draw
+enum class ProfileStage
+{
+	CONTROLS, ANIMATE, IK, BONES, SKELETON, SKINNING, SUBMIT, L_SYSTEM, PRIMITIVES, CROWD, FRAME, COUNT
+};
+
+constexpr int kNumProfileStages = int(ProfileStage::COUNT);
+
+// Number of frames the rolling statistics are computed over
+constexpr int kProfileWindow = 120;
+
+// Number of scopes kept for the trace, older ones are overwritten
+constexpr int kProfileTraceCapacity = 1 << 16;
+
+// Collects the time spent in every stage of a frame.
+// Scopes only check a flag while the profiler is disabled.
+class Profiler
+{
+public:
+	static Profiler* Instance();
+
+	static bool enabled;
+
+	// A frame is everything recorded between beginFrame and endFrame
+	void beginFrame();
+	void record(ProfileStage stage, double begin_us, double end_us);
+	void endFrame();
+	void clear();
+
+	// Average and maximum time per frame in ms over the last kProfileWindow frames
+	double average(ProfileStage stage) const;
+	double maximum(ProfileStage stage) const;
+	int numFrames() const { return num_frames; }
+
+	// Write the recorded scopes in the Chrome trace event format, open it in chrome://tracing
+	bool writeTrace(const std::string& filename) const;
+
+	static const char* stageName(ProfileStage stage);
+
+	// Microseconds since the profiler was created
+	double now() const;
+
+private:
+	Profiler();
+	Profiler(const Profiler&) = delete;
+	Profiler& operator=(const Profiler&) = delete;
+
+	class Event
+	{
+	public:
+		ProfileStage stage;
+		double begin, duration;		// in us
+	};
+
+	std::chrono::steady_clock::time_point origin;
+	double frame_begin{-1.0};
+
+	double current[kNumProfileStages];					// ms spent in the current frame
+	double history[kProfileWindow][kNumProfileStages];	// ms spent in the last frames
+	int num_frames{0};
+
+	std::vector<Event> trace;
+	int trace_next{0};
+};
+
+// Times the enclosing scope as one stage
+class ProfileScope
+{
+public:
+	explicit ProfileScope(ProfileStage stage) : stage(stage), active(Profiler::enabled)
+	{
+		if (active)
+			begin = Profiler::Instance()->now();
+	}
+
+	~ProfileScope()
+	{
+		stop();
+	}
+
+	// End the scope early
+	void stop()
+	{
+		if (active)
+			Profiler::Instance()->record(stage, begin, Profiler::Instance()->now());
+		active = false;
+	}
+
+private:
+	ProfileStage stage;
+	bool active;
+	double begin{0.0};
+};
@@ -0,0 +1,939 @@
+#include "Skinning.h"
+#include "WorkerPool.h"
+
+#include <cmath>
+#include <iostream>
+#include <algorithm>
+
+// The AVX2 kernels are compiled into every x86 build and only picked when the CPU
+// reports AVX2 at run time, so the Win32 project needs no /arch:AVX2.
+// MSVC accepts AVX2 intrinsics without it, GCC and Clang need the target attribute.
+#if defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+#define SKINNING_HAS_AVX2
+#define SKINNING_TARGET_AVX2
+#include <intrin.h>
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__i386__) || defined(__x86_64__))
+#define SKINNING_HAS_AVX2
+#define SKINNING_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define SKINNING_TARGET_AVX2
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SKINNING_HAS_SSE
+#endif
+
+#if defined(SKINNING_HAS_AVX2)
+#include <immintrin.h>
+#elif defined(SKINNING_HAS_SSE)
+#include <xmmintrin.h>
+#endif
+
+using namespace std;
+
+SkinningKernel skinning_kernel = SkinningKernel::SCALAR;
+
+// AVX2 needs both the CPU and the OS, which has to save the ymm registers on context switches
+static bool cpuHasAVX2()
+{
+#if defined(SKINNING_HAS_AVX2) && defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7)
+		return false;
+	__cpuid(info, 1);
+	const int osxsave = 1 << 27, avx = 1 << 28;
+	if ((info[2] & (osxsave | avx)) != (osxsave | avx) || (_xgetbv(0) & 6) != 6)
+		return false;
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#elif defined(SKINNING_HAS_AVX2)
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2");
+#else
+	return false;
+#endif
+}
+
+SkinningKernel bestSkinningKernel()
+{
+	static const bool has_avx2 = cpuHasAVX2();
+	if (has_avx2)
+		return SkinningKernel::AVX2;
+#if defined(SKINNING_HAS_SSE)
+	return SkinningKernel::SSE;
+#else
+	return SkinningKernel::SCALAR;
+#endif
+}
+
+const char* skinningKernelName(SkinningKernel kernel)
+{
+	switch (kernel)
+	{
+	case SkinningKernel::SSE:
+		return "SSE";
+	case SkinningKernel::AVX2:
+		return "AVX2";
+	default:
+		return "scalar";
+	}
+}
+
+void buildBonePalette(const vector<Bone>& bones, vector<float>& palette)
+{
+	palette.resize(bones.size() * kPaletteStride);
+	for (int i = 0; i < bones.size(); ++i)
+	{
+		const float* m = bones[i].final_transformation.data();
+		copy(m, m + kPaletteStride, &palette[i * kPaletteStride]);
+	}
+}
+
+static void packDualQuat(const Affine3x4& transformation, float* p)
+{
+	aiVector3D scale, t;
+	aiQuaternion q;
+	transformation.toMatrix4().Decompose(scale, q, t);
+
+	// The dual part is t * q / 2, t taken as a pure quaternion
+	p[0] = q.x; p[1] = q.y; p[2] = q.z; p[3] = q.w;
+	p[4] = 0.5f * (t.x * q.w + t.y * q.z - t.z * q.y);
+	p[5] = 0.5f * (t.y * q.w + t.z * q.x - t.x * q.z);
+	p[6] = 0.5f * (t.z * q.w + t.x * q.y - t.y * q.x);
+	p[7] = -0.5f * (t.x * q.x + t.y * q.y + t.z * q.z);
+	p[8] = scale.x; p[9] = scale.y; p[10] = scale.z; p[11] = 0.f;
+}
+
+void buildDualQuatPalette(const vector<Bone>& bones, vector<float>& palette)
+{
+	palette.resize(bones.size() * kPaletteStride);
+	for (int i = 0; i < bones.size(); ++i)
+		packDualQuat(bones[i].final_transformation, &palette[i * kPaletteStride]);
+}
+
+void buildDualQuatPalette(const vector<Affine3x4>& transformations, vector<float>& palette)
+{
+	palette.resize(transformations.size() * kPaletteStride);
+	for (int i = 0; i < transformations.size(); ++i)
+		packDualQuat(transformations[i], &palette[i * kPaletteStride]);
+}
+
+// Keeps degenerate normals from turning into NaNs
+static constexpr float kMinNormalLength = 1e-20f;
+
+// Reference implementation, blend the 3x4 matrices and transform the position and normal
+void skinVerticesScalar(const SkinData& skin, const float* palette, int begin, int end, Vertex* out)
+{
+	for (int i = begin; i < end; ++i)
+	{
+		const int* index = &skin.bone_index[i * kMaxInfluences];
+		const float* weight = &skin.bone_weight[i * kMaxInfluences];
+
+		float m[kPaletteStride] = {0.f};
+		for (int j = 0; j < kMaxInfluences; ++j)
+		{
+			if (weight[j] == 0.f) continue;
+			const float* bone = palette + index[j] * kPaletteStride;
+			for (int k = 0; k < kPaletteStride; ++k)
+				m[k] += bone[k] * weight[j];
+		}
+
+		float x = skin.pos_x[i], y = skin.pos_y[i], z = skin.pos_z[i];
+		out[i].world_pos.x = m[0] * x + m[1] * y + m[2] * z + m[3];
+		out[i].world_pos.y = m[4] * x + m[5] * y + m[6] * z + m[7];
+		out[i].world_pos.z = m[8] * x + m[9] * y + m[10] * z + m[11];
+
+		// Normals only take the linear part and are renormalized
+		x = skin.nrm_x[i], y = skin.nrm_y[i], z = skin.nrm_z[i];
+		float nx = m[0] * x + m[1] * y + m[2] * z;
+		float ny = m[4] * x + m[5] * y + m[6] * z;
+		float nz = m[8] * x + m[9] * y + m[10] * z;
+		float length = max(sqrt(nx * nx + ny * ny + nz * nz), kMinNormalLength);
+		out[i].normal.x = nx / length;
+		out[i].normal.y = ny / length;
+		out[i].normal.z = nz / length;
+	}
+}
+
+// 4 vertices per iteration. The rows of the 4 bone matrices are loaded and
+// transposed so that each register holds one matrix entry for all 4 vertices.
+void skinVerticesSSE(const SkinData& skin, const float* palette, int begin, int end, Vertex* out)
+{
+#if defined(SKINNING_HAS_SSE)
+	int i = begin;
+	for (; i + 4 <= end; i += 4)
+	{
+		const int* index = &skin.bone_index[i * kMaxInfluences];
+
+		// Weights are stored per vertex, transpose to get one influence slot per register
+		__m128 w[kMaxInfluences];
+		w[0] = _mm_loadu_ps(&skin.bone_weight[i * kMaxInfluences]);
+		w[1] = _mm_loadu_ps(&skin.bone_weight[i * kMaxInfluences + 4]);
+		w[2] = _mm_loadu_ps(&skin.bone_weight[i * kMaxInfluences + 8]);
+		w[3] = _mm_loadu_ps(&skin.bone_weight[i * kMaxInfluences + 12]);
+		_MM_TRANSPOSE4_PS(w[0], w[1], w[2], w[3]);
+
+		__m128 m[kPaletteStride];
+		for (int k = 0; k < kPaletteStride; ++k)
+			m[k] = _mm_setzero_ps();
+
+		for (int j = 0; j < kMaxInfluences; ++j)
+		{
+			const float* b0 = palette + index[j] * kPaletteStride;
+			const float* b1 = palette + index[kMaxInfluences + j] * kPaletteStride;
+			const float* b2 = palette + index[2 * kMaxInfluences + j] * kPaletteStride;
+			const float* b3 = palette + index[3 * kMaxInfluences + j] * kPaletteStride;
+
+			for (int r = 0; r < 3; ++r)
+			{
+				__m128 c0 = _mm_loadu_ps(b0 + r * 4);
+				__m128 c1 = _mm_loadu_ps(b1 + r * 4);
+				__m128 c2 = _mm_loadu_ps(b2 + r * 4);
+				__m128 c3 = _mm_loadu_ps(b3 + r * 4);
+				_MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+
+				m[r * 4] = _mm_add_ps(m[r * 4], _mm_mul_ps(c0, w[j]));
+				m[r * 4 + 1] = _mm_add_ps(m[r * 4 + 1], _mm_mul_ps(c1, w[j]));
+				m[r * 4 + 2] = _mm_add_ps(m[r * 4 + 2], _mm_mul_ps(c2, w[j]));
+				m[r * 4 + 3] = _mm_add_ps(m[r * 4 + 3], _mm_mul_ps(c3, w[j]));
+			}
+		}
+
+		__m128 x = _mm_loadu_ps(&skin.pos_x[i]);
+		__m128 y = _mm_loadu_ps(&skin.pos_y[i]);
+		__m128 z = _mm_loadu_ps(&skin.pos_z[i]);
+
+		__m128 nx = _mm_loadu_ps(&skin.nrm_x[i]);
+		__m128 ny = _mm_loadu_ps(&skin.nrm_y[i]);
+		__m128 nz = _mm_loadu_ps(&skin.nrm_z[i]);
+
+		float res[3][4];
+		__m128 n[3];
+		for (int r = 0; r < 3; ++r)
+		{
+			__m128 v = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m[r * 4], x), _mm_mul_ps(m[r * 4 + 1], y)),
+				_mm_add_ps(_mm_mul_ps(m[r * 4 + 2], z), m[r * 4 + 3]));
+			_mm_storeu_ps(res[r], v);
+			n[r] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m[r * 4], nx), _mm_mul_ps(m[r * 4 + 1], ny)),
+				_mm_mul_ps(m[r * 4 + 2], nz));
+		}
+
+		__m128 length = _mm_add_ps(_mm_add_ps(_mm_mul_ps(n[0], n[0]), _mm_mul_ps(n[1], n[1])), _mm_mul_ps(n[2], n[2]));
+		length = _mm_max_ps(_mm_sqrt_ps(length), _mm_set1_ps(kMinNormalLength));
+		float nrm[3][4];
+		for (int r = 0; r < 3; ++r)
+			_mm_storeu_ps(nrm[r], _mm_div_ps(n[r], length));
+
+		for (int l = 0; l < 4; ++l)
+		{
+			out[i + l].world_pos.x = res[0][l];
+			out[i + l].world_pos.y = res[1][l];
+			out[i + l].world_pos.z = res[2][l];
+			out[i + l].normal.x = nrm[0][l];
+			out[i + l].normal.y = nrm[1][l];
+			out[i + l].normal.z = nrm[2][l];
+		}
+	}
+	skinVerticesScalar(skin, palette, i, end, out);
+#else
+	skinVerticesScalar(skin, palette, begin, end, out);
+#endif
+}
+
+// 8 vertices per iteration, matrix entries are fetched with gathers
+SKINNING_TARGET_AVX2 void skinVerticesAVX2(const SkinData& skin, const float* palette, int begin, int end, Vertex* out)
+{
+#if defined(SKINNING_HAS_AVX2)
+	const __m256i slot_offsets = _mm256_setr_epi32(0, 4, 8, 12, 16, 20, 24, 28);
+	const __m256i stride = _mm256_set1_epi32(kPaletteStride);
+
+	int i = begin;
+	for (; i + 8 <= end; i += 8)
+	{
+		__m256 m[kPaletteStride];
+		for (int k = 0; k < kPaletteStride; ++k)
+			m[k] = _mm256_setzero_ps();
+
+		for (int j = 0; j < kMaxInfluences; ++j)
+		{
+			__m256 w = _mm256_i32gather_ps(&skin.bone_weight[i * kMaxInfluences + j], slot_offsets, 4);
+			__m256i index = _mm256_i32gather_epi32(&skin.bone_index[i * kMaxInfluences + j], slot_offsets, 4);
+			__m256i base = _mm256_mullo_epi32(index, stride);
+
+			for (int k = 0; k < kPaletteStride; ++k)
+			{
+				__m256 c = _mm256_i32gather_ps(palette + k, base, 4);
+				m[k] = _mm256_add_ps(m[k], _mm256_mul_ps(c, w));
+			}
+		}
+
+		__m256 x = _mm256_loadu_ps(&skin.pos_x[i]);
+		__m256 y = _mm256_loadu_ps(&skin.pos_y[i]);
+		__m256 z = _mm256_loadu_ps(&skin.pos_z[i]);
+
+		__m256 nx = _mm256_loadu_ps(&skin.nrm_x[i]);
+		__m256 ny = _mm256_loadu_ps(&skin.nrm_y[i]);
+		__m256 nz = _mm256_loadu_ps(&skin.nrm_z[i]);
+
+		float res[3][8];
+		__m256 n[3];
+		for (int r = 0; r < 3; ++r)
+		{
+			__m256 v = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m[r * 4], x), _mm256_mul_ps(m[r * 4 + 1], y)),
+				_mm256_add_ps(_mm256_mul_ps(m[r * 4 + 2], z), m[r * 4 + 3]));
+			_mm256_storeu_ps(res[r], v);
+			n[r] = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m[r * 4], nx), _mm256_mul_ps(m[r * 4 + 1], ny)),
+				_mm256_mul_ps(m[r * 4 + 2], nz));
+		}
+
+		__m256 length = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(n[0], n[0]), _mm256_mul_ps(n[1], n[1])),
+			_mm256_mul_ps(n[2], n[2]));
+		length = _mm256_max_ps(_mm256_sqrt_ps(length), _mm256_set1_ps(kMinNormalLength));
+		float nrm[3][8];
+		for (int r = 0; r < 3; ++r)
+			_mm256_storeu_ps(nrm[r], _mm256_div_ps(n[r], length));
+
+		for (int l = 0; l < 8; ++l)
+		{
+			out[i + l].world_pos.x = res[0][l];
+			out[i + l].world_pos.y = res[1][l];
+			out[i + l].world_pos.z = res[2][l];
+			out[i + l].normal.x = nrm[0][l];
+			out[i + l].normal.y = nrm[1][l];
+			out[i + l].normal.z = nrm[2][l];
+		}
+	}
+	_mm256_zeroupper();
+	skinVerticesSSE(skin, palette, i, end, out);
+#else
+	skinVerticesSSE(skin, palette, begin, end, out);
+#endif
+}
+
+// Reference implementation of dual quaternion skinning. Rotations on the other
+// side of the hypersphere than the first influence are negated before blending,
+// so that the blend takes the short way.
+void skinVerticesDualQuatScalar(const SkinData& skin, const float* palette, int begin, int end, Vertex* out)
+{
+	for (int i = begin; i < end; ++i)
+	{
+		const int* index = &skin.bone_index[i * kMaxInfluences];
+		const float* weight = &skin.bone_weight[i * kMaxInfluences];
+		const float* first = palette + index[0] * kPaletteStride;
+
+		float b[kPaletteStride] = {0.f};
+		for (int j = 0; j < kMaxInfluences; ++j)
+		{
+			if (weight[j] == 0.f) continue;
+			const float* bone = palette + index[j] * kPaletteStride;
+			float dot = bone[0] * first[0] + bone[1] * first[1] + bone[2] * first[2] + bone[3] * first[3];
+			float w = dot < 0.f ? -weight[j] : weight[j];
+			for (int k = 0; k < 8; ++k)
+				b[k] += bone[k] * w;
+			for (int k = 8; k < kPaletteStride; ++k)
+				b[k] += bone[k] * weight[j];
+		}
+
+		float length = max(sqrt(b[0] * b[0] + b[1] * b[1] + b[2] * b[2] + b[3] * b[3]), kMinNormalLength);
+		float rx = b[0] / length, ry = b[1] / length, rz = b[2] / length, rw = b[3] / length;
+		float dx = b[4] / length, dy = b[5] / length, dz = b[6] / length, dw = b[7] / length;
+
+		// Translation 2 * d * conj(r)
+		float tx = 2.f * (rw * dx - dw * rx + ry * dz - rz * dy);
+		float ty = 2.f * (rw * dy - dw * ry + rz * dx - rx * dz);
+		float tz = 2.f * (rw * dz - dw * rz + rx * dy - ry * dx);
+
+		// v + 2 * r.xyz x (r.xyz x v + r.w * v) rotates v by r
+		float x = skin.pos_x[i] * b[8], y = skin.pos_y[i] * b[9], z = skin.pos_z[i] * b[10];
+		float cx = ry * z - rz * y + rw * x;
+		float cy = rz * x - rx * z + rw * y;
+		float cz = rx * y - ry * x + rw * z;
+		out[i].world_pos.x = x + 2.f * (ry * cz - rz * cy) + tx;
+		out[i].world_pos.y = y + 2.f * (rz * cx - rx * cz) + ty;
+		out[i].world_pos.z = z + 2.f * (rx * cy - ry * cx) + tz;
+
+		// Normals take the inverse scale, up to a factor that the renormalization removes
+		x = skin.nrm_x[i] * b[9] * b[10], y = skin.nrm_y[i] * b[8] * b[10], z = skin.nrm_z[i] * b[8] * b[9];
+		cx = ry * z - rz * y + rw * x;
+		cy = rz * x - rx * z + rw * y;
+		cz = rx * y - ry * x + rw * z;
+		float nx = x + 2.f * (ry * cz - rz * cy);
+		float ny = y + 2.f * (rz * cx - rx * cz);
+		float nz = z + 2.f * (rx * cy - ry * cx);
+		length = max(sqrt(nx * nx + ny * ny + nz * nz), kMinNormalLength);
+		out[i].normal.x = nx / length;
+		out[i].normal.y = ny / length;
+		out[i].normal.z = nz / length;
+	}
+}
+
+// Same layout as skinVerticesSSE, 4 vertices per iteration with one palette entry per register
+void skinVerticesDualQuatSSE(const SkinData& skin, const float* palette, int begin, int end, Vertex* out)
+{
+#if defined(SKINNING_HAS_SSE)
+	const __m128 sign_bit = _mm_set1_ps(-0.f);
+	const __m128 two = _mm_set1_ps(2.f);
+
+	int i = begin;
+	for (; i + 4 <= end; i += 4)
+	{
+		const int* index = &skin.bone_index[i * kMaxInfluences];
+
+		__m128 w[kMaxInfluences];
+		w[0] = _mm_loadu_ps(&skin.bone_weight[i * kMaxInfluences]);
+		w[1] = _mm_loadu_ps(&skin.bone_weight[i * kMaxInfluences + 4]);
+		w[2] = _mm_loadu_ps(&skin.bone_weight[i * kMaxInfluences + 8]);
+		w[3] = _mm_loadu_ps(&skin.bone_weight[i * kMaxInfluences + 12]);
+		_MM_TRANSPOSE4_PS(w[0], w[1], w[2], w[3]);
+
+		__m128 b[kPaletteStride], first[4];
+		for (int k = 0; k < kPaletteStride; ++k)
+			b[k] = _mm_setzero_ps();
+
+		for (int j = 0; j < kMaxInfluences; ++j)
+		{
+			const float* b0 = palette + index[j] * kPaletteStride;
+			const float* b1 = palette + index[kMaxInfluences + j] * kPaletteStride;
+			const float* b2 = palette + index[2 * kMaxInfluences + j] * kPaletteStride;
+			const float* b3 = palette + index[3 * kMaxInfluences + j] * kPaletteStride;
+
+			__m128 c[kPaletteStride];
+			for (int r = 0; r < 3; ++r)
+			{
+				c[r * 4] = _mm_loadu_ps(b0 + r * 4);
+				c[r * 4 + 1] = _mm_loadu_ps(b1 + r * 4);
+				c[r * 4 + 2] = _mm_loadu_ps(b2 + r * 4);
+				c[r * 4 + 3] = _mm_loadu_ps(b3 + r * 4);
+				_MM_TRANSPOSE4_PS(c[r * 4], c[r * 4 + 1], c[r * 4 + 2], c[r * 4 + 3]);
+			}
+			if (j == 0)
+			{
+				for (int k = 0; k < 4; ++k)
+					first[k] = c[k];
+			}
+
+			__m128 dot = _mm_add_ps(_mm_add_ps(_mm_mul_ps(c[0], first[0]), _mm_mul_ps(c[1], first[1])),
+				_mm_add_ps(_mm_mul_ps(c[2], first[2]), _mm_mul_ps(c[3], first[3])));
+			__m128 wq = _mm_xor_ps(w[j], _mm_and_ps(_mm_cmplt_ps(dot, _mm_setzero_ps()), sign_bit));
+			for (int k = 0; k < 8; ++k)
+				b[k] = _mm_add_ps(b[k], _mm_mul_ps(c[k], wq));
+			for (int k = 8; k < kPaletteStride; ++k)
+				b[k] = _mm_add_ps(b[k], _mm_mul_ps(c[k], w[j]));
+		}
+
+		__m128 length = _mm_add_ps(_mm_add_ps(_mm_mul_ps(b[0], b[0]), _mm_mul_ps(b[1], b[1])),
+			_mm_add_ps(_mm_mul_ps(b[2], b[2]), _mm_mul_ps(b[3], b[3])));
+		__m128 inv = _mm_div_ps(_mm_set1_ps(1.f), _mm_max_ps(_mm_sqrt_ps(length), _mm_set1_ps(kMinNormalLength)));
+		__m128 rx = _mm_mul_ps(b[0], inv), ry = _mm_mul_ps(b[1], inv), rz = _mm_mul_ps(b[2], inv), rw = _mm_mul_ps(b[3], inv);
+		__m128 dx = _mm_mul_ps(b[4], inv), dy = _mm_mul_ps(b[5], inv), dz = _mm_mul_ps(b[6], inv), dw = _mm_mul_ps(b[7], inv);
+
+		__m128 tx = _mm_mul_ps(two, _mm_add_ps(_mm_sub_ps(_mm_mul_ps(rw, dx), _mm_mul_ps(dw, rx)),
+			_mm_sub_ps(_mm_mul_ps(ry, dz), _mm_mul_ps(rz, dy))));
+		__m128 ty = _mm_mul_ps(two, _mm_add_ps(_mm_sub_ps(_mm_mul_ps(rw, dy), _mm_mul_ps(dw, ry)),
+			_mm_sub_ps(_mm_mul_ps(rz, dx), _mm_mul_ps(rx, dz))));
+		__m128 tz = _mm_mul_ps(two, _mm_add_ps(_mm_sub_ps(_mm_mul_ps(rw, dz), _mm_mul_ps(dw, rz)),
+			_mm_sub_ps(_mm_mul_ps(rx, dy), _mm_mul_ps(ry, dx))));
+
+		// Rotate the scaled position and the inversely scaled normal by r
+		__m128 v[2][3] = {
+			{_mm_mul_ps(_mm_loadu_ps(&skin.pos_x[i]), b[8]), _mm_mul_ps(_mm_loadu_ps(&skin.pos_y[i]), b[9]),
+				_mm_mul_ps(_mm_loadu_ps(&skin.pos_z[i]), b[10])},
+			{_mm_mul_ps(_mm_loadu_ps(&skin.nrm_x[i]), _mm_mul_ps(b[9], b[10])),
+				_mm_mul_ps(_mm_loadu_ps(&skin.nrm_y[i]), _mm_mul_ps(b[8], b[10])),
+				_mm_mul_ps(_mm_loadu_ps(&skin.nrm_z[i]), _mm_mul_ps(b[8], b[9]))}
+		};
+		for (auto& p : v)
+		{
+			__m128 cx = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(ry, p[2]), _mm_mul_ps(rz, p[1])), _mm_mul_ps(rw, p[0]));
+			__m128 cy = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(rz, p[0]), _mm_mul_ps(rx, p[2])), _mm_mul_ps(rw, p[1]));
+			__m128 cz = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(rx, p[1]), _mm_mul_ps(ry, p[0])), _mm_mul_ps(rw, p[2]));
+			p[0] = _mm_add_ps(p[0], _mm_mul_ps(two, _mm_sub_ps(_mm_mul_ps(ry, cz), _mm_mul_ps(rz, cy))));
+			p[1] = _mm_add_ps(p[1], _mm_mul_ps(two, _mm_sub_ps(_mm_mul_ps(rz, cx), _mm_mul_ps(rx, cz))));
+			p[2] = _mm_add_ps(p[2], _mm_mul_ps(two, _mm_sub_ps(_mm_mul_ps(rx, cy), _mm_mul_ps(ry, cx))));
+		}
+
+		float res[3][4];
+		_mm_storeu_ps(res[0], _mm_add_ps(v[0][0], tx));
+		_mm_storeu_ps(res[1], _mm_add_ps(v[0][1], ty));
+		_mm_storeu_ps(res[2], _mm_add_ps(v[0][2], tz));
+
+		__m128 n[3] = {v[1][0], v[1][1], v[1][2]};
+		length = _mm_add_ps(_mm_add_ps(_mm_mul_ps(n[0], n[0]), _mm_mul_ps(n[1], n[1])), _mm_mul_ps(n[2], n[2]));
+		length = _mm_max_ps(_mm_sqrt_ps(length), _mm_set1_ps(kMinNormalLength));
+		float nrm[3][4];
+		for (int r = 0; r < 3; ++r)
+			_mm_storeu_ps(nrm[r], _mm_div_ps(n[r], length));
+
+		for (int l = 0; l < 4; ++l)
+		{
+			out[i + l].world_pos.x = res[0][l];
+			out[i + l].world_pos.y = res[1][l];
+			out[i + l].world_pos.z = res[2][l];
+			out[i + l].normal.x = nrm[0][l];
+			out[i + l].normal.y = nrm[1][l];
+			out[i + l].normal.z = nrm[2][l];
+		}
+	}
+	skinVerticesDualQuatScalar(skin, palette, i, end, out);
+#else
+	skinVerticesDualQuatScalar(skin, palette, begin, end, out);
+#endif
+}
+
+// 8 vertices per iteration, palette entries are fetched with gathers like skinVerticesAVX2
+SKINNING_TARGET_AVX2 void skinVerticesDualQuatAVX2(const SkinData& skin, const float* palette, int begin, int end, Vertex* out)
+{
+#if defined(SKINNING_HAS_AVX2)
+	const __m256i slot_offsets = _mm256_setr_epi32(0, 4, 8, 12, 16, 20, 24, 28);
+	const __m256i stride = _mm256_set1_epi32(kPaletteStride);
+	const __m256 sign_bit = _mm256_set1_ps(-0.f);
+	const __m256 two = _mm256_set1_ps(2.f);
+
+	int i = begin;
+	for (; i + 8 <= end; i += 8)
+	{
+		__m256 b[kPaletteStride], first[4];
+		for (int k = 0; k < kPaletteStride; ++k)
+			b[k] = _mm256_setzero_ps();
+
+		for (int j = 0; j < kMaxInfluences; ++j)
+		{
+			__m256 w = _mm256_i32gather_ps(&skin.bone_weight[i * kMaxInfluences + j], slot_offsets, 4);
+			__m256i index = _mm256_i32gather_epi32(&skin.bone_index[i * kMaxInfluences + j], slot_offsets, 4);
+			__m256i base = _mm256_mullo_epi32(index, stride);
+
+			__m256 c[kPaletteStride];
+			for (int k = 0; k < kPaletteStride; ++k)
+				c[k] = _mm256_i32gather_ps(palette + k, base, 4);
+			if (j == 0)
+			{
+				for (int k = 0; k < 4; ++k)
+					first[k] = c[k];
+			}
+
+			__m256 dot = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(c[0], first[0]), _mm256_mul_ps(c[1], first[1])),
+				_mm256_add_ps(_mm256_mul_ps(c[2], first[2]), _mm256_mul_ps(c[3], first[3])));
+			__m256 wq = _mm256_xor_ps(w, _mm256_and_ps(_mm256_cmp_ps(dot, _mm256_setzero_ps(), _CMP_LT_OQ), sign_bit));
+			for (int k = 0; k < 8; ++k)
+				b[k] = _mm256_add_ps(b[k], _mm256_mul_ps(c[k], wq));
+			for (int k = 8; k < kPaletteStride; ++k)
+				b[k] = _mm256_add_ps(b[k], _mm256_mul_ps(c[k], w));
+		}
+
+		__m256 length = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(b[0], b[0]), _mm256_mul_ps(b[1], b[1])),
+			_mm256_add_ps(_mm256_mul_ps(b[2], b[2]), _mm256_mul_ps(b[3], b[3])));
+		__m256 inv = _mm256_div_ps(_mm256_set1_ps(1.f), _mm256_max_ps(_mm256_sqrt_ps(length), _mm256_set1_ps(kMinNormalLength)));
+		__m256 rx = _mm256_mul_ps(b[0], inv), ry = _mm256_mul_ps(b[1], inv);
+		__m256 rz = _mm256_mul_ps(b[2], inv), rw = _mm256_mul_ps(b[3], inv);
+		__m256 dx = _mm256_mul_ps(b[4], inv), dy = _mm256_mul_ps(b[5], inv);
+		__m256 dz = _mm256_mul_ps(b[6], inv), dw = _mm256_mul_ps(b[7], inv);
+
+		__m256 tx = _mm256_mul_ps(two, _mm256_add_ps(_mm256_sub_ps(_mm256_mul_ps(rw, dx), _mm256_mul_ps(dw, rx)),
+			_mm256_sub_ps(_mm256_mul_ps(ry, dz), _mm256_mul_ps(rz, dy))));
+		__m256 ty = _mm256_mul_ps(two, _mm256_add_ps(_mm256_sub_ps(_mm256_mul_ps(rw, dy), _mm256_mul_ps(dw, ry)),
+			_mm256_sub_ps(_mm256_mul_ps(rz, dx), _mm256_mul_ps(rx, dz))));
+		__m256 tz = _mm256_mul_ps(two, _mm256_add_ps(_mm256_sub_ps(_mm256_mul_ps(rw, dz), _mm256_mul_ps(dw, rz)),
+			_mm256_sub_ps(_mm256_mul_ps(rx, dy), _mm256_mul_ps(ry, dx))));
+
+		__m256 v[2][3] = {
+			{_mm256_mul_ps(_mm256_loadu_ps(&skin.pos_x[i]), b[8]), _mm256_mul_ps(_mm256_loadu_ps(&skin.pos_y[i]), b[9]),
+				_mm256_mul_ps(_mm256_loadu_ps(&skin.pos_z[i]), b[10])},
+			{_mm256_mul_ps(_mm256_loadu_ps(&skin.nrm_x[i]), _mm256_mul_ps(b[9], b[10])),
+				_mm256_mul_ps(_mm256_loadu_ps(&skin.nrm_y[i]), _mm256_mul_ps(b[8], b[10])),
+				_mm256_mul_ps(_mm256_loadu_ps(&skin.nrm_z[i]), _mm256_mul_ps(b[8], b[9]))}
+		};
+		for (auto& p : v)
+		{
+			__m256 cx = _mm256_add_ps(_mm256_sub_ps(_mm256_mul_ps(ry, p[2]), _mm256_mul_ps(rz, p[1])), _mm256_mul_ps(rw, p[0]));
+			__m256 cy = _mm256_add_ps(_mm256_sub_ps(_mm256_mul_ps(rz, p[0]), _mm256_mul_ps(rx, p[2])), _mm256_mul_ps(rw, p[1]));
+			__m256 cz = _mm256_add_ps(_mm256_sub_ps(_mm256_mul_ps(rx, p[1]), _mm256_mul_ps(ry, p[0])), _mm256_mul_ps(rw, p[2]));
+			p[0] = _mm256_add_ps(p[0], _mm256_mul_ps(two, _mm256_sub_ps(_mm256_mul_ps(ry, cz), _mm256_mul_ps(rz, cy))));
+			p[1] = _mm256_add_ps(p[1], _mm256_mul_ps(two, _mm256_sub_ps(_mm256_mul_ps(rz, cx), _mm256_mul_ps(rx, cz))));
+			p[2] = _mm256_add_ps(p[2], _mm256_mul_ps(two, _mm256_sub_ps(_mm256_mul_ps(rx, cy), _mm256_mul_ps(ry, cx))));
+		}
+
+		float res[3][8];
+		_mm256_storeu_ps(res[0], _mm256_add_ps(v[0][0], tx));
+		_mm256_storeu_ps(res[1], _mm256_add_ps(v[0][1], ty));
+		_mm256_storeu_ps(res[2], _mm256_add_ps(v[0][2], tz));
+
+		__m256 n[3] = {v[1][0], v[1][1], v[1][2]};
+		length = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(n[0], n[0]), _mm256_mul_ps(n[1], n[1])),
+			_mm256_mul_ps(n[2], n[2]));
+		length = _mm256_max_ps(_mm256_sqrt_ps(length), _mm256_set1_ps(kMinNormalLength));
+		float nrm[3][8];
+		for (int r = 0; r < 3; ++r)
+			_mm256_storeu_ps(nrm[r], _mm256_div_ps(n[r], length));
+
+		for (int l = 0; l < 8; ++l)
+		{
+			out[i + l].world_pos.x = res[0][l];
+			out[i + l].world_pos.y = res[1][l];
+			out[i + l].world_pos.z = res[2][l];
+			out[i + l].normal.x = nrm[0][l];
+			out[i + l].normal.y = nrm[1][l];
+			out[i + l].normal.z = nrm[2][l];
+		}
+	}
+	_mm256_zeroupper();
+	skinVerticesDualQuatSSE(skin, palette, i, end, out);
+#else
+	skinVerticesDualQuatSSE(skin, palette, begin, end, out);
+#endif
+}
+
+void skinVertices(SkinningKernel kernel, SkinningMethod method, const SkinData& skin, const float* palette,
+	int begin, int end, Vertex* out)
+{
+	if (method == SkinningMethod::DUAL_QUATERNION)
+	{
+		switch (kernel)
+		{
+		case SkinningKernel::AVX2:
+			skinVerticesDualQuatAVX2(skin, palette, begin, end, out);
+			break;
+		case SkinningKernel::SSE:
+			skinVerticesDualQuatSSE(skin, palette, begin, end, out);
+			break;
+		default:
+			skinVerticesDualQuatScalar(skin, palette, begin, end, out);
+			break;
+		}
+		return;
+	}
+
+	switch (kernel)
+	{
+	case SkinningKernel::AVX2:
+		skinVerticesAVX2(skin, palette, begin, end, out);
+		break;
+	case SkinningKernel::SSE:
+		skinVerticesSSE(skin, palette, begin, end, out);
+		break;
+	default:
+		skinVerticesScalar(skin, palette, begin, end, out);
+		break;
+	}
+}
+
+// Returns the first vertex whose position or normal differs by more than tolerance, -1 if none.
+// Positions are compared relative to their distance from the origin.
+static int findSkinningMismatch(const vector<Vertex>& expected, const vector<Vertex>& actual, float tolerance,
+	const vector<char>* compare = nullptr)
+{
+	for (int i = 0; i < expected.size(); ++i)
+	{
+		if (compare != nullptr && !(*compare)[i])
+			continue;
+
+		float scale = max(1.f, expected[i].world_pos.Length());
+		if ((expected[i].world_pos - actual[i].world_pos).Length() > tolerance * scale)
+			return i;
+		if ((expected[i].normal - actual[i].normal).Length() > tolerance)
+			return i;
+	}
+	return -1;
+}
+
+// Deterministic rigid transformations with a mild non uniform scale
+static vector<Bone> syntheticBones(int num_bones, bool scaled)
+{
+	vector<Bone> bones(num_bones);
+	for (int i = 0; i < num_bones; ++i)
+	{
+		aiVector3D axis(sin(i * 0.7f + 0.2f), cos(i * 1.3f), sin(i * 0.3f + 1.f));
+		aiQuaternion rotation(axis.Normalize(), i * 0.9f + 0.3f);
+		aiVector3D position(sin(i * 0.5f) * 3.f, cos(i * 0.8f) * 2.f, sin(i * 1.1f + 0.4f));
+		aiVector3D scale(1.f, 1.f, 1.f);
+		if (scaled)
+			scale = aiVector3D(1.f + 0.2f * sin(i * 1.7f), 1.f + 0.1f * cos(i * 0.9f), 0.9f);
+		bones[i].final_transformation = Affine3x4(scale, rotation, position);
+	}
+	return bones;
+}
+
+bool verifySkinningKernel(SkinningKernel kernel, const SkinData& skin, int num_bones, float tolerance)
+{
+	if (kernel == SkinningKernel::SCALAR || skin.num_vertices == 0 || num_bones == 0)
+		return true;
+
+	// Arbitrary but deterministic affine matrices, so that every entry matters
+	vector<float> palette(num_bones * kPaletteStride);
+	for (int i = 0; i < palette.size(); ++i)
+		palette[i] = sin(i * 0.37f + 0.1f) * 2.f;
+
+	vector<float> dual_quat_palette;
+	buildDualQuatPalette(syntheticBones(num_bones, true), dual_quat_palette);
+
+	vector<Vertex> expected(skin.num_vertices), actual(skin.num_vertices);
+	for (SkinningMethod method : {SkinningMethod::LINEAR, SkinningMethod::DUAL_QUATERNION})
+	{
+		const float* p = method == SkinningMethod::LINEAR ? palette.data() : dual_quat_palette.data();
+		skinVertices(SkinningKernel::SCALAR, method, skin, p, 0, skin.num_vertices, expected.data());
+		skinVertices(kernel, method, skin, p, 0, skin.num_vertices, actual.data());
+
+		int i = findSkinningMismatch(expected, actual, tolerance);
+		if (i >= 0)
+		{
+			cerr << skinningKernelName(kernel) << (method == SkinningMethod::LINEAR ? " linear blend" : " dual quaternion")
+				<< " skinning differs from scalar path at vertex " << i << endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+bool verifyDualQuatSkinning(const SkinData& skin, int num_bones, float tolerance)
+{
+	if (skin.num_vertices == 0 || num_bones == 0)
+		return true;
+
+	vector<Vertex> linear(skin.num_vertices), dual_quat(skin.num_vertices);
+	vector<float> palette;
+	auto skinBoth = [&](const vector<Bone>& bones)
+	{
+		buildBonePalette(bones, palette);
+		skinVerticesScalar(skin, palette.data(), 0, skin.num_vertices, linear.data());
+		buildDualQuatPalette(bones, palette);
+		skinVerticesDualQuatScalar(skin, palette.data(), 0, skin.num_vertices, dual_quat.data());
+	};
+
+	// The whole mesh moves as one rigid body
+	vector<Bone> bones = syntheticBones(num_bones, false);
+	for (auto& bone : bones)
+		bone.final_transformation = bones[0].final_transformation;
+	skinBoth(bones);
+	int i = findSkinningMismatch(linear, dual_quat, tolerance);
+
+	// Every bone moves differently, vertices with a single influence still move rigidly
+	if (i < 0)
+	{
+		vector<char> single(skin.num_vertices);
+		for (int v = 0; v < skin.num_vertices; ++v)
+			single[v] = skin.bone_weight[v * kMaxInfluences] == 1.f;
+		skinBoth(syntheticBones(num_bones, false));
+		i = findSkinningMismatch(linear, dual_quat, tolerance, &single);
+	}
+
+	if (i >= 0)
+	{
+		cerr << "dual quaternion skinning differs from linear blend skinning on a rigid pose at vertex " << i << endl;
+		return false;
+	}
+	return true;
+}
+
+void calBounds(const Vertex* vertices, int begin, int end, aiVector3D& aabb_min, aiVector3D& aabb_max)
+{
+	aabb_min = aabb_max = vertices[begin].world_pos;
+	for (int i = begin + 1; i < end; ++i)
+	{
+		const aiVector3D& pos = vertices[i].world_pos;
+		aabb_min.x = min(aabb_min.x, pos.x);
+		aabb_min.y = min(aabb_min.y, pos.y);
+		aabb_min.z = min(aabb_min.z, pos.z);
+
+		aabb_max.x = max(aabb_max.x, pos.x);
+		aabb_max.y = max(aabb_max.y, pos.y);
+		aabb_max.z = max(aabb_max.z, pos.z);
+	}
+}
+
+// Rotation and scale of a bone transformation, the parts packDualQuat blends
+static void rotationScale(const Affine3x4& transformation, aiQuaternion& rotation, aiVector3D& scale)
+{
+	aiVector3D t;
+	transformation.toMatrix4().Decompose(scale, rotation, t);
+}
+
+// final(b) is the transformation of bone b
+template <class Finals>
+static void calPoseBounds(const SkinData& skin, Finals final, SkinningMethod method, aiVector3D& aabb_min, aiVector3D& aabb_max)
+{
+	aabb_min = aiVector3D(1e10f, 1e10f, 1e10f);
+	aabb_max = aiVector3D(-1e10f, -1e10f, -1e10f);
+	for (int b = 0; b < skin.bone_aabb_min.size(); ++b)
+	{
+		const aiVector3D& lo = skin.bone_aabb_min[b];
+		const aiVector3D& hi = skin.bone_aabb_max[b];
+		if (lo.x > hi.x)
+			continue;
+
+		// Center and half extent of the box moved by the bone
+		const float* m = final(b).data();
+		aiVector3D center = (lo + hi) * 0.5f, half = (hi - lo) * 0.5f;
+		for (int r = 0; r < 3; ++r)
+		{
+			const float* row = m + r * 4;
+			float c = row[0] * center.x + row[1] * center.y + row[2] * center.z + row[3];
+			float e = abs(row[0]) * half.x + abs(row[1]) * half.y + abs(row[2]) * half.z;
+			aabb_min[r] = min(aabb_min[r], c - e);
+			aabb_max[r] = max(aabb_max[r], c + e);
+		}
+	}
+
+	if (method != SkinningMethod::DUAL_QUATERNION || aabb_min.x > aabb_max.x || skin.influence_pairs.empty())
+		return;
+
+	// Dual quaternion skinning moves a vertex p to vec(sum w_i x_i u_i), where x_i is p
+	// scaled by the blended scale and moved rigidly by bone i, b is the blend of the
+	// rotations q_i and u_i = q_i conj(b) / |b|^2. The u_i sum to 1 and |u_i - 1| is
+	// |q_i - b| / |b|, so the vertex is at most max |x_i - x_j| * min(1, max |q_i - b|) / |b|
+	// away from the weighted average of the x_i. That average is inside the box above but
+	// for the scales. Through the first influence of the vertex: |b| >= kappa, the least
+	// |q_first . q_other|, and |q_i - b| <= 2 sqrt(2 - 2 kappa). The x_i differ by at most
+	// spread when scaled the same, and the blended scale moves them by up to 2 scaled.
+	float kappa = 1.f, spread = 0.f, scaled = 0.f;
+	for (int i = 0; i < skin.influence_pairs.size(); ++i)
+	{
+		const Affine3x4& first = final(skin.influence_pairs[i].first);
+		const Affine3x4& other = final(skin.influence_pairs[i].second);
+		aiQuaternion q1, q2;
+		aiVector3D s1, s2;
+		rotationScale(first, q1, s1);
+		rotationScale(other, q2, s2);
+		kappa = min(kappa, abs(q1.x * q2.x + q1.y * q2.y + q1.z * q2.z + q1.w * q2.w));
+
+		const aiVector3D& lo = skin.pair_aabb_min[i];
+		const aiVector3D& hi = skin.pair_aabb_max[i];
+		aiVector3D center = (lo + hi) * 0.5f;
+		aiVector3D farthest(max(abs(lo.x), abs(hi.x)), max(abs(lo.y), abs(hi.y)), max(abs(lo.z), abs(hi.z)));
+		scaled = max(scaled, max(abs(s1.x - s2.x), max(abs(s1.y - s2.y), abs(s1.z - s2.z))) * farthest.Length());
+
+		// The two transformations differ by at most this much over the box of the pair
+		aiVector3D moved;
+		float linear = 0.f;
+		for (int r = 0; r < 3; ++r)
+		{
+			float d[4];
+			for (int c = 0; c < 4; ++c)
+				d[c] = first.data()[r * 4 + c] - other.data()[r * 4 + c];
+			moved[r] = d[0] * center.x + d[1] * center.y + d[2] * center.z + d[3];
+			linear += d[0] * d[0] + d[1] * d[1] + d[2] * d[2];
+		}
+		spread = max(spread, moved.Length() + sqrt(linear) * ((hi - lo) * 0.5f).Length());
+	}
+
+	float distance = 2.f * (spread + 4.f * scaled);
+	float margin = 2.f * scaled + distance * min(1.f, 2.f * sqrt(max(0.f, 2.f - 2.f * kappa))) / max(kappa, 1e-6f);
+	aabb_min -= aiVector3D(margin, margin, margin);
+	aabb_max += aiVector3D(margin, margin, margin);
+}
+
+void calPoseBounds(const SkinData& skin, const Affine3x4* finals, SkinningMethod method,
+	aiVector3D& aabb_min, aiVector3D& aabb_max)
+{
+	calPoseBounds(skin, [finals](int b) -> const Affine3x4& { return finals[b]; }, method, aabb_min, aabb_max);
+}
+
+void calPoseBounds(const SkinData& skin, const vector<Bone>& bones, SkinningMethod method,
+	aiVector3D& aabb_min, aiVector3D& aabb_max)
+{
+	// A mesh without bones is skinned with an identity palette
+	Affine3x4 identity;
+	calPoseBounds(skin, [&bones, &identity](int b) -> const Affine3x4& { return b < bones.size() ? bones[b].final_transformation : identity; },
+		method, aabb_min, aabb_max);
+}
+
+// Mark the vertices influenced by moved bones, returns the number of marked vertices
+static int markDirtyVertices(Mesh& mesh)
+{
+	const SkinData& skin = mesh.skin;
+	mesh.vertex_dirty.resize(skin.num_vertices, 0);
+
+	int num_dirty = 0;
+	for (int b : mesh.moved_bones)
+	{
+		mesh.bones[b].moved = false;
+		for (int i = skin.bone_vertex_offset[b]; i < skin.bone_vertex_offset[b + 1]; ++i)
+		{
+			char& dirty = mesh.vertex_dirty[skin.bone_vertices[i]];
+			num_dirty += !dirty;
+			dirty = 1;
+		}
+	}
+	mesh.moved_bones.clear();
+	return num_dirty;
+}
+
+// Every chunk skins its vertices and computes a partial aabb, the partial
+// boxes are then reduced into the aabb of the mesh.
+// Only vertices influenced by bones that moved since the last call are skinned,
+// chunks without such vertices keep their positions and partial aabb.
+void processVertices(Mesh& mesh)
+{
+	int num_vertices = mesh.skin.num_vertices;
+	if (num_vertices == 0 || mesh.moved_bones.empty())
+		return;
+
+	if (mesh.skinning_method == SkinningMethod::DUAL_QUATERNION)
+		buildDualQuatPalette(mesh.bones, mesh.palette);
+	else
+		buildBonePalette(mesh.bones, mesh.palette);
+
+	int num_chunks = WorkerPool::numChunks(num_vertices, kSkinningChunkSize);
+	bool full = mesh.chunk_aabb_min.size() != num_chunks || mesh.moved_bones.size() == mesh.bones.size();
+	if (full)
+	{
+		for (int b : mesh.moved_bones)
+			mesh.bones[b].moved = false;
+		mesh.moved_bones.clear();
+		mesh.vertex_dirty.assign(num_vertices, 0);
+	}
+	else
+	{
+		// Not worth scanning for runs if most of the mesh moved
+		full = markDirtyVertices(mesh) * 2 > num_vertices;
+	}
+
+	mesh.chunk_aabb_min.resize(num_chunks);
+	mesh.chunk_aabb_max.resize(num_chunks);
+
+	WorkerPool::Instance()->parallelFor(num_vertices, kSkinningChunkSize, [&mesh, full](int chunk, int begin, int end)
+	{
+		const float* palette = mesh.palette.data();
+		if (full)
+		{
+			skinVertices(skinning_kernel, mesh.skinning_method, mesh.skin, palette, begin, end, mesh.vertices.data());
+		}
+		else
+		{
+			// Skin contiguous runs of dirty vertices
+			bool touched = false;
+			char* dirty = mesh.vertex_dirty.data();
+			for (int i = begin; i < end; )
+			{
+				if (!dirty[i])
+				{
+					++i;
+					continue;
+				}
+				int j = i;
+				while (j < end && dirty[j])
+					++j;
+				skinVertices(skinning_kernel, mesh.skinning_method, mesh.skin, palette, i, j, mesh.vertices.data());
+				touched = true;
+				i = j;
+			}
+			if (!touched)
+				return;
+		}
+
+		fill(mesh.vertex_dirty.begin() + begin, mesh.vertex_dirty.begin() + end, 0);
+		calBounds(mesh.vertices.data(), begin, end, mesh.chunk_aabb_min[chunk], mesh.chunk_aabb_max[chunk]);
+	});
+
+	mesh.aabb_min = mesh.chunk_aabb_min[0];
+	mesh.aabb_max = mesh.chunk_aabb_max[0];
+	for (int i = 1; i < num_chunks; ++i)
+	{
+		mesh.aabb_min.x = min(mesh.aabb_min.x, mesh.chunk_aabb_min[i].x);
+		mesh.aabb_min.y = min(mesh.aabb_min.y, mesh.chunk_aabb_min[i].y);
+		mesh.aabb_min.z = min(mesh.aabb_min.z, mesh.chunk_aabb_min[i].z);
+
+		mesh.aabb_max.x = max(mesh.aabb_max.x, mesh.chunk_aabb_max[i].x);
+		mesh.aabb_max.y = max(mesh.aabb_max.y, mesh.chunk_aabb_max[i].y);
+		mesh.aabb_max.z = max(mesh.aabb_max.z, mesh.chunk_aabb_max[i].z);
+	}
+}
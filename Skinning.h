@@ -0,0 +1,70 @@
+#pragma once
+
+#include <vector>
+#include "ModelHelper.h"
+
+// Skinning kernels working on the packed SkinData of a mesh.
+// For linear blend skinning the palette holds the Affine3x4 final transformation
+// of every bone, 12 floats of a row-major 3x4 matrix. For dual quaternion skinning every bone takes the same
+// 12 floats: the rotation quaternion (x y z w), the dual part (x y z w) and the
+// scale (x y z 0), which is blended linearly and applied before the rotation.
+
+enum class SkinningKernel
+{
+	SCALAR, SSE, AVX2
+};
+
+constexpr int kPaletteStride = 12;
+
+// Number of vertices handed to a worker at once
+constexpr int kSkinningChunkSize = 2048;
+
+// The kernel used by processVertices, picked at load time by ModelHelper
+extern SkinningKernel skinning_kernel;
+
+// Best kernel this build and CPU support
+SkinningKernel bestSkinningKernel();
+const char* skinningKernelName(SkinningKernel kernel);
+
+void buildBonePalette(const std::vector<Bone>& bones, std::vector<float>& palette);
+void buildDualQuatPalette(const std::vector<Bone>& bones, std::vector<float>& palette);
+void buildDualQuatPalette(const std::vector<Affine3x4>& transformations, std::vector<float>& palette);
+
+// An array of Affine3x4 is a linear blend skinning palette as it is
+static_assert(sizeof(Affine3x4) == kPaletteStride * sizeof(float), "Affine3x4 has to match the palette layout");
+
+// Skin vertices [begin, end) and write the results to out[i].world_pos and out[i].normal
+void skinVerticesScalar(const SkinData& skin, const float* palette, int begin, int end, Vertex* out);
+void skinVerticesSSE(const SkinData& skin, const float* palette, int begin, int end, Vertex* out);
+void skinVerticesAVX2(const SkinData& skin, const float* palette, int begin, int end, Vertex* out);
+void skinVerticesDualQuatScalar(const SkinData& skin, const float* palette, int begin, int end, Vertex* out);
+void skinVerticesDualQuatSSE(const SkinData& skin, const float* palette, int begin, int end, Vertex* out);
+void skinVerticesDualQuatAVX2(const SkinData& skin, const float* palette, int begin, int end, Vertex* out);
+void skinVertices(SkinningKernel kernel, SkinningMethod method, const SkinData& skin, const float* palette,
+	int begin, int end, Vertex* out);
+
+// Run the given kernel and the scalar reference of both methods on a synthetic
+// palette and check that they agree within tolerance
+bool verifySkinningKernel(SkinningKernel kernel, const SkinData& skin, int num_bones, float tolerance = 1e-4f);
+
+// Dual quaternion skinning has to reproduce linear blend skinning on rigid poses:
+// when all bones share one transformation, and for vertices with a single influence
+bool verifyDualQuatSkinning(const SkinData& skin, int num_bones, float tolerance = 1e-4f);
+
+// Bounding box of out[begin, end)
+void calBounds(const Vertex* vertices, int begin, int end, aiVector3D& aabb_min, aiVector3D& aabb_max);
+
+// Box around skin as it would be skinned with the bone transformations finals, found
+// without skinning it: the bind pose box of every bone is moved by its transformation.
+// Linear blend skinning keeps every vertex inside. Dual quaternion skinning can bulge
+// out, the box is grown by a bound on that from the bones of skin.influence_pairs, which
+// is loose for bones that turn far apart but always holds. Lets culling skip the skinning.
+void calPoseBounds(const SkinData& skin, const Affine3x4* finals, SkinningMethod method,
+	aiVector3D& aabb_min, aiVector3D& aabb_max);
+void calPoseBounds(const SkinData& skin, const std::vector<Bone>& bones, SkinningMethod method,
+	aiVector3D& aabb_min, aiVector3D& aabb_max);
+
+// Update the position in world space for each vertex influenced by a moved bone
+// and the aabb of the mesh, the vertex range is split into chunks and skinned
+// on the worker pool
+void processVertices(Mesh& mesh);
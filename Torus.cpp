@@ -1,6 +1,8 @@
 #include "Torus.h"
 #include <FL/gl.h>
 #include "modelerdraw.h"
+#include <algorithm>
+#include <cmath>
 
 using namespace std;
 
@@ -63,6 +65,19 @@ void Torus::pointRZ(double rz) {
 	tempy = y;
 }
 
+float Torus::boundingRadius(float ring_long, float ring_short, float tube_long, float tube_short, bool flower) {
+	// Half a chord plus the distance of its middle from the center is at most sqrt(2) times the ring radius
+	float ring = max(abs(ring_long), abs(ring_short)) * (flower ? sqrt(2.f) : 1.f) + abs(tube_long);
+	return sqrt(ring * ring + tube_short * tube_short);
+}
+
+bool Torus::visible(const Frustum& frustum) const {
+	// The ring is rotated and moved, the petals stay around the origin
+	if (frustum.sphereVisible(aiVector3D(positionX, positionY, positionZ), boundingRadius(ringLongRadius, ringShortRadius, tubeLongRadius, tubeShortRadius, false)))
+		return true;
+	return enableFlower && frustum.sphereVisible(aiVector3D(), boundingRadius(ringLongRadius, ringShortRadius, tubeLongRadius, tubeShortRadius, true));
+}
+
 void Torus::draw() {
 	double ringStep = 2 * M_PI / ringVertex;
 	double tubeStep = 2 * M_PI / tubeVertex;
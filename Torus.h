@@ -2,6 +2,7 @@
 
 #include <string>
 #include <map>
+#include "Frustum.h"
 
 class Torus {
 public:
@@ -9,6 +10,14 @@ public:
 	void getPoint(double ringAngle, double tubeAngle);
 	void getFlowerPoint(double petalAngel, double tubeAngle);
 	void draw();
+
+	// False if neither the ring nor the petals can be inside frustum
+	bool visible(const Frustum& frustum) const;
+
+	// Radius of a sphere around a ring with these radii, centered like it. The petals
+	// of a flower reach further out, a petal spans a whole chord between two of them.
+	static float boundingRadius(float ring_long, float ring_short, float tube_long, float tube_short, bool flower);
+
 	void transPoint(double x, double y, double z);
 	void pointRX(double rx);
 	void pointRY(double ry);
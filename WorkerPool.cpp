@@ -0,0 +1,97 @@
+#include "WorkerPool.h"
+
+#include <algorithm>
+
+using namespace std;
+
+WorkerPool* WorkerPool::Instance()
+{
+	static WorkerPool pool;
+	return &pool;
+}
+
+WorkerPool::WorkerPool()
+{
+	int num_workers = int(thread::hardware_concurrency()) - 1;
+	for (int i = 0; i < num_workers; ++i)
+		workers.emplace_back(&WorkerPool::workerLoop, this);
+}
+
+WorkerPool::~WorkerPool()
+{
+	{
+		lock_guard<std::mutex> lock(mutex);
+		stop = true;
+	}
+	start_cv.notify_all();
+	for (auto& worker : workers)
+		worker.join();
+}
+
+int WorkerPool::numChunks(int count, int chunk_size)
+{
+	return (count + chunk_size - 1) / chunk_size;
+}
+
+void WorkerPool::parallelFor(int count, int chunk_size, const Job& job)
+{
+	chunk_size = max(chunk_size, 1);
+	int chunks = numChunks(count, chunk_size);
+	if (chunks == 0)
+		return;
+
+	// Not worth waking anyone up
+	if (chunks == 1 || workers.empty())
+	{
+		for (int i = 0; i < chunks; ++i)
+			job(i, i * chunk_size, min(count, (i + 1) * chunk_size));
+		return;
+	}
+
+	lock_guard<std::mutex> dispatch_lock(dispatch_mutex);
+	{
+		lock_guard<std::mutex> lock(mutex);
+		this->job = &job;
+		this->count = count;
+		this->chunk_size = chunk_size;
+		num_chunks = chunks;
+		next_chunk = 0;
+		busy_workers = workers.size();
+		++generation;
+	}
+	start_cv.notify_all();
+
+	runChunks();
+
+	// Every worker has to check in, so that no one touches the job after we return
+	unique_lock<std::mutex> lock(mutex);
+	done_cv.wait(lock, [this] { return busy_workers == 0; });
+	this->job = nullptr;
+}
+
+void WorkerPool::runChunks()
+{
+	for (int i = next_chunk++; i < num_chunks; i = next_chunk++)
+		(*job)(i, i * chunk_size, min(count, (i + 1) * chunk_size));
+}
+
+void WorkerPool::workerLoop()
+{
+	unsigned seen = 0;
+	while (true)
+	{
+		{
+			unique_lock<std::mutex> lock(mutex);
+			start_cv.wait(lock, [&] { return stop || generation != seen; });
+			if (stop)
+				return;
+			seen = generation;
+		}
+
+		runChunks();
+
+		lock_guard<std::mutex> lock(mutex);
+		if (--busy_workers == 0)
+			done_cv.notify_one();
+	}
+}
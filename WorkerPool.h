@@ -0,0 +1,49 @@
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+
+// A persistent pool of worker threads for data parallel loops.
+// The pool is a singleton, threads are created on first use and live until exit.
+class WorkerPool
+{
+public:
+	// job(chunk, begin, end) is called once for every chunk
+	using Job = std::function<void(int, int, int)>;
+
+	static WorkerPool* Instance();
+	~WorkerPool();
+
+	// Split [0, count) into chunks of chunk_size items and run them on all
+	// workers and the calling thread, returns after every chunk is done.
+	// Jobs must not call parallelFor themselves.
+	void parallelFor(int count, int chunk_size, const Job& job);
+
+	static int numChunks(int count, int chunk_size);
+	int numThreads() const { return workers.size() + 1; }
+
+private:
+	WorkerPool();
+	WorkerPool(const WorkerPool&) = delete;
+	WorkerPool& operator=(const WorkerPool&) = delete;
+
+	void workerLoop();
+	void runChunks();
+
+	std::vector<std::thread> workers;
+	std::mutex dispatch_mutex;		// one parallelFor at a time
+	std::mutex mutex;
+	std::condition_variable start_cv, done_cv;
+	bool stop{false};
+	unsigned generation{0};
+	int busy_workers{0};
+
+	// Current job
+	const Job* job{nullptr};
+	int count{0}, chunk_size{1}, num_chunks{0};
+	std::atomic<int> next_chunk{0};
+};
@@ -0,0 +1,245 @@
+// Headless benchmark of the pose -> skeleton -> skinning -> submission pipeline.
+// It needs neither FLTK nor OpenGL, so it runs on machines without a display or GPU.
+//
+// Build from the repository root, against the installed assimp, with this one
+// command (wrapped here):
+//   g++ -std=c++14 -O2 -pthread -I. -Iassimp-5.0.1 -o pipeline_bench bench/pipeline_bench.cpp
+//       ModelHelper.cpp ModelCache.cpp Skinning.cpp Crowd.cpp Frustum.cpp MeshSimplifier.cpp WorkerPool.cpp bitmap.cpp -lassimp
+//
+// Usage:
+//   pipeline_bench [model.dae] [bone.txt] [frames] [max p99 frame ms] [linear|dq] [herd size]
+// With a frame budget the exit code is 1 if the p99 frame time exceeds it,
+// so that the benchmark can gate regressions. With a herd, every frame also
+// poses, skins and submits that many walking copies of the first mesh.
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <new>
+#include <algorithm>
+
+#include "ModelHelper.h"
+#include "Skinning.h"
+#include "WorkerPool.h"
+#include "Crowd.h"
+
+using namespace std;
+
+ModelHelper helper;
+
+// Every allocation goes through here, so that allocations per frame can be reported
+static atomic<long long> allocations{0};
+
+void* operator new(size_t size)
+{
+	++allocations;
+	if (void* ptr = malloc(size == 0 ? 1 : size))
+		return ptr;
+	throw bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept
+{
+	free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept
+{
+	free(ptr);
+}
+
+enum Stage
+{
+	CONTROLS, ANIMATE, SKELETON, SKINNING, SUBMIT, CROWD, FRAME, NUM_STAGES
+};
+
+static const char* stage_names[NUM_STAGES] = {
+	"controls", "animate", "skeleton", "skinning", "submit", "crowd", "frame"
+};
+
+// Bones driven by the scripted sliders, like applyMeshControls does with the UI
+static const ControlBone controlled_bones[] = {
+	BONE_NECK, BONE_HEAD,
+	BONE_FORE_LIMP_LEFT_1, BONE_FORE_LIMP_RIGHT_1, BONE_REAR_LIMP_LEFT_1, BONE_REAR_LIMP_RIGHT_1,
+	BONE_FORE_LIMP_LEFT_2, BONE_FORE_LIMP_RIGHT_2, BONE_REAR_LIMP_LEFT_2, BONE_REAR_LIMP_RIGHT_2,
+	BONE_FORE_LIMP_LEFT_3, BONE_FORE_LIMP_RIGHT_3, BONE_REAR_LIMP_LEFT_3, BONE_REAR_LIMP_RIGHT_3,
+	BONE_TAIL
+};
+
+// Deterministic slider values, every bone moves at its own pace
+static void applyScriptedControls(Mesh& mesh, int frame)
+{
+	const BoneHandle* bones = mesh.controlBones();
+	mesh.restoreIdentity(bones[BONE_MAIN]);
+	mesh.applyRotationX(bones[BONE_MAIN], sin(frame * 0.01f) * 30.f);
+	mesh.applyTranslate(bones[BONE_MAIN], aiVector3D(sin(frame * 0.02f), 0, cos(frame * 0.02f)));
+
+	for (ControlBone bone : controlled_bones)
+	{
+		float phase = frame * 0.05f + bone;
+		mesh.restoreIdentity(bones[bone]);
+		mesh.applyRotationZ(bones[bone], sin(phase) * 30.f);
+		mesh.applyRotationX(bones[bone], cos(phase) * 10.f);
+	}
+}
+
+// Without a GL context, submission is approximated by reading every indexed
+// vertex the way glDrawElements would
+static float submitMesh(const Mesh& mesh, const vector<Vertex>& vertices)
+{
+	float sum = 0.f;
+	for (unsigned int index : mesh.indices)
+	{
+		const Vertex& vertex = vertices[index];
+		sum += vertex.world_pos.x + vertex.normal.y + vertex.tex_coords.x;
+	}
+	return sum;
+}
+
+static double percentile(vector<double>& samples, double p)
+{
+	if (samples.empty())
+		return 0.0;
+	sort(samples.begin(), samples.end());
+	int index = min<int>(samples.size() - 1, int(p / 100.0 * samples.size()));
+	return samples[index];
+}
+
+int main(int argc, char** argv)
+{
+	string model = argc > 1 ? argv[1] : "./models/lowpolydeer_1.3.dae";
+	string bone = argc > 2 ? argv[2] : "./models/lowpolydeer_bone_1.1.txt";
+	int frames = argc > 3 ? atoi(argv[3]) : 1000;
+	double budget = argc > 4 ? atof(argv[4]) : 0.0;
+	SkinningMethod method = argc > 5 && string(argv[5]) == "dq" ? SkinningMethod::DUAL_QUATERNION : SkinningMethod::LINEAR;
+	int herd_size = argc > 6 ? atoi(argv[6]) : 0;
+
+	try
+	{
+		auto start = chrono::steady_clock::now();
+		helper.loadModel(model, bone);
+		double load_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+		cout << "Loaded " << model << " in " << load_ms << " ms" << endl;
+	}
+	catch (const exception& e)
+	{
+		cerr << "failed to load " << model << ": " << e.what() << endl;
+		return 2;
+	}
+
+	// Same attachments as the modeler
+	for (int i : {1, 2, 3, 8, 9, 10})
+		if (i < helper.meshes.size())
+			helper.meshes[i].parent = &helper.meshes[0];
+
+	int total_vertices = 0;
+	for (auto& mesh : helper.meshes)
+	{
+		mesh.setSkinningMethod(method);
+		total_vertices += mesh.skin.num_vertices;
+	}
+	cout << helper.meshes.size() << " meshes, " << total_vertices << " vertices, "
+		<< WorkerPool::Instance()->numThreads() << " threads, "
+		<< skinningKernelName(skinning_kernel) << (method == SkinningMethod::LINEAR ? " linear" : " dual quaternion")
+		<< " kernel" << endl;
+
+	Crowd crowd;
+	if (herd_size > 0)
+	{
+		crowd.build(0, herd_size, 14.f);
+		cout << "Herd of " << crowd.size() << " instances, " << crowd.size() * double(helper.meshes[0].skin.num_vertices)
+			<< " vertices" << endl;
+	}
+
+	vector<vector<double>> samples(NUM_STAGES);
+	for (auto& stage : samples)
+		stage.reserve(frames);
+
+	long long frame_allocations = 0;
+	float checksum = 0.f;
+	double skinning_total = 0.0;
+	double crowd_total = 0.0;
+
+	for (int frame = 0; frame < frames; ++frame)
+	{
+		long long allocations_before = allocations;
+		double elapsed[NUM_STAGES] = {0.0};
+		auto frame_start = chrono::steady_clock::now();
+		auto last = frame_start;
+		auto lap = [&](Stage stage)
+		{
+			auto now = chrono::steady_clock::now();
+			elapsed[stage] += chrono::duration<double, milli>(now - last).count();
+			last = now;
+		};
+
+		helper.active_index = 0;
+		applyScriptedControls(helper.meshes[0], frame);
+		lap(CONTROLS);
+		animate();
+		lap(ANIMATE);
+
+		for (auto& mesh : helper.meshes)
+		{
+			helper.evaluateSkeleton(mesh);
+			lap(SKELETON);
+			processVertices(mesh);
+			lap(SKINNING);
+			checksum += submitMesh(mesh, mesh.vertices);
+			lap(SUBMIT);
+		}
+
+		if (herd_size > 0)
+		{
+			crowd.update(helper, tick, method);
+			for (auto& instance : crowd.instances)
+				checksum += submitMesh(helper.meshes[0], instance.vertices);
+			lap(CROWD);
+		}
+
+		elapsed[FRAME] = chrono::duration<double, milli>(last - frame_start).count();
+		for (int i = 0; i < NUM_STAGES; ++i)
+			samples[i].push_back(elapsed[i]);
+		skinning_total += elapsed[SKINNING];
+		crowd_total += elapsed[CROWD];
+
+		// The first frame sizes every buffer
+		if (frame > 0)
+			frame_allocations += allocations - allocations_before;
+	}
+
+	cout << endl << left << setw(10) << "stage" << right << setw(10) << "p50 ms" << setw(10) << "p90 ms"
+		<< setw(10) << "p99 ms" << setw(10) << "max ms" << endl;
+	cout << fixed << setprecision(4);
+	double frame_p99 = 0.0;
+	for (int i = 0; i < NUM_STAGES; ++i)
+	{
+		double p50 = percentile(samples[i], 50), p90 = percentile(samples[i], 90), p99 = percentile(samples[i], 99);
+		double max_ms = samples[i].empty() ? 0.0 : samples[i].back();
+		cout << left << setw(10) << stage_names[i] << right << setw(10) << p50
+			<< setw(10) << p90 << setw(10) << p99 << setw(10) << max_ms << endl;
+		if (i == FRAME)
+			frame_p99 = p99;
+	}
+
+	cout << endl << setprecision(0);
+	if (skinning_total > 0.0)
+		cout << "Skinned vertices per second: " << total_vertices * double(frames) / (skinning_total / 1000.0) << endl;
+	if (crowd_total > 0.0)
+		cout << "Herd instances per second: " << crowd.size() * double(frames) / (crowd_total / 1000.0) << endl;
+	cout << setprecision(2) << "Allocations per frame: "
+		<< (frames > 1 ? double(frame_allocations) / (frames - 1) : 0.0) << endl;
+	cout << "Checksum: " << checksum << endl;
+
+	if (budget > 0.0 && frame_p99 > budget)
+	{
+		cerr << "p99 frame time " << frame_p99 << " ms is over the budget of " << budget << " ms" << endl;
+		return 1;
+	}
+	return 0;
+}
@@ -10,6 +10,7 @@
 //
 
 #include "bitmap.h"
+#include <string.h>
  
 BMP_BITMAPFILEHEADER bmfh; 
 BMP_BITMAPINFOHEADER bmih; 
@@ -1,6 +1,8 @@
 #include "modelerapp.h"
 #include "modelerview.h"
 #include "modelerui.h"
+#include "ControlSnapshot.h"
+#include "FrameScheduler.h"
 
 #include <FL/Fl_Value_Slider.H>
 #include <FL/Fl_Box.H>
@@ -8,6 +10,7 @@
 #include <cstring>
 #include <cstdio>
 #include <cstdlib>
+#include <cstdint>
 
 // CLASS ModelerControl METHODS
 
@@ -74,6 +77,7 @@ void ModelerApplication::Init(ModelerViewCreator_f createView,
     // Store pointers to the controls for manipulation
     m_controlLabelBoxes   = new Fl_Box*[numControls];
     m_controlValueSliders = new Fl_Value_Slider*[numControls];
+    ControlSnapshot::Instance()->reset(numControls);
     
     // Constants for user interface setup
     const int textHeight    = 20;
@@ -102,7 +106,8 @@ void ModelerApplication::Init(ModelerViewCreator_f createView,
         slider->value(controls[i].m_value);
         slider->hide(); 
         m_controlValueSliders[i] = slider;
-        slider->callback((Fl_Callback*)ModelerApplication::SliderCallback);
+        slider->callback((Fl_Callback*)ModelerApplication::SliderCallback, (void*)intptr_t(i));
+        ControlSnapshot::Instance()->set(i, controls[i].m_value);
     }
     m_ui->m_controlsPack->end();
 
@@ -116,6 +121,8 @@ void ModelerApplication::Init(ModelerViewCreator_f createView,
 	m_ui->m_modelerView = createView(0, 0, m_ui->m_modelerWindow->w(), m_ui->m_modelerWindow->h() ,NULL);
 	Fl_Group::current()->resizable(m_ui->m_modelerView);
 	m_ui->m_modelerWindow->end();
+
+	FrameScheduler::Instance()->setView(m_ui->m_modelerView);
 }
 
 ModelerApplication::~ModelerApplication()
@@ -137,7 +144,7 @@ int ModelerApplication::Run()
     // Just tell FLTK to go for it.
    	Fl::visual( FL_RGB | FL_DOUBLE );
 	m_ui->show();
-	Fl::add_timeout(0, ModelerApplication::RedrawLoop, NULL);
+	FrameScheduler::Instance()->requestFrame();
 
 	return Fl::run();
 }
@@ -150,6 +157,7 @@ double ModelerApplication::GetControlValue(int controlNumber)
 void ModelerApplication::SetControlValue(int controlNumber, double value)
 {
     m_controlValueSliders[controlNumber]->value(value);
+    ControlSnapshot::Instance()->set(controlNumber, m_controlValueSliders[controlNumber]->value());
 }
 
 void ModelerApplication::ShowControl(int controlNumber)
@@ -166,16 +174,10 @@ void ModelerApplication::HideControl(int controlNumber)
     m_ui->m_controlsWindow->redraw();
 }
 
-void ModelerApplication::SliderCallback(Fl_Slider *, void *)
-{
-    ModelerApplication::Instance()->m_ui->m_modelerView->redraw();
-}
-
-void ModelerApplication::RedrawLoop(void*)
+void ModelerApplication::SliderCallback(Fl_Slider *slider, void *control)
 {
-	if (ModelerApplication::Instance()->m_animating)
-		ModelerApplication::Instance()->m_ui->m_modelerView->redraw();
+    ControlSnapshot::Instance()->set(int(intptr_t(control)), slider->value());
 
-	// 1/50 second update is good enough
-	Fl::add_timeout(0.025, ModelerApplication::RedrawLoop, NULL);
+    // Dragging a slider calls this far more often than frames are drawn
+    FrameScheduler::Instance()->requestFrame();
 }
\ No newline at end of file
@@ -48,11 +48,12 @@ public:
     // Starts the application, returns when application is closed
 	int  Run();
 
-    // Get and set slider values.
+    // Get and set slider values. Drawing code reads them with VAL instead,
+    // which goes through the ControlSnapshot of the frame.
     double GetControlValue(int controlNumber);
     void   SetControlValue(int controlNumber, double value);
 
-	// Just a flag for updates
+	// Just a flag for updates, FrameScheduler keeps drawing frames while it is set
 	bool m_animating;			// this has been moved to public field
 
 private:
@@ -77,7 +78,6 @@ private:
     Fl_Value_Slider      **m_controlValueSliders;
 
     static void SliderCallback(Fl_Slider *, void*);
-	static void RedrawLoop(void*);
 
 };
 
@@ -2,7 +2,14 @@
 #include <FL/gl.h>
 #include <GL/glu.h>
 #include <cstdio>
+#include <map>
 #include <math.h>
+#include <tuple>
+
+// The Windows SDK headers stop at OpenGL 1.1
+#ifndef GL_RESCALE_NORMAL
+#define GL_RESCALE_NORMAL 0x803A
+#endif
 
 // ********************************************************
 // Support functions from previous version of modeler
@@ -298,24 +305,29 @@ void drawTextureBox( double x, double y, double z )
     // NOT IMPLEMENTED, SORRY (ehsu)
 }
 
-void drawCylinder( double h, double r1, double r2 )
+/* slices of a cylinder around its axis */
+static int _cylinderDivisions( QualitySetting_t quality )
 {
-    ModelerDrawState *mds = ModelerDrawState::Instance();
-    int divisions;
-
-	_setupOpenGl();
-    
-    switch(mds->m_quality)
+    switch(quality)
     {
     case HIGH: 
-        divisions = 32; break;
+        return 32;
     case MEDIUM: 
-        divisions = 20; break;
+        return 20;
     case LOW:
-        divisions = 12; break;
+        return 12;
     case POOR:
-        divisions = 8; break;
+    default:
+        return 8;
     }
+}
+
+void drawCylinder( double h, double r1, double r2 )
+{
+    ModelerDrawState *mds = ModelerDrawState::Instance();
+    int divisions = _cylinderDivisions(mds->m_quality);
+
+	_setupOpenGl();
     
     if (mds->m_rayFile)
     {
@@ -645,7 +657,7 @@ void drawTriangle( double x1, double y1, double z1,
     }
 }
 
-void drawTriangle(Mesh& mesh, const aiFace& face)
+void drawTriangle(const std::vector<Vertex>& vertices, const unsigned int* face)
 {
 	ModelerDrawState *mds = ModelerDrawState::Instance();
 
@@ -653,9 +665,9 @@ void drawTriangle(Mesh& mesh, const aiFace& face)
 
     float x1, x2, x3, y1, y2, y3, z1, z2, z3;
 
-	auto& v1 = mesh.vertices[face.mIndices[0]];
-	auto& v2 = mesh.vertices[face.mIndices[1]];
-	auto& v3 = mesh.vertices[face.mIndices[2]];
+	auto& v1 = vertices[face[0]];
+	auto& v2 = vertices[face[1]];
+	auto& v3 = vertices[face[2]];
 
     x1 = v1.world_pos.x;
 	x2 = v2.world_pos.x;
@@ -679,30 +691,177 @@ void drawTriangle(Mesh& mesh, const aiFace& face)
     }
     else
     {
-        float a, b, c, d, e, f;
-        
-        /* the normal to the triangle is the cross product of two of its edges. */
-        a = x2-x1;
-        b = y2-y1;
-        c = z2-z1;
-        
-        d = x3-x1;
-        e = y3-y1;
-        f = z3-z1;
-
+        /* vertex normals are skinned along with the positions */
         glBegin( GL_TRIANGLES );
-        glNormal3f( b*f - c*e, c*d - a*f, a*e - b*d );
-
+        glNormal3f( v1.normal.x, v1.normal.y, v1.normal.z );
     		glTexCoord2f(v1.tex_coords.x, v1.tex_coords.y);
         glVertex3f( x1, y1, z1 );
+        glNormal3f( v2.normal.x, v2.normal.y, v2.normal.z );
     		glTexCoord2f(v2.tex_coords.x, v2.tex_coords.y);
         glVertex3f( x2, y2, z2 );
+        glNormal3f( v3.normal.x, v3.normal.y, v3.normal.z );
     		glTexCoord2f(v3.tex_coords.x, v3.tex_coords.y);
         glVertex3f( x3, y3, z3 );
         glEnd();
     }
 }
 
+void drawMesh(Mesh& mesh)
+{
+	drawMesh(mesh, mesh.vertices);
+}
+
+void drawMesh(const Mesh& mesh, const std::vector<Vertex>& skinned)
+{
+	ModelerDrawState *mds = ModelerDrawState::Instance();
+
+	if (mds->m_rayFile)
+	{
+		for (int i = 0; i < mesh.indices.size(); i += 3)
+			drawTriangle(skinned, &mesh.indices[i]);
+		return;
+	}
+
+	if (mesh.indices.empty())
+		return;
+
+	_setupOpenGl();
+
+	/* skinned normals are already unit length, rescaling is enough for a uniformly scaled modelview */
+	GLboolean normalize = glIsEnabled( GL_NORMALIZE );
+	glDisable( GL_NORMALIZE );
+	glEnable( GL_RESCALE_NORMAL );
+
+	/* positions, normals and texture coords are interleaved in Vertex */
+	const Vertex* vertices = skinned.data();
+	glEnableClientState( GL_VERTEX_ARRAY );
+	glEnableClientState( GL_NORMAL_ARRAY );
+	glEnableClientState( GL_TEXTURE_COORD_ARRAY );
+	glVertexPointer( 3, GL_FLOAT, sizeof(Vertex), &vertices->world_pos );
+	glNormalPointer( GL_FLOAT, sizeof(Vertex), &vertices->normal );
+	glTexCoordPointer( 2, GL_FLOAT, sizeof(Vertex), &vertices->tex_coords );
+
+	glDrawElements( GL_TRIANGLES, mesh.indices.size(), GL_UNSIGNED_INT, mesh.indices.data() );
+
+	glDisableClientState( GL_TEXTURE_COORD_ARRAY );
+	glDisableClientState( GL_NORMAL_ARRAY );
+	glDisableClientState( GL_VERTEX_ARRAY );
+
+	glDisable( GL_RESCALE_NORMAL );
+	if (normalize)
+		glEnable( GL_NORMALIZE );
+}
+
+const UnitCylinder& unitCylinder(float r1, float r2)
+{
+	static std::map<std::tuple<int, float, float>, UnitCylinder> cylinders;
+	QualitySetting_t quality = ModelerDrawState::Instance()->m_quality;
+	UnitCylinder& cylinder = cylinders[std::make_tuple(int(quality), r1, r2)];
+	if (!cylinder.positions.empty())
+		return cylinder;
+
+	/* rings at the bottom and top of the side, then the bottom and top caps, each a center and a ring */
+	unsigned int d = _cylinderDivisions(quality);
+	cylinder.positions.resize(4 * d + 2);
+	cylinder.normals.resize(4 * d + 2);
+	for (unsigned int i = 0; i < d; ++i)
+	{
+		float angle = 2.f * AI_MATH_PI_F * i / d;
+		aiVector3D ring(cos(angle), sin(angle), 0.f);
+		aiVector3D side(ring.x, ring.y, r1 - r2);
+		cylinder.positions[i] = cylinder.positions[2 * d + 1 + i] = ring * r1;
+		cylinder.positions[d + i] = cylinder.positions[3 * d + 2 + i] = ring * r2 + aiVector3D(0.f, 0.f, 1.f);
+		cylinder.normals[i] = cylinder.normals[d + i] = side / side.Length();
+		cylinder.normals[2 * d + 1 + i] = aiVector3D(0.f, 0.f, -1.f);
+		cylinder.normals[3 * d + 2 + i] = aiVector3D(0.f, 0.f, 1.f);
+	}
+	cylinder.positions[2 * d] = aiVector3D(0.f, 0.f, 0.f);
+	cylinder.normals[2 * d] = aiVector3D(0.f, 0.f, -1.f);
+	cylinder.positions[3 * d + 1] = aiVector3D(0.f, 0.f, 1.f);
+	cylinder.normals[3 * d + 1] = aiVector3D(0.f, 0.f, 1.f);
+
+	/* counterclockwise seen from outside */
+	for (unsigned int i = 0; i < d; ++i)
+	{
+		unsigned int j = (i + 1) % d;
+		unsigned int side[] = { i, j, d + i, d + i, j, d + j };
+		unsigned int bottom[] = { 2 * d, 2 * d + 1 + j, 2 * d + 1 + i };
+		unsigned int top[] = { 3 * d + 1, 3 * d + 2 + i, 3 * d + 2 + j };
+		cylinder.indices.insert(cylinder.indices.end(), side, side + 6);
+		cylinder.indices.insert(cylinder.indices.end(), bottom, bottom + 3);
+		cylinder.indices.insert(cylinder.indices.end(), top, top + 3);
+	}
+	return cylinder;
+}
+
+/* vertices of the buffer drawInstances fills, it is drawn whenever the next copy does not fit */
+static const unsigned int kInstanceBatchVertices = 1 << 16;
+
+/* copies of a cylinder moved into place on the CPU, kept to reuse their memory */
+class InstanceBatch
+{
+public:
+	std::vector<aiVector3D> positions, normals;
+	std::vector<unsigned int> indices;
+};
+
+static void _drawInstanceBatch( InstanceBatch& batch )
+{
+	if (batch.indices.empty())
+		return;
+
+	glEnableClientState( GL_VERTEX_ARRAY );
+	glEnableClientState( GL_NORMAL_ARRAY );
+	glVertexPointer( 3, GL_FLOAT, sizeof(aiVector3D), batch.positions.data() );
+	glNormalPointer( GL_FLOAT, sizeof(aiVector3D), batch.normals.data() );
+	glDrawElements( GL_TRIANGLES, batch.indices.size(), GL_UNSIGNED_INT, batch.indices.data() );
+	glDisableClientState( GL_NORMAL_ARRAY );
+	glDisableClientState( GL_VERTEX_ARRAY );
+
+	batch.positions.clear();
+	batch.normals.clear();
+	batch.indices.clear();
+}
+
+void drawInstances( const UnitCylinder& cylinder, const float* transformations, int count )
+{
+	if (count == 0)
+		return;
+
+	_setupOpenGl();
+
+	static InstanceBatch batch;
+	unsigned int num_vertices = cylinder.positions.size();
+	if (batch.positions.capacity() < kInstanceBatchVertices)
+	{
+		batch.positions.reserve(kInstanceBatchVertices);
+		batch.normals.reserve(kInstanceBatchVertices);
+	}
+
+	for (int i = 0; i < count; ++i)
+	{
+		if (batch.positions.size() + num_vertices > kInstanceBatchVertices)
+			_drawInstanceBatch( batch );
+
+		/* columns of the transformation, normals go by the cofactors as it may scale unevenly */
+		const float* m = transformations + 16 * i;
+		aiVector3D x(m[0], m[1], m[2]), y(m[4], m[5], m[6]), z(m[8], m[9], m[10]), t(m[12], m[13], m[14]);
+		aiVector3D nx = y ^ z, ny = z ^ x, nz = x ^ y;
+
+		unsigned int base = batch.positions.size();
+		for (unsigned int v = 0; v < num_vertices; ++v)
+		{
+			const aiVector3D& p = cylinder.positions[v];
+			const aiVector3D& n = cylinder.normals[v];
+			batch.positions.push_back(x * p.x + y * p.y + z * p.z + t);
+			batch.normals.push_back((nx * n.x + ny * n.y + nz * n.z).NormalizeSafe());
+		}
+		for (unsigned int index : cylinder.indices)
+			batch.indices.push_back(base + index);
+	}
+	_drawInstanceBatch( batch );
+}
+
 void drawNurbs(float* control_points, int width, int height)
 {
 	GLUnurbs* nurbs_renderer = gluNewNurbsRenderer();
@@ -726,3 +885,14 @@ void drawNurbs(float* control_points, int width, int height)
 	delete [] s_knots;
 	delete [] t_knots;
 }
+
+Frustum currentFrustum()
+{
+    if (ModelerDrawState::Instance()->m_rayFile)
+        return Frustum();
+
+    float projection[16], modelview[16];
+    glGetFloatv(GL_PROJECTION_MATRIX, projection);
+    glGetFloatv(GL_MODELVIEW_MATRIX, modelview);
+    return Frustum(projection, modelview);
+}
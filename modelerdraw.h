@@ -11,6 +11,7 @@
 
 #include "modelerglobals.h"
 #include "ModelHelper.h"
+#include "Frustum.h"
 
 
 enum DrawModeSetting_t 
@@ -114,8 +115,36 @@ void drawSlice( double x1, double y1, double z1,
 				double x3, double y3, double z3,
 				double x4, double y4, double z4);
 
-void drawTriangle( Mesh& mesh, const aiFace& face );
+// face points to the 3 indices of the triangle into vertices
+void drawTriangle( const std::vector<Vertex>& vertices, const unsigned int* face );
+
+// Draw a whole skinned mesh in one call, or face by face to a .ray file
+void drawMesh( Mesh& mesh );
+
+// Same with the faces of mesh and vertices skinned elsewhere, e.g. by a CharacterInstance
+void drawMesh( const Mesh& mesh, const std::vector<Vertex>& vertices );
 
 void drawNurbs(float* control_points, int width, int height);
 
+// Triangles of a cylinder from z=0 to z=1 with radius r1 at z=0 and r2 at z=1, both
+// ends capped, tessellated like drawCylinder at the current quality. Built once per
+// quality and pair of radii and kept. The caps have vertices of their own.
+class UnitCylinder
+{
+public:
+	std::vector<aiVector3D> positions, normals;
+	std::vector<unsigned int> indices;
+};
+const UnitCylinder& unitCylinder( float r1 = 1.f, float r2 = 1.f );
+
+// Draw cylinder once for every one of count transformations. The copies are moved into
+// place on the CPU and drawn with one glDrawElements per 64k vertices, from a buffer
+// that is reused. Transformations are column-major as glMultMatrixf takes them, 16 floats
+// each, and may scale. OpenGL only, nothing goes to a .ray file.
+void drawInstances( const UnitCylinder& cylinder, const float* transformations, int count );
+
+// Frustum of the current projection and modelview matrices, to cull with before
+// drawing. Contains everything while a .ray file is open, which needs the whole scene.
+Frustum currentFrustum();
+
 #endif
\ No newline at end of file
@@ -1,6 +1,8 @@
 #ifndef _MODELER_GLOBALS_H
 #define _MODELER_GLOBALS_H
 
+#include "ControlSnapshot.h"
+
 #ifndef M_PI
 #define M_PI 3.141592653589793238462643383279502
 #endif
@@ -26,7 +28,7 @@ enum SampleModelControls
 	LEFT_FORELIMP_3_YAW, RIGHT_FORELIMP_3_YAW, LEFT_REARLIMP_3_YAW, RIGHT_REARLIMP_3_YAW,
 	TAIL_PITCH, TAIL_YAW,
 	LIMP_FOLDING,
-	L_SYSTEM_ENABLE, L_SYSTEM_ANGLE, L_SYSTEM_BRANCH_LENGTH,
+	L_SYSTEM_ENABLE, L_SYSTEM_ANGLE, L_SYSTEM_BRANCH_LENGTH, L_SYSTEM_FOREST, L_SYSTEM_SEED,
 	CURVE_ENABLE,CURVE_ROTATION,
 	POINT_X1, POINT_Y1, POINT_Z1,
 	POINT_X2, POINT_Y2, POINT_Z2,
@@ -37,6 +39,10 @@ enum SampleModelControls
 	TORUS_PX, TORUS_PY, TORUS_PZ, TORUS_RX, TORUS_RY, TORUS_RZ,
 	TORUS_FLOWER, TORUS_PETAL,
 	DRAW_NURBS,
+	DUAL_QUAT_SKINNING,
+	CROWD_SIZE, CROWD_SPACING,
+	AUTO_LOD, LOD_PIXEL_ERROR,
+	FRUSTUM_CULLING,
 	NUMCONTROLS
 };
 
@@ -45,8 +51,8 @@ enum SampleModelControls
 #define COLOR_GREEN		0.0f, 1.0f, 0.0f
 #define COLOR_BLUE		0.0f, 0.0f, 1.0f
 
-// We'll be getting the instance of the application a lot; 
-// might as well have it as a macro.
-#define VAL(x) (ModelerApplication::Instance()->GetControlValue(x))
+// We'll be getting the values of the controls a lot; 
+// might as well have it as a macro. Reads the snapshot taken at the start of the frame.
+#define VAL(x) (ControlSnapshot::Instance()->value(x))
 
 #endif
\ No newline at end of file
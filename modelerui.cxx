@@ -4,6 +4,8 @@
 #include "modelerui.h"
 #include "modelerapp.h"
 #include "IKSolver.h"
+#include "Profiler.h"
+#include "FrameScheduler.h"
 
 #include "camera.h"
 
@@ -312,6 +314,22 @@ void ModelerUserInterface::cb_showIkDialog(Fl_Menu_* o, void*)
 	((ModelerUserInterface*)(o->parent()->user_data()))->m_ikDialog->show();
 }
 
+// Start over with empty statistics every time the profiler is switched on
+void ModelerUserInterface::cb_profilerEnable(Fl_Menu_* o, void*)
+{
+	Profiler::enabled = o->mvalue()->value() != 0;
+	if (Profiler::enabled)
+		Profiler::Instance()->clear();
+	((ModelerUserInterface*)(o->parent()->user_data()))->m_modelerView->redraw();
+}
+
+void ModelerUserInterface::cb_SaveTrace(Fl_Menu_* o, void*)
+{
+	char *filename = fl_file_chooser("Save Trace File", "*.json", NULL);
+	if (filename && !Profiler::Instance()->writeTrace(filename))
+		fl_alert("Error writing file.");
+}
+
 inline void ModelerUserInterface::cb_Normal_i(Fl_Menu_*, void*) {
   setDrawMode(NORMAL);
 m_modelerView->redraw();
@@ -379,6 +397,7 @@ void ModelerUserInterface::cb_Focus(Fl_Menu_* o, void* v) {
 
 inline void ModelerUserInterface::cb_m_controlsAnimOnMenu_i(Fl_Menu_*, void*) {
   ModelerApplication::Instance()->m_animating = (m_controlsAnimOnMenu->value() == 0) ? false : true;
+  FrameScheduler::Instance()->setAnimating(ModelerApplication::Instance()->m_animating);
 }
 void ModelerUserInterface::cb_m_controlsAnimOnMenu(Fl_Menu_* o, void* v) {
   ((ModelerUserInterface*)(o->parent()->user_data()))->cb_m_controlsAnimOnMenu_i(o,v);
@@ -406,6 +425,10 @@ Fl_Menu_Item ModelerUserInterface::menu_m_controlsMenuBar[] = {
  {"Animate", 0,  0, 0, 64, 0, 0, 14, 0},
  {"Enable", 0,  (Fl_Callback*)ModelerUserInterface::cb_m_controlsAnimOnMenu, 0, 2, 0, 0, 14, 0},
  {0},
+	{"Profiler", 0,  0, 0, 64, 0, 0, 14, 0},
+	{"Show Overlay", 0, (Fl_Callback*)ModelerUserInterface::cb_profilerEnable, 0, 2, 0, 0, 14, 0},
+	{"Save Trace File", 0, (Fl_Callback*)ModelerUserInterface::cb_SaveTrace, 0, 0, 0, 0, 14, 0},
+	{0},
 	{"IK Solver", 0, (Fl_Callback*)ModelerUserInterface::cb_showIkDialog, 0, 0},
 	{0},
  {0}
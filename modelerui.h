@@ -76,6 +76,8 @@ private:
   static void cb_FrameAll(Fl_Menu_*, void*);
 
 	static void cb_showIkDialog(Fl_Menu_*, void*);
+	static void cb_profilerEnable(Fl_Menu_*, void*);
+	static void cb_SaveTrace(Fl_Menu_*, void*);
 
   inline void cb_SavePos_i(Fl_Menu_*, void*);
   static void cb_SavePos(Fl_Menu_*, void*);
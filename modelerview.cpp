@@ -6,6 +6,9 @@
 #include <FL/gl.h>
 #include <GL/glu.h>
 #include <cstdio>
+#include <algorithm>
+#include "Profiler.h"
+#include "FrameScheduler.h"
 
 static const int	kMouseRotationButton			= FL_LEFT_MOUSE;
 static const int	kMouseTranslationButton			= FL_MIDDLE_MOUSE;
@@ -87,7 +90,8 @@ int ModelerView::handle(int event)
 		return 0;
 	}
 	
-	redraw();
+	// Mouse events come faster than frames, the scheduler draws one for all of them
+	FrameScheduler::Instance()->requestFrame();
 
 	return 1;
 }
@@ -127,6 +131,66 @@ void ModelerView::draw()
 	glLightfv( GL_LIGHT1, GL_DIFFUSE, lightDiffuse1 );
 }
 
+void ModelerView::drawProfilerOverlay()
+{
+	Profiler* profiler = Profiler::Instance();
+	const int line_height = 14, width = 260, bar_width = 80;
+	const int height = (kNumProfileStages + 2) * line_height + 8;
+
+	glPushAttrib( GL_ENABLE_BIT | GL_CURRENT_BIT | GL_COLOR_BUFFER_BIT );
+	glDisable( GL_LIGHTING );
+	glDisable( GL_DEPTH_TEST );
+	glDisable( GL_TEXTURE_2D );
+	glEnable( GL_BLEND );
+	glBlendFunc( GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA );
+
+	// Window coordinates, origin at the bottom left
+	glMatrixMode( GL_PROJECTION );
+	glPushMatrix();
+	glLoadIdentity();
+	glOrtho( 0, w(), 0, h(), -1, 1 );
+	glMatrixMode( GL_MODELVIEW );
+	glPushMatrix();
+	glLoadIdentity();
+
+	int top = h() - 4;
+	glColor4f( 0.f, 0.f, 0.f, 0.6f );
+	glRecti( 4, top - height, 4 + width, top );
+
+	char text[64];
+	gl_font( FL_HELVETICA, 12 );
+	glColor3f( 1.f, 1.f, 1.f );
+	sprintf( text, "%-12s %7s %7s", "stage", "avg ms", "max ms" );
+	gl_draw( text, 8.f, float(top - line_height) );
+
+	// Bars show the share of every stage in the average frame
+	double frame = profiler->average( ProfileStage::FRAME );
+	for (int i = 0; i < kNumProfileStages; ++i)
+	{
+		ProfileStage stage = ProfileStage(i);
+		double average = profiler->average( stage );
+		int y = top - (i + 2) * line_height;
+
+		glColor4f( 0.2f, 0.7f, 1.f, 0.8f );
+		int bar = frame > 0.0 ? int(bar_width * std::min(average / frame, 1.0)) : 0;
+		glRecti( width - bar_width, y, width - bar_width + bar, y + line_height - 4 );
+
+		glColor3f( 1.f, 1.f, 1.f );
+		sprintf( text, "%-12s %7.3f %7.3f", Profiler::stageName( stage ), average, profiler->maximum( stage ) );
+		gl_draw( text, 8.f, float(y) );
+	}
+
+	FrameScheduler* scheduler = FrameScheduler::Instance();
+	sprintf( text, "%-12s %7.1f %7.0f", "fps / target", scheduler->frameRate(), scheduler->targetFrameRate() );
+	gl_draw( text, 8.f, float(top - (kNumProfileStages + 2) * line_height) );
+
+	glPopMatrix();
+	glMatrixMode( GL_PROJECTION );
+	glPopMatrix();
+	glMatrixMode( GL_MODELVIEW );
+	glPopAttrib();
+}
+
 /*
 void ModelerView::moveLight0(float x, float y, float z) {
 	lightPosition0[0] = x;
@@ -28,6 +28,9 @@ public:
     virtual int handle(int event);
     virtual void draw();
 
+    // Per stage frame times of the Profiler, drawn over the scene
+    void drawProfilerOverlay();
+
     bool l_button_pressed{false};
 	bool r_button_pressed{false};
 
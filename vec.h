@@ -4,7 +4,7 @@
 // Stupid FLTK includes iostream.h, so I can't include the official 
 // STL version of iostream.  Damn it all to bloody hell!  -- ehsu
 
-#if _MSC_VER >= 1300
+#if _MSC_VER >= 1300 || defined(__GNUC__)
 
 #include <iostream>
 using namespace std;
@@ -99,14 +99,13 @@ public:
 
 	//---[ Friend Methods ]----------------------
 
-#if _MSC_VER >= 1300
+#if _MSC_VER >= 1300 || defined(__GNUC__)
 
 	template <class U> friend U operator *( const Vec<U>& a, const Vec<U>& b );
 	template <class U> friend Vec<U> operator -( const Vec<U>& v );
 	template <class U> friend Vec<U> operator *( const Vec<U>& a, const double d );
 	template <class U> friend Vec<U> operator *( const double d, const Vec<U>& a );
 	template <class U> friend Vec<U> operator /( const Vec<U>& a, const double d );
-	template <class U> friend Vec<U> operator ^( const Vec<U>& a, const Vec<U>& b );
 	template <class U> friend bool operator ==( const Vec<U>& a, const Vec<U>& b );
 	template <class U> friend bool operator !=( const Vec<U>& a, const Vec<U>& b );
 	template <class U> friend ostream& operator <<( ostream& os, const Vec<U>& v );
@@ -122,7 +121,6 @@ public:
 	friend Vec<T> operator *( const Vec<T>& a, const double d );
 	friend Vec<T> operator *( const double d, const Vec<T>& a );
 	friend Vec<T> operator /( const Vec<T>& a, const double d );
-	friend Vec<T> operator ^( const Vec<T>& a, const Vec<T>& b );
 	friend bool operator ==( const Vec<T>& a, const Vec<T>& b );
 	friend bool operator !=( const Vec<T>& a, const Vec<T>& b );
 	friend ostream& operator <<( ostream& os, const Vec<T>& v );
@@ -208,7 +206,7 @@ public:
 
 	//---[ Friend Methods ]----------------------
 
-#if _MSC_VER >= 1300
+#if _MSC_VER >= 1300 || defined(__GNUC__)
 
 	template<class U> friend U operator *( const Vec3<U>& a, const Vec4<U>& b );
 	template<class U> friend U operator *( const Vec4<U>& b, const Vec3<U>& a );
@@ -328,7 +326,7 @@ public:
 	
 	//---[ Friend Methods ]----------------------
 
-#if _MSC_VER >= 1300
+#if _MSC_VER >= 1300 || defined(__GNUC__)
 
 	template<class U> friend U operator *( const Vec3<U>& a, const Vec4<U>& b );
 	template<class U> friend U operator *( const Vec4<U>& b, const Vec3<U>& a );
@@ -557,7 +555,7 @@ Vec<T> operator-( const Vec<T>& v ) {
 	Vec<T>	result( v.numElements, false );
 
 	for( int i=0;i<v.numElements;i++ )
-		result.n[i] = -n[i];
+		result.n[i] = -v.n[i];
 
 	return result;
 }
@@ -592,16 +590,6 @@ Vec<T> operator/( const Vec<T>& a, const double d ) {
 	return result;
 }
 
-template <class T>
-Vec<T> operator^( const Vec<T>& a, const Vec<T>& b ) {
-#ifdef _DEBUG
-	if( a.numElements != b.numElements )
-		throw VectorSizeMismatch();
-#endif
-
-	return *this;
-}
-
 template <class T>
 bool operator==( const Vec<T>& a, const Vec<T>& b ) {
 #ifdef _DEBUG
@@ -822,10 +810,10 @@ inline T operator *(const Vec4<T>& a, const Vec4<T>& b) {
 
 template <class T>
 inline Vec4<T> operator *(const Mat4<T>& a, const Vec4<T>& v) {
-	return Vec3<T>( a.n[0]*v.n[0]+a.n[1]*v.n[1]+a.n[2]*v.n[2]+a.n[3]*v.n[3],
+	return Vec4<T>( a.n[0]*v.n[0]+a.n[1]*v.n[1]+a.n[2]*v.n[2]+a.n[3]*v.n[3],
 					a.n[4]*v.n[0]+a.n[5]*v.n[1]+a.n[6]*v.n[2]+a.n[7]*v.n[3],
 					a.n[8]*v.n[0]+a.n[9]*v.n[1]+a.n[10]*v.n[2]+a.n[11]*v.n[3],
-					a.n[12]*v.n[0]+a.n[13]*v.n[1]+a.n[14]*v.n[2]+a.n[15]*v.n[3],);
+					a.n[12]*v.n[0]+a.n[13]*v.n[1]+a.n[14]*v.n[2]+a.n[15]*v.n[3]);
 }
 
 template <class T>